@@ -0,0 +1,68 @@
+#ifndef ANALYZER_H
+#define ANALYZER_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "track-data.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ANALYZE_TOP_RANGES 5
+
+// Per-track counts
+typedef struct {
+    uint64_t events;        // channel messages
+    uint64_t notes;         // note-ons with velocity > 0
+    uint64_t meta_events;   // meta and SysEx events
+    uint32_t max_long_msg;  // longest meta/SysEx payload in bytes
+    uint64_t last_tick;
+} TrackProfile;
+
+typedef struct {
+    int64_t start_100ns;
+    uint64_t events;
+} DensityRange;
+
+typedef struct {
+    int track_count;
+    TrackProfile* tracks;
+
+    uint64_t total_events;
+    uint64_t total_notes;
+    uint64_t total_meta;
+    uint64_t max_track_events;
+    uint32_t max_long_msg;
+    uint32_t tempo_changes;
+    int64_t duration_100ns;
+    uint32_t max_polyphony[16];
+
+    // Peaks per window length, in notes and events per second
+    int window_count;
+    uint32_t* window_ms;
+    double* peak_nps;
+    double* peak_eps;
+
+    // Busiest non-overlapping windows of window_ms[0]
+    int top_count;
+    DensityRange top[ANALYZE_TOP_RANGES];
+
+    int threads;
+    long analyze_ms;
+} MidiProfile;
+
+// Profiles freshly loaded tracks without consuming them. Tracks are decoded
+// in parallel; rates are resolved at 1 ms, polyphony follows every event.
+// windows_ms lists the window lengths for peak rates (at least one).
+MidiProfile* analyze_midi(const TrackData* tracks, int track_count, uint16_t time_div,
+                          const uint32_t* windows_ms, int window_count);
+void print_midi_profile(const MidiProfile* profile, const char* filename, FILE* out);
+void free_midi_profile(MidiProfile* profile);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // ANALYZER_H
@@ -0,0 +1,82 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Bump allocator over one anonymous mapping. Everything a loaded file needs
+// during playback (TrackData array, event data, long message buffers) lives
+// in one arena, is sized before playback and freed together, so the playback
+// thread never calls the allocator.
+
+typedef enum {
+    HUGE_PAGES_OFF,
+    HUGE_PAGES_TRANSPARENT,   // madvise(MADV_HUGEPAGE)
+    HUGE_PAGES_EXPLICIT,      // MAP_HUGETLB, falls back to normal pages
+} HugePageMode;
+
+// Process-wide, since mlock limits and huge page pools are too
+typedef struct {
+    HugePageMode huge_pages;
+    bool prefault;    // touch every page before playback (default on)
+    bool lock;        // mlock the arena so it is never paged out
+    int numa_node;    // prefer memory on this node, -1 for the default policy
+} ArenaPolicy;
+
+typedef struct {
+    uint8_t* base;
+    size_t reserved;   // bytes mapped
+    size_t used;
+    size_t page_size;
+    size_t lazy_from;  // see arena_begin_lazy, 0 when not called
+    bool huge;         // mapped with MAP_HUGETLB
+    bool locked;
+} Arena;
+
+void arena_set_policy(const ArenaPolicy* policy);
+const ArenaPolicy* arena_policy(void);
+
+// Reserves address space for up to capacity bytes; pages are only backed
+// once touched. The Arena itself sits at the start of the mapping.
+Arena* arena_create(size_t capacity);
+
+// Never fails once the capacity given to arena_create is respected;
+// returns NULL past it
+void* arena_alloc(Arena* arena, size_t size, size_t align);
+
+// Shrinks the latest allocation, block, to size bytes, e.g. a buffer that
+// was sized for a worst case before it was filled
+void arena_shrink_last(Arena* arena, void* block, size_t size);
+
+// Everything allocated after this is left out of prefaulting and locking:
+// for buffers that are filled while playback already runs, or sized for a
+// worst case that is rarely reached
+void arena_begin_lazy(Arena* arena);
+
+// Call once everything is allocated: gives back the unused reservation,
+// then prefaults and locks according to the policy
+void arena_finish(Arena* arena);
+
+// Prefaults and locks part of a lazy block once it is known to be needed,
+// after arena_finish. Safe while playback uses the rest of the arena: no
+// byte is changed.
+void arena_commit(Arena* arena, void* block, size_t size);
+
+void arena_destroy(Arena* arena);
+
+// The arena that returned first as its first allocation
+Arena* arena_of_first(void* first);
+
+// mlockall(MCL_CURRENT | MCL_FUTURE) for the whole process
+bool lock_all_memory(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // ARENA_H
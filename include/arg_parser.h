@@ -1,10 +1,43 @@
 #ifndef ARG_PARSER_H
 #define ARG_PARSER_H
 
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "arena.h"
+#include "midi-player.h"
+#include "thread-placement.h"
+
+#define MAX_WINDOWS 8
+
 typedef struct {
-    const char* filename;
+    const char** files;     // files to play in order
+    int file_count;
+    const char* playlist;   // optional playlist file, appended after files
     const char* alsa_port;
+    const char* kdmapi_lib;     // KDMAPI library to load instead of OmniMIDI
+    bool kdmapi_buffered;       // keep events on SendDirectData, not SendDirectDataNoBuf
+    const char* shm_name;       // shared memory ring for an out-of-process synthesizer
+    const char* daemon_socket;  // run as a resident daemon on this socket
     int min_velocity;
+    TransformSpec transform;    // --remap, --transpose, --mute-*, --velocity-curve
+    PlaybackEngine engine;      // inline or buffered scheduling
+    int parser_threads;         // buffered engine decode threads, 0 for one
+    OverloadPolicy overload;    // note-ons shed while playback is late
+    double overload_threshold_ms;
+    bool coalesce;              // drop superseded controller messages
+    double coalesce_window_ms;  // merge ticks closer than this when coalescing
+    double speed;               // initial tempo multiplier
+    bool analyze;               // profile the files instead of playing them
+    const char* capture_path;   // record every sent message to this trace file
+    bool headless;              // no output device, virtual clock
+    bool quiet;                 // no notes-per-second output
+    ArenaPolicy memory;         // huge pages, prefaulting and locking of loaded files
+    const char* pin_cpus[THREAD_ROLE_COUNT];  // CPU list per thread role, NULL to leave alone
+    RealtimePolicy realtime;    // scheduling class for the playback and parser threads
+    int realtime_priority;
+    uint32_t windows_ms[MAX_WINDOWS];  // peak-rate windows for --analyze
+    int window_count;
 } Options;
 
 int parse_args(int argc, char* argv[], Options* opts);
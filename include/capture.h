@@ -0,0 +1,25 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <stdbool.h>
+
+#include "midi-utils.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Capture sink: records every message with its send time to a trace file
+// (see trace.h) and passes it on to forward, which may be NULL for a
+// headless run. Times are counted from capture_start. One capture per
+// process, like the ALSA output.
+bool capture_start(const char* path, SendDirectDataFunc forward);
+void capture_send(uint32_t message);
+// Returns false if the trace could not be written completely
+bool capture_stop(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CAPTURE_H
@@ -0,0 +1,48 @@
+#ifndef COALESCER_H
+#define COALESCER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "midi-utils.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Holds back the channel messages of one tick (or a short window) and
+// drops controller, pitch bend, aftertouch and program change messages
+// that a later message of the same kind replaces before anything can
+// hear them. Notes, bank select, RPN/NRPN data entry and channel mode
+// messages are barriers: nothing on their channel is merged across them,
+// and the order of everything that is sent stays the same.
+typedef struct {
+    uint32_t* events;       // pending messages in order, 0 once superseded
+    size_t count;
+    size_t capacity;
+    uint32_t* owner;        // per key: index + 1 of the pending message
+    uint16_t* touched;      // keys set in owner since the last flush
+    size_t touched_count;
+    uint32_t barrier[16];   // per channel: index + 1 of the last barrier
+    uint64_t dropped;       // superseded messages never sent
+} Coalescer;
+
+bool coalescer_init(Coalescer* c, size_t capacity);
+void coalescer_free(Coalescer* c);
+
+// Queues a channel message, flushing first when the batch is full
+void coalescer_push(Coalescer* c, uint32_t message, SendDirectDataFunc SendDirectData);
+
+// Sends the surviving messages in their original order
+void coalescer_flush(Coalescer* c, SendDirectDataFunc SendDirectData);
+
+static inline bool coalescer_pending(const Coalescer* c) {
+    return c->count > 0;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // COALESCER_H
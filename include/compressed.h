@@ -0,0 +1,59 @@
+#ifndef COMPRESSED_H
+#define COMPRESSED_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// MIDI files stored gzip, xz or zstd compressed, recognized by their first
+// bytes. The loader decompresses them whole, straight into the arena the
+// tracks are played from. Formats that can be split are decoded on several
+// threads: xz files with several blocks (xz -T) and zstd files with several
+// frames (pzstd, or .zst files concatenated). gzip is always one stream.
+typedef enum {
+    COMPRESSION_NONE,
+    COMPRESSION_GZIP,
+    COMPRESSION_XZ,
+    COMPRESSION_ZSTD,
+} Compression;
+
+typedef struct {
+    Compression format;
+    const uint8_t* data;   // the whole compressed file, mapped
+    size_t size;
+} CompressedFile;
+
+// COMPRESSION_NONE for plain MIDI files, and for files that can not be
+// read, which the MIDI loader reports
+Compression compression_detect(const char* filename);
+const char* compression_name(Compression format);
+
+bool compressed_open(CompressedFile* file, const char* filename);
+void compressed_close(CompressedFile* file);
+
+// Largest decompressed size accepted; the sizes come from the file
+#define COMPRESSED_SIZE_MAX (sizeof(size_t) > 4 ? (size_t)1 << 38 : (size_t)1 << 29)
+
+// Decompressed size as the format records it: exact for xz, an upper bound
+// for zstd, and for gzip the size of the last member modulo 4 GiB. 0 when
+// the records are unreadable or add up to more than COMPRESSED_SIZE_MAX.
+size_t compressed_size_bound(const CompressedFile* file);
+
+// Decompresses only the first size bytes, e.g. the header
+bool compressed_peek(const CompressedFile* file, uint8_t* out, size_t size);
+
+// Decompresses everything into out on up to threads threads. A file that
+// is cut short gives what could be decoded. Returns the decompressed size,
+// or (size_t)-1 when the data is corrupt. gzip data larger than capacity
+// returns its full size, with only capacity bytes written: try again.
+size_t compressed_decode(const CompressedFile* file, uint8_t* out, size_t capacity, int threads);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // COMPRESSED_H
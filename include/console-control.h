@@ -0,0 +1,26 @@
+#ifndef CONSOLE_CONTROL_H
+#define CONSOLE_CONTROL_H
+
+#include <stdbool.h>
+#include <stdatomic.h>
+
+#include "playback-control.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Reads transport commands from stdin, one per line, on a background thread:
+//   p          toggle pause
+//   n          skip to the next file
+//   q          stop and quit
+//   + / -      speed up / slow down by 10%
+//   x <speed>  set the tempo multiplier
+// quit is raised by "q" so the caller can leave its playlist loop.
+void console_control_start(PlaybackControl* control, atomic_bool* quit);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CONSOLE_CONTROL_H
@@ -0,0 +1,31 @@
+#ifndef DAEMON_H
+#define DAEMON_H
+
+#include "midi-player.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Resident player: keeps the output sink open and parsed files cached, and
+// takes one command per line on a Unix domain socket. Every command gets a
+// single reply line starting with "ok" or "err".
+//
+//   load <path>      parse and cache a file
+//   play [path]      play a file from the start (default: the current or
+//                    last loaded one)
+//   seek <seconds>   restart the current file at the given position
+//   pause / resume   hold and continue playback (notes are released)
+//   speed <x>        set the tempo multiplier, e.g. 0.5 or 2
+//   stop             stop playback and silence all channels
+//   status           report state, position and cache size
+//   shutdown         stop playback and exit the daemon
+//
+// Returns the process exit code.
+int run_daemon(const char* socket_path, const char* alsa_port, const PlaybackOptions* options);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // DAEMON_H
@@ -2,6 +2,7 @@
 #define MIDI_LOADER_H
 
 #include <stdbool.h>
+#include <stdint.h>
 
 #ifdef _WIN32
 #include <windows.h>
@@ -9,19 +10,49 @@
 #include <dlfcn.h>
 #endif
 
+#include "midi-utils.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-// Define function pointer types for OmniMIDI/KDMAPI functions
-typedef void (*SendDirectDataFunc)(uint32_t);
+// What initialize_midi found in the library. Only IsKDMAPIAvailable,
+// InitializeKDMAPIStream and SendDirectData are required; everything else
+// is used when present.
+typedef struct {
+    bool no_buffer;      // SendDirectDataNoBuf: straight to the synth, skipping its event buffer
+    bool long_data;      // SendDirectLongData with Prepare/UnprepareLongData: SysEx
+    bool terminate;      // TerminateKDMAPIStream
+    bool reset;          // ResetKDMAPIStream
+    bool version;        // ReturnKDMAPIVer
+    uint32_t major, minor, build, revision;
+} KdmapiFeatures;
+
+// Library to load instead of OmniMIDI.dll / ./libOmniMIDI.so, e.g. the
+// kdmapi_mock tool. NULL restores the default.
+void kdmapi_set_library(const char* path);
+
+// Keep short messages on SendDirectData even when SendDirectDataNoBuf exists
+void kdmapi_prefer_buffered(bool buffered);
 
 // Initializes the MIDI library (OmniMIDI on Windows, libOmniMIDI.so on Linux)
 // On success, returns a handle to the loaded library and sets SendDirectData
+// to the fastest short message entrypoint available
 // On failure, returns NULL
 void* initialize_midi(SendDirectDataFunc* SendDirectData);
 
-// Unloads the MIDI library loaded by initialize_midi
+// Entrypoints of the library loaded by initialize_midi
+const KdmapiFeatures* kdmapi_features(void);
+
+// Sends one complete SysEx message (F0 ... F7), preparing and unpreparing
+// the header around it. The first failure is reported on stderr. Only valid
+// while the library is loaded and kdmapi_features()->long_data is set.
+void kdmapi_send_long(const uint8_t* data, uint32_t length);
+
+// Clears every voice and controller of the stream, if the library can
+void kdmapi_reset(void);
+
+// Terminates the stream when the library supports it, then unloads it
 void unload_midi(void* midi_lib);
 
 #ifdef __cplusplus
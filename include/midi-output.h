@@ -0,0 +1,35 @@
+#ifndef MIDI_OUTPUT_H
+#define MIDI_OUTPUT_H
+
+#include <stdbool.h>
+
+#include "midi-utils.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// An opened output sink: the KDMAPI library, an ALSA sequencer port or a
+// shared memory ring. Open it once and reuse it for as many files as needed.
+typedef struct {
+    SendDirectDataFunc SendDirectData;
+    SendLongDataFunc SendLongData;   // NULL when the output has no SysEx path
+    void* midi_lib;      // KDMAPI library handle, NULL when using ALSA or shared memory
+    bool alsa;
+    bool shm;
+} MidiOutput;
+
+// Opens ALSA when alsa_port is set, otherwise loads the KDMAPI library
+bool midi_output_open(MidiOutput* out, const char* alsa_port);
+// Creates the shared memory ring name for a synthesizer in another process
+bool midi_output_open_shm(MidiOutput* out, const char* name);
+void midi_output_close(MidiOutput* out);
+
+// Sink that drops every message, for headless runs
+void midi_output_null(uint32_t message);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // MIDI_OUTPUT_H
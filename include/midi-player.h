@@ -3,12 +3,53 @@
 
 #include "track-data.h"
 #include "midi-utils.h"
+#include "midi.h"
+#include "playback-control.h"
+#include "transform.h"
+#include "overload.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-void play_midi(TrackData* tracks, int track_count, uint16_t time_div, SendDirectDataFunc SendDirectData, int min_velocity);
+// How play_midi schedules the file, see playback-engines.h
+typedef enum {
+    PLAYBACK_ENGINE_INLINE,    // one thread; best for sparse files
+    PLAYBACK_ENGINE_BUFFERED,  // parser and dispatcher threads; best for dense files
+} PlaybackEngine;
+
+// Per-playback settings that stay fixed while a file plays
+typedef struct {
+    PlaybackEngine engine;
+    int min_velocity;               // note-ons at or below this velocity are skipped, -1 sends all
+    const TransformSpec* transform; // remapping, transposition, muting, velocity curve; NULL for none
+    bool quiet;                     // no notes-per-second logger
+    bool coalesce;                  // drop messages superseded within a tick, see coalescer.h
+    int64_t coalesce_window_100ns;  // with coalesce, also merge ticks this close together
+    int parser_threads;             // buffered engine: tracks decoded on this many threads, 0 for one
+    OverloadPolicy overload;        // note-ons shed while playback is late, see overload.h
+    int64_t overload_threshold_100ns; // lateness that starts it, 0 for OVERLOAD_DEFAULT_THRESHOLD_100NS
+    // Engines that send from a thread of their own call this there first,
+    // for sinks that find their state through thread-locals. May be NULL.
+    void (*bind_sink_thread)(void* context);
+    void* sink_context;
+    // SysEx goes here when set (inline engine); otherwise it is dropped
+    SendLongDataFunc SendLongData;
+    // Set while the file is still loading: playback waits at the first
+    // tick that is not loaded yet, see midi_stream_start
+    MidiStream* loading;
+} PlaybackOptions;
+
+// control may be NULL; when set, playback starts at control->seek_100ns and
+// follows its stop, pause and speed requests
+void play_midi(TrackData* tracks, int track_count, uint16_t time_div, SendDirectDataFunc SendDirectData, const PlaybackOptions* options, PlaybackControl* control);
+
+// "inline" or "buffered"; false for anything else
+bool playback_engine_from_name(const char* name, PlaybackEngine* engine);
+const char* playback_engine_name(PlaybackEngine engine);
+
+// Sends All Notes Off and releases the sustain pedal on every channel
+void all_notes_off(SendDirectDataFunc SendDirectData);
 
 #ifdef __cplusplus
 }
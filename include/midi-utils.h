@@ -10,6 +10,8 @@ extern "C" {
 
 // Type definition for the OmniMIDI function
 typedef void (*SendDirectDataFunc)(uint32_t);
+// One complete SysEx message, F0 through F7
+typedef void (*SendLongDataFunc)(const uint8_t* data, uint32_t length);
 
 // Endianness conversion functions
 uint32_t fntohl(uint32_t nlong);
@@ -18,6 +20,13 @@ uint16_t fntohs(uint16_t nshort);
 // Timing functions
 int64_t getTime100ns();
 void delayExecution100Ns(int64_t delayIn100Ns);
+// CLOCK_MONOTONIC even on the virtual clock, for what is measured in real time
+int64_t getRealTime100ns();
+
+// Headless runs: time only moves when something delays, so playback runs
+// as fast as possible and always produces the same timestamps
+void use_virtual_clock(bool enabled);
+bool virtual_clock_enabled(void);
 
 // Logger thread function and structure
 typedef struct {
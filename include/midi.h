@@ -1,4 +1,37 @@
+#ifndef MIDI_H
+#define MIDI_H
+
+#include <stdbool.h>
+
 #include "track-data.h"
 #include "midi-utils.h"
 
-TrackData* load_midi_file(const char* filename, uint16_t* time_div, int* track_count);
\ No newline at end of file
+TrackData* load_midi_file(const char* filename, uint16_t* time_div, int* track_count);
+void free_tracks(TrackData* tracks, int track_count);
+// Playback only reads the event data, so a cached file is played again
+// from a copy of the cursors and long message buffers that shares it.
+// tracks must stay loaded until the copy is freed.
+TrackData* share_tracks(const TrackData* tracks, int track_count);
+
+// A file that plays while it loads. The loader thread reads the chunk
+// table, sizes every track buffer up front, reads the opening of every
+// track and then fills in the rest, always the track that is furthest
+// behind in song time. Everything before midi_stream_loaded_tick is in
+// place in every track; playback waits (midi_stream_wait) before going
+// past it.
+typedef struct MidiStream MidiStream;
+
+// Starts loading in the background; NULL when out of memory
+MidiStream* midi_stream_start(const char* filename);
+// Waits until the opening of every track is loaded. The tracks can be
+// played from then on and belong to the caller (free_tracks), but only
+// after midi_stream_close. Returns false if the file failed to load.
+bool midi_stream_wait_playable(MidiStream* stream, TrackData** tracks, uint16_t* time_div, int* track_count);
+// Ticks below this are loaded in every track; UINT64_MAX once all are
+uint64_t midi_stream_loaded_tick(const MidiStream* stream);
+// Waits up to timeout_100ns (real time) for tick to be loaded
+bool midi_stream_wait(MidiStream* stream, uint64_t tick, int64_t timeout_100ns);
+// Stops the loader if it is still running and frees the stream, not the tracks
+void midi_stream_close(MidiStream* stream);
+
+#endif // MIDI_H
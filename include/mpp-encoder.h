@@ -0,0 +1,58 @@
+#ifndef MPP_ENCODER_H
+#define MPP_ENCODER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Encodes note events into the MPP note-buffer packet used by
+// test/mpp/NoteHandler.js: a little-endian 48-bit millisecond timestamp,
+// then 3 bytes per note (note, delay in ms from the timestamp, velocity).
+// A velocity of 0 is a note release.
+
+#define MPP_HEADER_SIZE 6
+#define MPP_NOTE_SIZE   3
+#define MPP_MAX_DELAY   255
+
+typedef struct {
+    uint8_t* data;       // header + notes, header is written by take
+    size_t count;        // notes in the current packet
+    size_t max_notes;
+    uint64_t time_ms;    // wall clock time of the first note, 0 when empty
+    int note_offset;     // added to the MIDI note number
+    uint16_t held[128];  // note-ons not yet released, per shifted note
+} MppEncoder;
+
+bool mpp_encoder_init(MppEncoder* enc, size_t max_notes, int note_offset);
+void mpp_encoder_free(MppEncoder* enc);
+
+// Adds a note on/off message. Other messages and notes shifted out of
+// 0-127 are ignored. Returns false, without adding anything, when the
+// packet is full or the note is too late for its 8-bit delay; take the
+// packet and push again.
+bool mpp_encoder_push(MppEncoder* enc, uint32_t message, uint64_t now_ms);
+
+// Adds a release for every note still held, e.g. when playback is
+// stopped. Returns false when the packet filled up first; take it and
+// call again.
+bool mpp_encoder_release_all(MppEncoder* enc, uint64_t now_ms);
+
+// Finishes the current packet and starts a new one. The returned buffer
+// belongs to the caller; returns NULL when there is nothing to send.
+uint8_t* mpp_encoder_take(MppEncoder* enc, int64_t time_offset_ms, size_t* size);
+
+// Standard base64 with padding. The result is NUL terminated.
+char* mpp_base64_encode(const uint8_t* data, size_t size, size_t* out_len);
+
+// Milliseconds since the Unix epoch, the clock Date.now() uses
+uint64_t mpp_wall_clock_ms(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // MPP_ENCODER_H
@@ -6,9 +6,8 @@
 
 // Function declarations
 napi_value PlayMIDI(napi_env env, napi_callback_info info);
-void NapiSendDirectData(uint32_t data);
+void ThreadSendDirectData(uint32_t data);
 
 napi_value Init(napi_env env, napi_value exports);
-void free_tracks(TrackData* tracks, int track_count);
 
-#endif // NAPI_BINDING_H
\ No newline at end of file
+#endif // NAPI_BINDING_H
@@ -0,0 +1,53 @@
+#ifndef NOTE_INDEX_H
+#define NOTE_INDEX_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "track-data.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Every note of a file as an interval, for piano rolls and visualizers that
+// ask "what sounds between t0 and t1" on every frame. Note-ons are paired
+// with note-offs per track, channel and key, first on first off; a note
+// still held at the end of its track ends there. Notes are sorted by start
+// and stored column-wise, with an implicit interval tree on top (a binary
+// tree over the sorted positions, each node knowing the latest end below
+// it), so a query costs O(log n + k) and allocates nothing once its
+// result buffer is large enough.
+typedef struct {
+    size_t count;
+    int64_t* start_100ns;   // song time, ascending
+    int64_t* end_100ns;
+    uint8_t* key;
+    uint8_t* velocity;
+    uint8_t* channel;
+    uint32_t* track;
+    int64_t* max_end_100ns; // latest end in each node's subtree
+    int max_level;          // height of the tree, -1 when empty
+
+    int64_t duration_100ns;
+    int threads;
+    long build_ms;
+} NoteIndex;
+
+// Pairs the notes of freshly loaded tracks, in parallel across tracks,
+// without consuming them. Returns NULL when out of memory.
+NoteIndex* note_index_build(const TrackData* tracks, int track_count, uint16_t time_div);
+void note_index_free(NoteIndex* index);
+
+// Positions of every note sounding at some point in [from_100ns, to_100ns]
+// (start <= to and end >= from), in start order. *hits is grown with
+// realloc as needed and can be reused across calls. Returns the number of
+// hits, or (size_t)-1 when *hits could not be grown.
+size_t note_index_query(const NoteIndex* index, int64_t from_100ns, int64_t to_100ns,
+                        size_t** hits, size_t* capacity);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // NOTE_INDEX_H
@@ -0,0 +1,80 @@
+#ifndef OVERLOAD_H
+#define OVERLOAD_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// What playback does once it falls behind, because decoding or the sink
+// can not keep up. Without a policy everything is played, late. With one,
+// the engines stay on the song clock and shed note-ons while they are more
+// than the threshold late, until they are back within a quarter of it.
+// Note-offs (also note-ons with velocity 0), controllers and everything
+// else always go out, so no note hangs and the channel state stays right.
+typedef enum {
+    OVERLOAD_OFF,    // play everything late
+    OVERLOAD_DROP,   // skip every note-on
+    OVERLOAD_THIN,   // skip the quietest note-ons first: none at the threshold, all at twice it
+} OverloadPolicy;
+
+#define OVERLOAD_DEFAULT_THRESHOLD_100NS 500000   // 50 ms
+
+typedef struct {
+    OverloadPolicy policy;
+    int64_t threshold_100ns;
+    int velocity_cut;          // note-ons below this velocity are skipped, 0 while on time
+    int64_t started_100ns;     // when the current episode began
+    // Reported by overload_report
+    uint64_t dropped;
+    uint64_t episodes;
+    int64_t overloaded_100ns;
+    int64_t worst_100ns;       // largest lateness seen
+} OverloadGuard;
+
+void overload_init(OverloadGuard* guard, OverloadPolicy policy, int64_t threshold_100ns);
+
+// Called once per tick or batch with how late it goes out
+static inline void overload_update(OverloadGuard* guard, int64_t late_100ns, int64_t now_100ns) {
+    if (late_100ns > guard->worst_100ns) guard->worst_100ns = late_100ns;
+    int64_t threshold = guard->threshold_100ns;
+    if (guard->velocity_cut == 0) {
+        if (guard->policy == OVERLOAD_OFF || late_100ns <= threshold) return;
+        guard->episodes++;
+        guard->started_100ns = now_100ns;
+    } else if (late_100ns < threshold / 4) {
+        guard->overloaded_100ns += now_100ns - guard->started_100ns;
+        guard->velocity_cut = 0;
+        return;
+    }
+    if (guard->policy == OVERLOAD_DROP || late_100ns >= 2 * threshold) {
+        guard->velocity_cut = 128;
+    } else {
+        // At least 1, which still marks the episode as running
+        int cut = (int)((late_100ns - threshold) * 128 / threshold);
+        guard->velocity_cut = cut < 1 ? 1 : cut;
+    }
+}
+
+// True for a note-on the guard sheds; it is counted
+static inline bool overload_sheds(OverloadGuard* guard, uint32_t message) {
+    if ((message & 0xF0) != 0x90) return false;
+    int velocity = (message >> 16) & 0x7F;
+    if (velocity == 0 || velocity >= guard->velocity_cut) return false;
+    guard->dropped++;
+    return true;
+}
+
+// Closes a running episode and prints the totals, if anything was dropped
+void overload_report(OverloadGuard* guard, int64_t now_100ns);
+
+// "off", "drop" or "thin"; false for anything else
+bool overload_policy_from_name(const char* name, OverloadPolicy* policy);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // OVERLOAD_H
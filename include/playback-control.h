@@ -0,0 +1,55 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+// Longest the player sleeps before looking at the control block again
+#define CONTROL_SLICE_100NS 20000LL  // 2ms
+
+// Shared between a playback thread and whoever controls it. The player only
+// does relaxed loads/stores on these, once per tick, so it is safe to poll
+// from the hot loop. Any thread may write the requests at any time.
+typedef struct {
+    atomic_bool     stop;            // set to end playback early
+    atomic_bool     paused;          // hold playback, all notes are released
+    _Atomic double  speed;           // tempo multiplier, 1.0 = as written
+    _Atomic int64_t seek_100ns;      // start position, read when playback starts
+    _Atomic int64_t position_100ns;  // current song position, written by the player
+    _Atomic int64_t first_note_100ns; // getRealTime100ns when the first note-on went out, 0 before
+} PlaybackControl;
+
+static inline void playback_control_init(PlaybackControl* ctl) {
+    atomic_init(&ctl->stop, false);
+    atomic_init(&ctl->paused, false);
+    atomic_init(&ctl->speed, 1.0);
+    atomic_init(&ctl->seek_100ns, 0);
+    atomic_init(&ctl->position_100ns, 0);
+    atomic_init(&ctl->first_note_100ns, 0);
+}
+
+static inline void playback_control_stop(PlaybackControl* ctl) {
+    atomic_store_explicit(&ctl->stop, true, memory_order_relaxed);
+}
+
+static inline bool playback_control_stopped(PlaybackControl* ctl) {
+    return atomic_load_explicit(&ctl->stop, memory_order_relaxed);
+}
+
+static inline void playback_control_pause(PlaybackControl* ctl, bool paused) {
+    atomic_store_explicit(&ctl->paused, paused, memory_order_relaxed);
+}
+
+static inline bool playback_control_paused(PlaybackControl* ctl) {
+    return atomic_load_explicit(&ctl->paused, memory_order_relaxed);
+}
+
+// Values outside 1/100x..100x are clamped
+static inline void playback_control_set_speed(PlaybackControl* ctl, double speed) {
+    speed = speed < 0.01 ? 0.01 : (speed > 100.0 ? 100.0 : speed);
+    atomic_store_explicit(&ctl->speed, speed, memory_order_relaxed);
+}
+
+static inline double playback_control_speed(PlaybackControl* ctl) {
+    return atomic_load_explicit(&ctl->speed, memory_order_relaxed);
+}
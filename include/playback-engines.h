@@ -0,0 +1,53 @@
+#ifndef PLAYBACK_ENGINES_H
+#define PLAYBACK_ENGINES_H
+
+#include "midi-player.h"
+#include "coalescer.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// The engines behind play_midi, picked by PlaybackOptions.engine. Both
+// decode with track-data.h and take the same arguments as play_midi.
+
+// One thread decodes and sends inline, sleeping between ticks
+void play_midi_inline(TrackData* tracks, int track_count, uint16_t time_div, SendDirectDataFunc SendDirectData, const PlaybackOptions* options, PlaybackControl* control);
+
+// A parser thread decodes ahead into a ring, a dispatcher thread sends on time.
+// With PlaybackOptions.parser_threads > 1 the tracks are split across that
+// many parser threads and a merge thread restores the order.
+void play_midi_buffered(TrackData* tracks, int track_count, uint16_t time_div, SendDirectDataFunc SendDirectData, const PlaybackOptions* options, PlaybackControl* control);
+
+// The buffered engine's parser side, started ahead of playback: a playlist
+// decodes the next file into its ring while the current one plays, so the
+// first batches are ready when it starts. It plays from the beginning of
+// the file; options are copied, tracks must stay loaded until it is played
+// or discarded. NULL if the ring could not be allocated.
+typedef struct BufferedPlayback BufferedPlayback;
+BufferedPlayback* buffered_prepare(TrackData* tracks, int track_count, uint16_t time_div, const PlaybackOptions* options);
+// Sends what prepared decodes on time, like play_midi_buffered, then frees it.
+// options are the dispatcher's: overload, quiet and the sink binding.
+void play_midi_buffered_prepared(BufferedPlayback* prepared, SendDirectDataFunc SendDirectData, const PlaybackOptions* options, PlaybackControl* control);
+// Stops the decoding and frees it unplayed
+void buffered_discard(BufferedPlayback* prepared);
+
+// Fast-forwards every track up to target_100ns without any delay. Notes are
+// skipped, but controllers, program changes and tempo changes are applied so
+// playback resumes with the right channel state. coalescer and transform
+// may be NULL. Returns the tick to resume at.
+uint64_t chase_to(TrackData* tracks, int track_count, uint16_t time_div,
+                  SendDirectDataFunc SendDirectData, Coalescer* coalescer,
+                  const Transform* transform, int64_t target_100ns,
+                  double* multiplier, uint64_t* bpm, int64_t* elapsed_100ns);
+
+// Streaming loads (PlaybackOptions.loading): blocks until everything at tick
+// is loaded. The time spent is added to *held, on the playback clock.
+// Returns false if playback was stopped first.
+bool wait_for_load(MidiStream* stream, uint64_t tick, PlaybackControl* control, int64_t* held);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // PLAYBACK_ENGINES_H
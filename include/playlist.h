@@ -0,0 +1,59 @@
+#ifndef PLAYLIST_H
+#define PLAYLIST_H
+
+#include <stdbool.h>
+#include <pthread.h>
+
+#include "track-data.h"
+#include "midi.h"
+#include "midi-player.h"
+#include "playback-engines.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// A file ready to be handed to play_midi, possibly still loading: pass
+// stream as PlaybackOptions.loading, then let loaded_midi_free close it.
+// With decoded set, the buffered engine is already decoding it: play it
+// with play_midi_buffered_prepared instead, which takes decoded over.
+typedef struct {
+    const char* filename;
+    TrackData* tracks;
+    int track_count;
+    uint16_t time_div;
+    MidiStream* stream;
+    BufferedPlayback* decoded;
+} LoadedMidi;
+
+// Loads the next file in the background while the current one plays. For
+// the buffered engine a thread also starts decoding it into the ring as
+// soon as its opening is loaded.
+typedef struct {
+    LoadedMidi file;
+    bool loaded;
+    PlaybackOptions options;   // what the file is decoded for
+    pthread_t thread;
+    bool threaded;
+} MidiPrefetch;
+
+// options may be NULL to only load the file
+void prefetch_start(MidiPrefetch* pf, const char* filename, const PlaybackOptions* options);
+// Waits until the file can start playing, see midi_stream_wait_playable;
+// returns false if it failed to load
+bool prefetch_finish(MidiPrefetch* pf, LoadedMidi* out);
+// Stops loading and decoding what is left and frees the tracks
+void loaded_midi_free(LoadedMidi* loaded);
+
+// Reads a playlist (one path per line, '#' starts a comment). Relative paths
+// are resolved against the playlist's directory. Returns the entry count,
+// or -1 on error, including running out of memory part way. Free the
+// result with playlist_free.
+int playlist_read(const char* path, char*** entries);
+void playlist_free(char** entries, int count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // PLAYLIST_H
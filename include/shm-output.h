@@ -0,0 +1,14 @@
+#ifndef SHM_OUTPUT_H
+#define SHM_OUTPUT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Output to a synthesizer in another process through a shared memory ring
+// (see shm-ring.h). Every message is stamped with its send time. One ring
+// per process, like the ALSA output.
+bool shm_output_initialize(const char* name);
+void shm_output_send(uint32_t message);
+void shm_output_shutdown(void);
+
+#endif // SHM_OUTPUT_H
@@ -0,0 +1,72 @@
+#ifndef SHM_RING_H
+#define SHM_RING_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Single producer, single consumer ring of timestamped MIDI messages in
+// POSIX shared memory, for a synthesizer running in its own process
+// (midi_player --shm=<name>). Neither side makes a system call while the
+// other keeps up: the producer only wakes the consumer (futex) after it
+// went to sleep on an empty ring, and the consumer only wakes the producer
+// after it went to sleep on a full one. Build the consumer against this
+// header and src/shm-ring.c alone (xmake target shm_ring).
+
+#define SHM_RING_DEFAULT_CAPACITY (1u << 20)   // events, 16 MiB
+
+// Clock of ShmRingEvent.time_100ns
+typedef enum {
+    SHM_RING_CLOCK_MONOTONIC,   // CLOCK_MONOTONIC in 100ns units, same in both processes
+    SHM_RING_CLOCK_VIRTUAL,     // a headless player's virtual clock, only for ordering
+} ShmRingClock;
+
+typedef struct {
+    int64_t time_100ns;   // when the player sent the message
+    uint32_t message;     // status in the low byte, as SendDirectData takes it
+    uint32_t reserved;
+} ShmRingEvent;
+
+typedef struct ShmRing ShmRing;
+
+typedef struct {
+    uint64_t events;    // pushed, or consumed on the consumer side
+    uint64_t dropped;   // lost to a full ring with no live consumer
+    uint64_t wakeups;   // futex wakes sent to the other side
+} ShmRingStats;
+
+// ——— Producer ———
+// Creates the segment, replacing one left behind by an earlier run.
+// capacity is rounded up to a power of two.
+ShmRing* shm_ring_create(const char* name, uint32_t capacity, ShmRingClock clock);
+// Waits while the ring is full and a consumer is attached, for at most a
+// second; then drops until the consumer moves again. Returns false when
+// the message was dropped.
+bool shm_ring_push(ShmRing* ring, int64_t time_100ns, uint32_t message);
+// Tells the consumer no more events come and removes the name
+void shm_ring_destroy(ShmRing* ring);
+
+// ——— Consumer ———
+// NULL when the segment does not exist (yet) or already has a consumer
+ShmRing* shm_ring_attach(const char* name);
+ShmRingClock shm_ring_clock(const ShmRing* ring);
+// The events ready to read, in place in the shared memory: up to the end
+// of the ring, so call again after shm_ring_release to get the rest
+size_t shm_ring_peek(ShmRing* ring, const ShmRingEvent** events);
+void shm_ring_release(ShmRing* ring, size_t count);
+// Sleeps until events are ready or timeout_100ns passes (negative waits
+// forever). Returns false once the producer is gone and the ring is empty.
+bool shm_ring_wait(ShmRing* ring, int64_t timeout_100ns);
+void shm_ring_detach(ShmRing* ring);
+
+void shm_ring_stats(const ShmRing* ring, ShmRingStats* stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SHM_RING_H
@@ -0,0 +1,42 @@
+#ifndef TEMPO_MAP_H
+#define TEMPO_MAP_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// A tempo change as found in a track
+typedef struct {
+    uint64_t tick;
+    int track;      // tempo changes on the same tick apply in track order
+    uint32_t bpm;   // microseconds per quarter note, as stored in the file
+} TempoEvent;
+
+// Start of a constant-tempo segment
+typedef struct {
+    uint64_t tick;
+    int64_t time_100ns;
+    double multiplier;  // 100ns per tick, same scale as play_midi uses
+} TempoPoint;
+
+typedef struct {
+    TempoPoint* points;
+    int count;
+} TempoMap;
+
+// Builds the map from tempo events in any order; events is sorted in place
+bool tempo_map_build(TempoMap* map, TempoEvent* events, int event_count, uint16_t time_div);
+void tempo_map_free(TempoMap* map);
+
+// Converts a tick to song time. *cursor caches the last segment, so walking
+// ticks in increasing order is O(1) per call; start it at 0.
+int64_t tempo_map_time(const TempoMap* map, uint64_t tick, int* cursor);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // TEMPO_MAP_H
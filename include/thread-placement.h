@@ -0,0 +1,54 @@
+#ifndef THREAD_PLACEMENT_H
+#define THREAD_PLACEMENT_H
+
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Which CPUs and scheduling class each kind of thread gets. The engines
+// call place_current_thread at the top of their threads; roles without
+// CPUs are left wherever the scheduler puts them. The settings are
+// process-wide, like the arena policy, and made before playback starts.
+typedef enum {
+    THREAD_ROLE_PLAYBACK,   // the thread that waits for and sends events
+    THREAD_ROLE_PARSER,     // decodes ahead (buffered engine)
+    THREAD_ROLE_LOGGER,     // notes-per-second output
+    THREAD_ROLE_COUNT
+} ThreadRole;
+
+typedef enum {
+    REALTIME_OFF,
+    REALTIME_FIFO,   // SCHED_FIFO
+    REALTIME_RR,     // SCHED_RR
+} RealtimePolicy;
+
+// cpus is a list like "2", "0-3" or "0,2,4-5". Returns false if it does not
+// parse or names no CPU this process may run on.
+bool thread_placement_pin(ThreadRole role, const char* cpus);
+
+// Playback runs at priority (1-99), the parser one below it; the logger
+// always stays at normal priority
+void thread_placement_realtime(RealtimePolicy policy, int priority);
+
+// Pins the calling thread and sets its scheduling class for role. Without
+// permission for a realtime class it warns once and keeps the normal one.
+// Once anything is configured, the first placement of each role is
+// reported on stdout.
+void place_current_thread(ThreadRole role);
+
+// Puts a thread that played inline back where it was before, so threads it
+// creates later do not inherit the playback placement
+void release_current_thread(void);
+
+// NUMA node of the first CPU of role, -1 when not pinned or not known
+int thread_role_numa_node(ThreadRole role);
+
+const char* thread_role_name(ThreadRole role);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // THREAD_PLACEMENT_H
@@ -0,0 +1,44 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Binary event trace: the 8-byte magic "MPTRACE1", then one record per
+// message: the time since the previous record in 100ns units as an
+// unsigned LEB128 varint, followed by the 3 message bytes (status first).
+
+#define TRACE_MAGIC     "MPTRACE1"
+#define TRACE_MAGIC_LEN 8
+
+typedef struct {
+    int64_t time_100ns;
+    uint32_t message;
+} TraceEvent;
+
+typedef struct {
+    FILE* file;
+    int64_t last_time;
+    uint64_t count;
+} TraceWriter;
+
+bool trace_writer_open(TraceWriter* w, const char* path);
+void trace_writer_add(TraceWriter* w, int64_t time_100ns, uint32_t message);
+// Returns false if anything failed to reach the disk
+bool trace_writer_close(TraceWriter* w);
+
+// Reads a whole trace. Returns NULL on error; an empty trace returns a
+// valid pointer with *count = 0. Free the result with free().
+TraceEvent* trace_read(const char* path, size_t* count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // TRACE_H
@@ -3,30 +3,76 @@
 
 #include <stdint.h>
 #include <stdlib.h>
+#include <stdbool.h>
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+// Every track buffer ends in an end-of-track event (00 FF 2F 00) placed
+// right after the last complete event, see seal_track_data. Decoding can
+// only ever stop on it, so the per-event decoders need no bounds checks.
+#define TRACK_PADDING 4
+
+// Loaded tracks live in an arena (see arena.h): data and long_msg are
+// freed with the whole file by free_tracks, and long_msg_capacity already
+// covers the longest message of the track, so playback never allocates.
+// long_msg[-1] is reserved there too, so a SysEx payload can be sent with
+// its F0 status in front without a copy.
+//
+// The decoder's cursor comes first and fills half a cache line; the rest is
+// only read for meta and SysEx events or when loading. The engines do not
+// scan TrackData to find the next track, see track-schedule.h.
 typedef struct {
+    // Hot: read and written for every event
     uint8_t* data;
-    uint8_t* long_msg;
-    int tick;
-    size_t offset, length;
+    size_t offset;
+    uint64_t tick;
     uint32_t message, temp;
+    // Cold
+    uint8_t* long_msg;
     size_t long_msg_len;
     size_t long_msg_capacity;
+    size_t length;
     size_t data_capacity;
 } TrackData;
 
 void init_track_data(TrackData* track);
-void free_track_data(TrackData* track);
+// Walks the track once with bounds checks, cuts it after the last complete
+// event (or its first end-of-track) and writes the sentinel there. data must
+// have room for length + TRACK_PADDING bytes. *longest receives the size of
+// the largest SysEx or meta payload kept. Returns false if the track had to
+// be cut short.
+bool seal_track_data(TrackData* track, size_t* longest);
+
+// Where a walk over a track that is still arriving got to, see track_scan.
+// Zero-initialize before the first call.
+typedef struct {
+    size_t offset;    // end of the last complete event
+    uint64_t tick;    // absolute tick of that event
+    size_t longest;   // largest SysEx or meta payload so far
+    uint8_t status;   // running status after it
+    bool ended;       // reached the end-of-track, offset is its start
+} TrackScan;
+
+// Continues the walk of seal_track_data over the first available bytes of
+// data. Returns true once the end-of-track is reached.
+bool track_scan(TrackScan* scan, const uint8_t* data, size_t available);
+// Cuts the track where the scan stopped and writes the sentinel there.
+// data is the track's buffer, which track->data may no longer point to.
+void track_seal(TrackData* track, uint8_t* data, const TrackScan* scan);
 
 void update_tick(TrackData* track);
 void update_command(TrackData* track);
 void update_message(TrackData* track);
 void process_meta_event(TrackData* track, double* multiplier, uint64_t* bpm, uint16_t time_div);
 
+// 100ns units per tick at tempo (microseconds per quarter note), at least 1
+static inline double tempo_multiplier(uint64_t tempo, uint16_t time_div) {
+    double multiplier = (double)(tempo * 10) / (double)time_div;
+    return multiplier < 1.0 ? 1.0 : multiplier;
+}
+
 int decode_variable_length(TrackData* track);
 
 #ifdef __cplusplus
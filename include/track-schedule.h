@@ -0,0 +1,56 @@
+#ifndef TRACK_SCHEDULE_H
+#define TRACK_SCHEDULE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "track-data.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// What the engines scan on every tick: the next tick of each track that
+// still has events, next to its index, in track order. The two arrays are
+// all a scan reads, 12 bytes per track, so a file with tens of thousands of
+// tracks fits in a few hundred cache lines instead of a TrackData each;
+// a track's TrackData is only touched once it is due. Finished tracks are
+// taken out, so the scan also shrinks as the file winds down.
+typedef struct {
+    uint64_t* ticks;   // next event tick per scheduled track
+    int* tracks;       // its index in the TrackData array
+    int count;
+} TrackSchedule;
+
+// Schedules every track that still has data, at its current tick
+bool track_schedule_init(TrackSchedule* schedule, const TrackData* tracks, int track_count);
+void track_schedule_free(TrackSchedule* schedule);
+
+// Slot of the earliest track, the first in track order on a tie; -1 once
+// every track is finished
+static inline int track_schedule_earliest(const TrackSchedule* schedule) {
+    int earliest = -1;
+    uint64_t earliest_tick = UINT64_MAX;
+    for (int slot = 0; slot < schedule->count; slot++) {
+        if (schedule->ticks[slot] < earliest_tick) {
+            earliest_tick = schedule->ticks[slot];
+            earliest = slot;
+        }
+    }
+    return earliest;
+}
+
+// Takes a finished track out, keeping the others in track order
+static inline void track_schedule_remove(TrackSchedule* schedule, int slot) {
+    int after = schedule->count - slot - 1;
+    memmove(&schedule->ticks[slot], &schedule->ticks[slot + 1], after * sizeof(uint64_t));
+    memmove(&schedule->tracks[slot], &schedule->tracks[slot + 1], after * sizeof(int));
+    schedule->count--;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // TRACK_SCHEDULE_H
@@ -0,0 +1,71 @@
+#ifndef TRANSFORM_H
+#define TRANSFORM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TRANSFORM_MAX_TRACK_RANGES 16
+
+// What to change on the way out: channel remapping, transposition, muting
+// and a note-on velocity curve. Channels are 0-15 here and 1-16 in the
+// parsed strings, tracks are counted from 0 as in the file.
+typedef struct {
+    int8_t channel_map[16];   // destination per source channel, -1 mutes the channel
+    int8_t transpose[16];     // semitones per source channel; notes pushed out of range are dropped
+    double velocity_gamma;    // note-on velocity becomes 127 * (v / 127) ^ gamma ...
+    double velocity_scale;    // ... times this, kept within 1-127
+    struct { int first, last; } muted_tracks[TRANSFORM_MAX_TRACK_RANGES];
+    int muted_track_ranges;
+} TransformSpec;
+
+// Everything passes through unchanged
+void transform_spec_init(TransformSpec* spec);
+bool transform_spec_is_identity(const TransformSpec* spec);
+
+// Parse the command line (and N-API) forms into spec; false when malformed
+bool transform_parse_remap(TransformSpec* spec, const char* value);          // "1:2,10:11"
+bool transform_parse_transpose(TransformSpec* spec, const char* value);      // "-12" (all but channel 10) or "5:1-4,6"
+bool transform_parse_mute_channels(TransformSpec* spec, const char* value);  // "10" or "1-4,9"
+bool transform_parse_mute_tracks(TransformSpec* spec, const char* value);    // "0,3-5"
+bool transform_parse_velocity_curve(TransformSpec* spec, const char* value); // "<gamma>" or "<gamma>:<scale>"
+
+// A spec compiled for one file. Every byte of a message is looked up once,
+// in a table picked by its status byte, so the cost per event is the same
+// whichever transforms are on. A table entry with bit 7 set drops the
+// message, and so does a status mapped to 0 (a muted channel or track).
+typedef struct {
+    uint8_t status[256];       // new status byte, 0 mutes
+    uint8_t data1_row[256];    // data1 table per status byte
+    uint8_t data2_row[256];    // data2 table per status byte
+    uint8_t data1[17][128];    // 0 passes through, 1 + channel transposes that source channel
+    uint8_t data2[2][128];     // 0 passes through, 1 is the note-on velocity table
+    int track_count;
+    uint8_t track_mask[];      // per track: 0xFF plays it, 0 mutes it
+} Transform;
+
+// Also folds min_velocity (-1 for none) into the velocity table. Returns
+// NULL when spec is NULL or changes nothing, so the engines keep their
+// plain path; the min_velocity filter is then theirs to apply.
+Transform* transform_compile(const TransformSpec* spec, int min_velocity, int track_count);
+void transform_free(Transform* transform);
+
+// The transformed channel message (status below 0xF0), 0 if it is dropped
+static inline uint32_t transform_apply(const Transform* t, int track, uint32_t message) {
+    uint32_t status = message & 0xFF;
+    uint32_t out = (uint32_t)(t->status[status] & t->track_mask[track])
+                 | (uint32_t)t->data1[t->data1_row[status]][(message >> 8) & 0x7F] << 8
+                 | (uint32_t)t->data2[t->data2_row[status]][(message >> 16) & 0x7F] << 16;
+    // A kept message has a status byte and no data byte with bit 7 set
+    uint32_t keep = (out & 0x808080) == 0x80;
+    return out & (0u - keep);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // TRANSFORM_H
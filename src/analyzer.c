@@ -0,0 +1,408 @@
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>
+
+#include "analyzer.h"
+#include "tempo-map.h"
+#include "midi-utils.h"
+
+#define BIN_100NS 10000  // 1 ms
+
+typedef struct {
+    const TrackData* tracks;
+    int track_count;
+    uint16_t time_div;
+    MidiProfile* profile;
+
+    // Pass 1: tempo events collected per track
+    TempoEvent** tempo_events;
+    int* tempo_counts;
+
+    // Pass 2: shared 1 ms histograms
+    TempoMap tempo_map;
+    size_t bin_count;
+    _Atomic uint32_t* note_bins;
+    _Atomic uint32_t* event_bins;
+    bool polyphony_failed;
+
+    _Atomic int next_track;
+    void (*job)(void* ctx, int track, TrackData* cursor);
+} Analysis;
+
+// Runs one track's decoder on a private cursor: the shared data is only read,
+// and long messages go to a per-worker buffer
+static void* worker_fn(void* arg) {
+    Analysis* a = (Analysis*)arg;
+    uint8_t* scratch = malloc(256);
+    size_t scratch_capacity = 256;
+
+    int i;
+    while (scratch && (i = atomic_fetch_add(&a->next_track, 1)) < a->track_count) {
+        TrackData cursor = a->tracks[i];
+        if (!cursor.data) continue;
+        cursor.long_msg = scratch;
+        cursor.long_msg_capacity = scratch_capacity;
+
+        a->job(a, i, &cursor);
+
+        scratch = cursor.long_msg;
+        scratch_capacity = cursor.long_msg_capacity;
+    }
+
+    free(scratch);
+    return NULL;
+}
+
+static void run_parallel(Analysis* a, void (*job)(void*, int, TrackData*)) {
+    int threads = a->profile->threads;
+    pthread_t* ids = malloc(threads * sizeof(pthread_t));
+
+    atomic_store(&a->next_track, 0);
+    a->job = job;
+
+    int started = 0;
+    for (; ids && started < threads; started++) {
+        if (pthread_create(&ids[started], NULL, worker_fn, a) != 0) break;
+    }
+    // Whatever could not be started runs here
+    if (started == 0) worker_fn(a);
+    for (int t = 0; t < started; t++) {
+        pthread_join(ids[t], NULL);
+    }
+    free(ids);
+}
+
+static inline bool next_event(TrackData* t) {
+    update_command(t);
+    update_message(t);
+    return !((t->message & 0xFFFF) == 0x2FFF);  // end of track
+}
+
+static void count_track(void* ctx, int track, TrackData* t) {
+    Analysis* a = (Analysis*)ctx;
+    TrackProfile* p = &a->profile->tracks[track];
+    int tempo_capacity = 0;
+
+    while (next_event(t)) {
+        uint8_t status = t->message & 0xFF;
+        if (status < 0xF0) {
+            p->events++;
+            if ((status & 0xF0) == 0x90 && ((t->message >> 16) & 0xFF) > 0) p->notes++;
+        } else if (status == 0xFF || status == 0xF0 || status == 0xF7) {
+            p->meta_events++;
+            if (t->long_msg_len > p->max_long_msg) p->max_long_msg = (uint32_t)t->long_msg_len;
+
+            if (status == 0xFF && ((t->message >> 8) & 0xFF) == 0x51 && t->long_msg_len >= 3) {
+                if (a->tempo_counts[track] == tempo_capacity) {
+                    tempo_capacity = tempo_capacity ? tempo_capacity * 2 : 16;
+                    TempoEvent* grown = realloc(a->tempo_events[track], tempo_capacity * sizeof(TempoEvent));
+                    if (!grown) break;
+                    a->tempo_events[track] = grown;
+                }
+                a->tempo_events[track][a->tempo_counts[track]++] = (TempoEvent){
+                    t->tick, track,
+                    (t->long_msg[0] << 16) | (t->long_msg[1] << 8) | t->long_msg[2]
+                };
+            }
+        }
+        update_tick(t);
+    }
+    p->last_tick = t->tick;
+}
+
+static void bin_track(void* ctx, int track, TrackData* t) {
+    (void)track;
+    Analysis* a = (Analysis*)ctx;
+    int cursor = 0;
+
+    while (next_event(t)) {
+        uint8_t status = t->message & 0xFF;
+        if (status < 0xF0) {
+            size_t bin = (size_t)(tempo_map_time(&a->tempo_map, t->tick, &cursor) / BIN_100NS);
+            if (bin >= a->bin_count) bin = a->bin_count - 1;
+            atomic_fetch_add_explicit(&a->event_bins[bin], 1, memory_order_relaxed);
+
+            if ((status & 0xF0) == 0x90 && ((t->message >> 16) & 0xFF) > 0) {
+                atomic_fetch_add_explicit(&a->note_bins[bin], 1, memory_order_relaxed);
+            }
+        }
+        update_tick(t);
+    }
+}
+
+// Min-heap of track indices by next tick, then track index: the order
+// the engines send in
+typedef struct {
+    int* tracks;
+    int count;
+    const TrackData* cursors;
+} TrackHeap;
+
+static inline bool heap_before(const TrackHeap* h, int a, int b) {
+    uint64_t ta = h->cursors[a].tick, tb = h->cursors[b].tick;
+    return ta < tb || (ta == tb && a < b);
+}
+
+static void heap_sift_down(TrackHeap* h, int slot) {
+    int track = h->tracks[slot];
+    while (true) {
+        int child = 2 * slot + 1;
+        if (child >= h->count) break;
+        if (child + 1 < h->count && heap_before(h, h->tracks[child + 1], h->tracks[child])) child++;
+        if (!heap_before(h, h->tracks[child], track)) break;
+        h->tracks[slot] = h->tracks[child];
+        slot = child;
+    }
+    h->tracks[slot] = track;
+}
+
+// Pass 2, beside the binning: every track merged in playback order, with
+// a live count of the notes sounding on each channel
+static void* polyphony_fn(void* arg) {
+    Analysis* a = (Analysis*)arg;
+    MidiProfile* p = a->profile;
+    TrackData* cursors = malloc((a->track_count ? a->track_count : 1) * sizeof(TrackData));
+    int* order = malloc((a->track_count ? a->track_count : 1) * sizeof(int));
+    // Long enough for every message, so it is never reallocated
+    uint8_t* scratch = malloc(p->max_long_msg + 1);
+    if (!cursors || !order || !scratch) {
+        a->polyphony_failed = true;
+        goto done;
+    }
+
+    TrackHeap heap = { order, 0, cursors };
+    for (int i = 0; i < a->track_count; i++) {
+        cursors[i] = a->tracks[i];
+        cursors[i].long_msg = scratch;
+        cursors[i].long_msg_capacity = p->max_long_msg;
+        if (cursors[i].data) order[heap.count++] = i;
+    }
+    for (int slot = heap.count / 2 - 1; slot >= 0; slot--) heap_sift_down(&heap, slot);
+
+    int64_t sounding[16] = { 0 };
+    while (heap.count > 0) {
+        TrackData* t = &cursors[heap.tracks[0]];
+        uint64_t tick = t->tick;
+        bool more;
+        while ((more = next_event(t))) {
+            uint8_t status = t->message & 0xF0;
+            int channel = t->message & 0x0F;
+            if (status == 0x90 && ((t->message >> 16) & 0xFF) > 0) {
+                if (++sounding[channel] > p->max_polyphony[channel]) {
+                    p->max_polyphony[channel] = (uint32_t)sounding[channel];
+                }
+            } else if ((status == 0x80 || status == 0x90) && sounding[channel] > 0) {
+                sounding[channel]--;  // stray note-offs are ignored
+            }
+            update_tick(t);
+            if (t->tick != tick) break;
+        }
+        if (!more) heap.tracks[0] = heap.tracks[--heap.count];
+        heap_sift_down(&heap, 0);
+    }
+
+done:
+    free(cursors);
+    free(order);
+    free(scratch);
+    return NULL;
+}
+
+// Largest sum of any `width` consecutive bins
+static uint64_t peak_window(_Atomic uint32_t* bins, size_t count, size_t width) {
+    uint64_t sum = 0, peak = 0;
+    for (size_t i = 0; i < count; i++) {
+        sum += bins[i];
+        if (i >= width) sum -= bins[i - width];
+        if (sum > peak) peak = sum;
+    }
+    return peak;
+}
+
+static void find_dense_ranges(Analysis* a, size_t width) {
+    MidiProfile* p = a->profile;
+    size_t count = a->bin_count;
+    size_t windows = count > width ? count - width + 1 : 1;
+
+    // sums[i] = events in bins [i, i + width)
+    uint64_t* sums = malloc(windows * sizeof(uint64_t));
+    if (!sums) return;
+    uint64_t sum = 0;
+    for (size_t i = 0; i < count; i++) {
+        sum += a->event_bins[i];
+        if (i >= width) sum -= a->event_bins[i - width];
+        if (i + 1 >= width) sums[i + 1 - width] = sum;
+    }
+    if (count < width) sums[0] = sum;
+
+    p->top_count = 0;
+    while (p->top_count < ANALYZE_TOP_RANGES) {
+        size_t best = 0;
+        for (size_t i = 1; i < windows; i++) {
+            if (sums[i] > sums[best]) best = i;
+        }
+        if (sums[best] == 0) break;
+
+        p->top[p->top_count++] = (DensityRange){ (int64_t)best * BIN_100NS, sums[best] };
+
+        // Exclude every window overlapping the one just taken
+        size_t from = best >= width ? best - width + 1 : 0;
+        size_t to = best + width < windows ? best + width : windows;
+        for (size_t i = from; i < to; i++) sums[i] = 0;
+    }
+    free(sums);
+}
+
+MidiProfile* analyze_midi(const TrackData* tracks, int track_count, uint16_t time_div,
+                          const uint32_t* windows_ms, int window_count) {
+    int64_t start_time = getTime100ns();
+
+    MidiProfile* p = calloc(1, sizeof(MidiProfile));
+    Analysis a = { .tracks = tracks, .track_count = track_count, .time_div = time_div, .profile = p };
+    if (!p) return NULL;
+
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    p->threads = (int)(cpus < 1 ? 1 : cpus);
+    if (p->threads > track_count) p->threads = track_count > 0 ? track_count : 1;
+
+    p->track_count = track_count;
+    p->tracks = calloc(track_count ? track_count : 1, sizeof(TrackProfile));
+    p->window_count = window_count;
+    p->window_ms = malloc(window_count * sizeof(uint32_t));
+    p->peak_nps = calloc(window_count, sizeof(double));
+    p->peak_eps = calloc(window_count, sizeof(double));
+    a.tempo_events = calloc(track_count ? track_count : 1, sizeof(TempoEvent*));
+    a.tempo_counts = calloc(track_count ? track_count : 1, sizeof(int));
+    if (!p->tracks || !p->window_ms || !p->peak_nps || !p->peak_eps ||
+        !a.tempo_events || !a.tempo_counts) {
+        goto fail;
+    }
+    memcpy(p->window_ms, windows_ms, window_count * sizeof(uint32_t));
+
+    // Pass 1: counts, longest messages and tempo changes
+    run_parallel(&a, count_track);
+
+    int tempo_total = 0;
+    uint64_t last_tick = 0;
+    for (int i = 0; i < track_count; i++) {
+        TrackProfile* t = &p->tracks[i];
+        p->total_events += t->events;
+        p->total_notes += t->notes;
+        p->total_meta += t->meta_events;
+        if (t->events > p->max_track_events) p->max_track_events = t->events;
+        if (t->max_long_msg > p->max_long_msg) p->max_long_msg = t->max_long_msg;
+        if (t->last_tick > last_tick) last_tick = t->last_tick;
+        tempo_total += a.tempo_counts[i];
+    }
+    p->tempo_changes = tempo_total;
+
+    TempoEvent* tempo = malloc((tempo_total ? tempo_total : 1) * sizeof(TempoEvent));
+    if (!tempo) goto fail;
+    for (int i = 0, n = 0; i < track_count; i++) {
+        if (a.tempo_counts[i]) {
+            memcpy(&tempo[n], a.tempo_events[i], a.tempo_counts[i] * sizeof(TempoEvent));
+            n += a.tempo_counts[i];
+        }
+    }
+    bool built = tempo_map_build(&a.tempo_map, tempo, tempo_total, time_div);
+    free(tempo);
+    if (!built) goto fail;
+
+    int cursor = 0;
+    p->duration_100ns = tempo_map_time(&a.tempo_map, last_tick, &cursor);
+
+    // Pass 2: place every channel message on the 1 ms timeline, and walk
+    // the whole file in order for polyphony
+    a.bin_count = (size_t)(p->duration_100ns / BIN_100NS) + 1;
+    a.note_bins = calloc(a.bin_count, sizeof(*a.note_bins));
+    a.event_bins = calloc(a.bin_count, sizeof(*a.event_bins));
+    if (!a.note_bins || !a.event_bins) goto fail;
+
+    pthread_t polyphony;
+    bool walking = pthread_create(&polyphony, NULL, polyphony_fn, &a) == 0;
+    run_parallel(&a, bin_track);
+    if (walking) {
+        pthread_join(polyphony, NULL);
+    } else {
+        polyphony_fn(&a);
+    }
+    if (a.polyphony_failed) goto fail;
+
+    for (int w = 0; w < window_count; w++) {
+        size_t width = windows_ms[w] ? windows_ms[w] : 1;
+        double per_second = 1000.0 / (double)width;
+        p->peak_nps[w] = peak_window(a.note_bins, a.bin_count, width) * per_second;
+        p->peak_eps[w] = peak_window(a.event_bins, a.bin_count, width) * per_second;
+    }
+
+    find_dense_ranges(&a, windows_ms[0] ? windows_ms[0] : 1);
+
+    p->analyze_ms = (long)((getTime100ns() - start_time) / 10000);
+
+    tempo_map_free(&a.tempo_map);
+    free((void*)a.note_bins);
+    free((void*)a.event_bins);
+    for (int i = 0; i < track_count; i++) free(a.tempo_events[i]);
+    free(a.tempo_events);
+    free(a.tempo_counts);
+    return p;
+
+fail:
+    fprintf(stderr, "Memory allocation failed\n");
+    tempo_map_free(&a.tempo_map);
+    free((void*)a.note_bins);
+    free((void*)a.event_bins);
+    if (a.tempo_events) {
+        for (int i = 0; i < track_count; i++) free(a.tempo_events[i]);
+    }
+    free(a.tempo_events);
+    free(a.tempo_counts);
+    free_midi_profile(p);
+    return NULL;
+}
+
+void print_midi_profile(const MidiProfile* p, const char* filename, FILE* out) {
+    fprintf(out, "mplayer: Analysis of %s\n", filename);
+    fprintf(out, "  Tracks:          %d\n", p->track_count);
+    fprintf(out, "  Duration:        %.3f s\n", p->duration_100ns / 10000000.0);
+    fprintf(out, "  Events:          %llu channel, %llu meta/SysEx\n",
+            (unsigned long long)p->total_events, (unsigned long long)p->total_meta);
+    fprintf(out, "  Notes:           %llu\n", (unsigned long long)p->total_notes);
+    fprintf(out, "  Tempo changes:   %u\n", p->tempo_changes);
+
+    for (int w = 0; w < p->window_count; w++) {
+        fprintf(out, "  %s %6u ms window: %.0f notes/s, %.0f events/s\n",
+                w == 0 ? "Peak rate," : "          ", p->window_ms[w], p->peak_nps[w], p->peak_eps[w]);
+    }
+
+    fprintf(out, "  Max polyphony:  ");
+    bool any = false;
+    for (int ch = 0; ch < 16; ch++) {
+        if (p->max_polyphony[ch] == 0) continue;
+        fprintf(out, " ch%d=%u", ch + 1, p->max_polyphony[ch]);
+        any = true;
+    }
+    fprintf(out, "%s\n", any ? "" : " none");
+
+    fprintf(out, "  Densest %u ms ranges:\n", p->window_count ? p->window_ms[0] : 0);
+    for (int i = 0; i < p->top_count; i++) {
+        double start = p->top[i].start_100ns / 10000000.0;
+        fprintf(out, "    %10.3f - %10.3f s: %llu events\n", start,
+                start + p->window_ms[0] / 1000.0, (unsigned long long)p->top[i].events);
+    }
+
+    fprintf(out, "  Largest:         %llu events in one track, %u bytes longest meta/SysEx\n",
+            (unsigned long long)p->max_track_events, p->max_long_msg);
+    fprintf(out, "  Analyzed in %ldms on %d threads.\n", p->analyze_ms, p->threads);
+}
+
+void free_midi_profile(MidiProfile* p) {
+    if (!p) return;
+    free(p->tracks);
+    free(p->window_ms);
+    free(p->peak_nps);
+    free(p->peak_eps);
+    free(p);
+}
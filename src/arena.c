@@ -0,0 +1,201 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include "arena.h"
+
+#define HUGE_PAGE_SIZE (2UL << 20)
+#define MPOL_PREFERRED 1   // from numaif.h, which needs libnuma installed
+
+static ArenaPolicy policy = { .huge_pages = HUGE_PAGES_OFF, .prefault = true, .lock = false, .numa_node = -1 };
+
+void arena_set_policy(const ArenaPolicy* p) {
+    policy = *p;
+}
+
+const ArenaPolicy* arena_policy(void) {
+    return &policy;
+}
+
+static size_t round_up(size_t value, size_t to) {
+    return (value + to - 1) / to * to;
+}
+
+// Before the first touch, so every page is allocated on the node
+static void prefer_node(void* base, size_t size, int node) {
+#ifdef SYS_mbind
+    unsigned long mask[4] = { 0 };
+    if (node < 0 || node >= (int)(sizeof(mask) * 8)) return;
+    mask[node / (sizeof(long) * 8)] = 1UL << (node % (sizeof(long) * 8));
+    if (syscall(SYS_mbind, base, size, MPOL_PREFERRED, mask, sizeof(mask) * 8, 0) != 0) {
+        static bool warned = false;
+        if (!warned) {
+            perror("mplayer: mbind");
+            warned = true;
+        }
+    }
+#else
+    (void)base; (void)size; (void)node;
+#endif
+}
+
+Arena* arena_create(size_t capacity) {
+    size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+    capacity += sizeof(Arena);
+
+    void* base = MAP_FAILED;
+    bool huge = false;
+    size_t reserved = 0;
+
+#ifdef MAP_HUGETLB
+    if (policy.huge_pages == HUGE_PAGES_EXPLICIT) {
+        // Reserved from the pool up front: a short pool has to fail here,
+        // not with SIGBUS on first touch
+        reserved = round_up(capacity, HUGE_PAGE_SIZE);
+        base = mmap(NULL, reserved, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (base == MAP_FAILED) {
+            static bool warned = false;
+            if (!warned) {
+                fprintf(stderr, "mplayer: No explicit huge pages available, using normal pages\n");
+                warned = true;
+            }
+        } else {
+            huge = true;
+            page_size = HUGE_PAGE_SIZE;
+        }
+    }
+#endif
+
+    if (base == MAP_FAILED) {
+        reserved = round_up(capacity, page_size);
+        base = mmap(NULL, reserved, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (base == MAP_FAILED) {
+            perror("mplayer: arena");
+            return NULL;
+        }
+#ifdef MADV_HUGEPAGE
+        if (policy.huge_pages == HUGE_PAGES_TRANSPARENT) {
+            madvise(base, reserved, MADV_HUGEPAGE);
+        }
+#endif
+    }
+
+    prefer_node(base, reserved, policy.numa_node);
+
+    Arena* arena = base;
+    arena->base = base;
+    arena->reserved = reserved;
+    arena->used = round_up(sizeof(Arena), 64);
+    arena->page_size = page_size;
+    arena->lazy_from = 0;
+    arena->huge = huge;
+    arena->locked = false;
+    return arena;
+}
+
+void* arena_alloc(Arena* arena, size_t size, size_t align) {
+    size_t start = round_up(arena->used, align);
+    if (start > arena->reserved || size > arena->reserved - start) {
+        return NULL;
+    }
+    arena->used = start + size;
+    return arena->base + start;
+}
+
+void arena_shrink_last(Arena* arena, void* block, size_t size) {
+    size_t start = (size_t)((uint8_t*)block - arena->base);
+    if (start + size < arena->used) {
+        arena->used = start + size;
+    }
+}
+
+void arena_begin_lazy(Arena* arena) {
+    arena->lazy_from = arena->used;
+}
+
+void arena_finish(Arena* arena) {
+    // Give back the part of the reservation that was not needed
+    size_t keep = round_up(arena->used, arena->page_size);
+    if (keep < arena->reserved) {
+        munmap(arena->base + keep, arena->reserved - keep);
+        arena->reserved = keep;
+    }
+
+    size_t eager = arena->lazy_from ? arena->lazy_from : arena->used;
+    if (policy.prefault) {
+        // Write, so copy-on-write zero pages get real backing too
+        for (size_t offset = 0; offset < eager; offset += arena->page_size) {
+            volatile uint8_t* page = arena->base + offset;
+            *page = *page;
+        }
+    }
+
+    if (policy.lock && !arena->locked) {
+        size_t lock = arena->lazy_from ? round_up(eager, arena->page_size) : arena->reserved;
+        if (mlock(arena->base, lock) == 0) {
+            arena->locked = true;
+        } else {
+            static bool warned = false;
+            if (!warned) {
+                perror("mplayer: mlock (raise RLIMIT_MEMLOCK / ulimit -l)");
+                warned = true;
+            }
+        }
+    }
+}
+
+void arena_commit(Arena* arena, void* block, size_t size) {
+    if (size == 0 || !(policy.prefault || policy.lock)) return;
+    size_t offset = (size_t)((uint8_t*)block - arena->base);
+    size_t start = offset / arena->page_size * arena->page_size;
+    size_t end = round_up(offset + size, arena->page_size);
+    uint8_t* pages = arena->base + start;
+
+    // The first and last page can be shared with buffers in use, so they
+    // are not written to as in arena_finish
+    bool populated = false;
+#ifdef MADV_POPULATE_WRITE
+    populated = policy.prefault && madvise(pages, end - start, MADV_POPULATE_WRITE) == 0;
+#endif
+    if (policy.prefault && !populated) {
+        for (size_t page = start; page < end; page += arena->page_size) {
+            __atomic_fetch_or(arena->base + page, 0, __ATOMIC_RELAXED);
+        }
+    }
+
+    if (policy.lock) {
+        if (mlock(pages, end - start) == 0) {
+            arena->locked = true;
+        } else {
+            static bool warned = false;
+            if (!warned) {
+                perror("mplayer: mlock (raise RLIMIT_MEMLOCK / ulimit -l)");
+                warned = true;
+            }
+        }
+    }
+}
+
+Arena* arena_of_first(void* first) {
+    return (Arena*)((uint8_t*)first - round_up(sizeof(Arena), 64));
+}
+
+void arena_destroy(Arena* arena) {
+    if (!arena) return;
+    if (arena->locked) {
+        munlock(arena->base, arena->reserved);
+    }
+    munmap(arena->base, arena->reserved);
+}
+
+bool lock_all_memory(void) {
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+        perror("mplayer: mlockall (raise RLIMIT_MEMLOCK / ulimit -l)");
+        return false;
+    }
+    return true;
+}
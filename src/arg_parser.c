@@ -7,6 +7,36 @@ typedef enum {
     ARG_ALSA,
     ARG_MINVEL,
     ARG_FILE,
+    ARG_PLAYLIST,
+    ARG_DAEMON,
+    ARG_SPEED,
+    ARG_ANALYZE,
+    ARG_WINDOW,
+    ARG_COALESCE,
+    ARG_COALESCE_WINDOW,
+    ARG_CAPTURE,
+    ARG_HEADLESS,
+    ARG_QUIET,
+    ARG_HUGE_PAGES,
+    ARG_NO_PREFAULT,
+    ARG_MLOCK,
+    ARG_ENGINE,
+    ARG_PARSERS,
+    ARG_OVERLOAD,
+    ARG_OVERLOAD_THRESHOLD,
+    ARG_PIN_PLAYBACK,
+    ARG_PIN_PARSER,
+    ARG_PIN_LOGGER,
+    ARG_REALTIME,
+    ARG_RT_PRIORITY,
+    ARG_KDMAPI,
+    ARG_KDMAPI_BUFFERED,
+    ARG_SHM,
+    ARG_REMAP,
+    ARG_TRANSPOSE,
+    ARG_MUTE_CHANNELS,
+    ARG_MUTE_TRACKS,
+    ARG_VELOCITY_CURVE,
     ARG_UNKNOWN
 } ArgType;
 
@@ -22,12 +52,66 @@ static const ArgKey known_keys[] = {
     {"alsa",   ARG_ALSA,   "Set ALSA output client:port"},
     {"p",      ARG_ALSA,   "Short alias for --alsa"},
 
-    {"minvel", ARG_MINVEL, "Set minimum velocity (0-127)"},
+    {"minvel", ARG_MINVEL, "Set minimum velocity (0-127, -1 sends every note)"},
     {"mv",     ARG_MINVEL, "Alias for --minvel"},
     {"m",      ARG_MINVEL, "Short alias for --minvel"},
 
-    {"file",   ARG_FILE,   "MIDI file to play"},
-    {"f",      ARG_FILE,   "Short alias for --file"}
+    {"file",   ARG_FILE,   "MIDI file to play (repeat to queue several)"},
+    {"f",      ARG_FILE,   "Short alias for --file"},
+
+    {"playlist", ARG_PLAYLIST, "Play every file listed in a playlist file"},
+    {"l",        ARG_PLAYLIST, "Short alias for --playlist"},
+
+    {"daemon", ARG_DAEMON, "Run as a daemon controlled through a Unix socket"},
+    {"d",      ARG_DAEMON, "Short alias for --daemon"},
+
+    {"speed",  ARG_SPEED,  "Tempo multiplier, e.g. 1.5 (change live with +/- on stdin)"},
+    {"s",      ARG_SPEED,  "Short alias for --speed"},
+
+    {"analyze", ARG_ANALYZE, "Report event rates, polyphony and buffer sizes, then exit"},
+    {"a",       ARG_ANALYZE, "Short alias for --analyze"},
+
+    {"window",  ARG_WINDOW,  "Peak-rate windows for --analyze in ms (default 100,1000)"},
+    {"w",       ARG_WINDOW,  "Short alias for --window"},
+
+    {"coalesce", ARG_COALESCE, "Skip controller, pitch bend and aftertouch messages overwritten in the same tick"},
+    {"c",        ARG_COALESCE, "Short alias for --coalesce"},
+
+    {"coalesce-window", ARG_COALESCE_WINDOW, "With --coalesce, also merge ticks closer than this many ms"},
+
+    {"capture",  ARG_CAPTURE,  "Record every sent message with its time to a trace file"},
+    {"headless", ARG_HEADLESS, "Play without an output device on a virtual clock, as fast as possible"},
+
+    {"quiet",  ARG_QUIET,  "Do not print notes per second while playing"},
+    {"q",      ARG_QUIET,  "Short alias for --quiet"},
+
+    {"huge-pages", ARG_HUGE_PAGES, "Back loaded files with huge pages: off, transparent or explicit (default off)"},
+    {"no-prefault", ARG_NO_PREFAULT, "Do not touch every page of a loaded file before playing it"},
+    {"mlock",      ARG_MLOCK,      "Lock all memory so playback never waits on a page fault"},
+
+    {"engine", ARG_ENGINE, "Playback engine: inline (default, one thread) or buffered (parser and dispatcher threads, for dense files)"},
+    {"e",      ARG_ENGINE, "Short alias for --engine"},
+    {"parsers", ARG_PARSERS, "Buffered engine: decode the tracks on this many threads, merged in time order (default: 1; try 2-8 on files with many dense tracks)"},
+
+    {"overload",           ARG_OVERLOAD,           "When playback falls behind: off (play everything late, default), drop or thin note-ons until it catches up"},
+    {"overload-threshold", ARG_OVERLOAD_THRESHOLD, "How late playback may be before --overload sheds note-ons, in ms (default 50)"},
+
+    {"pin-playback", ARG_PIN_PLAYBACK, "Run the thread that times and sends events on these CPUs, e.g. 3 or 2-3"},
+    {"pin-parser",   ARG_PIN_PARSER,   "Run the buffered engine's parser threads on these CPUs"},
+    {"pin-logger",   ARG_PIN_LOGGER,   "Run the notes-per-second logger on these CPUs"},
+    {"realtime",     ARG_REALTIME,     "Realtime scheduling for playback and parser: fifo, rr or off (needs CAP_SYS_NICE)"},
+    {"rt-priority",  ARG_RT_PRIORITY,  "Realtime priority of the playback thread, 2-99 (default 80, parser one less)"},
+
+    {"kdmapi",          ARG_KDMAPI,          "KDMAPI library to load instead of OmniMIDI; with --headless it still receives the events"},
+    {"kdmapi-buffered", ARG_KDMAPI_BUFFERED, "Send through KDMAPI's event buffer (SendDirectData) even when SendDirectDataNoBuf exists"},
+
+    {"shm", ARG_SHM, "Send timestamped events to a synthesizer process through this shared memory ring; works with --headless"},
+
+    {"remap",          ARG_REMAP,          "Move channels, e.g. 1:2,10:11 plays channel 1 on 2 and 10 on 11"},
+    {"transpose",      ARG_TRANSPOSE,      "Shift notes by semitones on every channel but 10, or on a list: 12 or -5:1-4,6"},
+    {"mute-channels",  ARG_MUTE_CHANNELS,  "Drop every message on these channels, e.g. 10 or 1-4,9"},
+    {"mute-tracks",    ARG_MUTE_TRACKS,    "Drop the channel messages of these tracks, counted from 0, e.g. 0,3-5"},
+    {"velocity-curve", ARG_VELOCITY_CURVE, "Note-on velocity curve: gamma[:scale], velocity = 127 * (v/127)^gamma * scale"}
 };
 
 static ArgType identify_arg(const char* key) {
@@ -38,8 +122,33 @@ static ArgType identify_arg(const char* key) {
     return ARG_UNKNOWN;
 }
 
+// Options that take no value
+static int is_flag(ArgType type) {
+    return type == ARG_ANALYZE || type == ARG_COALESCE || type == ARG_HEADLESS || type == ARG_QUIET ||
+           type == ARG_NO_PREFAULT || type == ARG_MLOCK || type == ARG_KDMAPI_BUFFERED;
+}
+
+static int parse_windows(const char* value, Options* opts) {
+    opts->window_count = 0;
+    while (*value) {
+        char* end;
+        long ms = strtol(value, &end, 10);
+        if (end == value || ms <= 0 || ms > 3600000 || opts->window_count == MAX_WINDOWS) {
+            fprintf(stderr, "window must be a list of up to %d lengths in ms\n", MAX_WINDOWS);
+            return 0;
+        }
+        opts->windows_ms[opts->window_count++] = (uint32_t)ms;
+        value = (*end == ',') ? end + 1 : end;
+        if (*end != ',' && *end != '\0') {
+            fprintf(stderr, "Invalid window list\n");
+            return 0;
+        }
+    }
+    return opts->window_count > 0;
+}
+
 static void print_usage(const char* prog_name) {
-    printf("Usage: %s [options] -f <midi_file>\n\nOptions:\n", prog_name);
+    printf("Usage: %s [options] -f <midi_file> [more files...]\n\nOptions:\n", prog_name);
 
     for (size_t i = 0; i < NUM_KEYS; ++i) {
         if (i > 0 && known_keys[i].type == known_keys[i - 1].type)
@@ -59,12 +168,50 @@ static void print_usage(const char* prog_name) {
     printf("\nExamples:\n");
     printf("  %s -f song.mid --alsa=14:0 --minvel=64\n", prog_name);
     printf("  %s -p 14:0 -m 10 song.mid\n", prog_name);
+    printf("  %s first.mid second.mid --playlist=set.txt\n", prog_name);
+    printf("  %s --daemon=/tmp/mplayer.sock\n", prog_name);
+    printf("  %s --analyze --window=50,1000 song.mid\n", prog_name);
+    printf("  %s --coalesce --coalesce-window=2 song.mid\n", prog_name);
+    printf("  %s --headless --capture=golden.trace song.mid\n", prog_name);
+    printf("  %s --huge-pages=transparent --mlock song.mid\n", prog_name);
+    printf("  %s --headless --engine=buffered dense.mid\n", prog_name);
+    printf("  %s -e buffered --parsers=4 dense.mid\n", prog_name);
+    printf("  %s --overload=thin --overload-threshold=30 black.mid\n", prog_name);
+    printf("  %s -e buffered --pin-playback=3 --pin-parser=2 --pin-logger=0 --realtime=fifo song.mid\n", prog_name);
+    printf("  %s --headless --kdmapi=./libkdmapi_mock.so song.mid\n", prog_name);
+    printf("  %s --shm=mplayer song.mid   (then: shm_ring_stat mplayer)\n", prog_name);
+    printf("  %s --remap=1:2 --transpose=-12 --mute-tracks=3 --velocity-curve=0.5 song.mid\n", prog_name);
 }
 
 int parse_args(int argc, char* argv[], Options* opts) {
-    opts->filename = NULL;
+    opts->files = malloc(argc * sizeof(const char*));
+    opts->file_count = 0;
+    opts->playlist = NULL;
     opts->alsa_port = NULL;
+    opts->kdmapi_lib = NULL;
+    opts->kdmapi_buffered = false;
+    opts->shm_name = NULL;
+    opts->daemon_socket = NULL;
     opts->min_velocity = 1;
+    transform_spec_init(&opts->transform);
+    opts->engine = PLAYBACK_ENGINE_INLINE;
+    opts->parser_threads = 0;
+    opts->overload = OVERLOAD_OFF;
+    opts->overload_threshold_ms = 50;
+    for (int role = 0; role < THREAD_ROLE_COUNT; role++) opts->pin_cpus[role] = NULL;
+    opts->realtime = REALTIME_OFF;
+    opts->realtime_priority = 80;
+    opts->coalesce = false;
+    opts->coalesce_window_ms = 0;
+    opts->speed = 1.0;
+    opts->analyze = false;
+    opts->capture_path = NULL;
+    opts->headless = false;
+    opts->quiet = false;
+    opts->memory = *arena_policy();
+    opts->windows_ms[0] = 100;
+    opts->windows_ms[1] = 1000;
+    opts->window_count = 2;
 
     for (int i = 1; i < argc; ++i) {
         const char* arg = argv[i];
@@ -82,42 +229,204 @@ int parse_args(int argc, char* argv[], Options* opts) {
             if (eq) {
                 *eq = '\0';
                 value = eq + 1;
-            } else if (i + 1 < argc) {
+            }
+
+            ArgType type = identify_arg(key);
+            if (!value && !is_flag(type) && type != ARG_UNKNOWN) {
+                if (i + 1 >= argc) {
+                    fprintf(stderr, "Missing value for option: %s\n", arg);
+                    return 0;
+                }
                 value = argv[++i];
-            } else {
-                fprintf(stderr, "Missing value for option: %s\n", arg);
-                return 0;
             }
 
-            switch (identify_arg(key)) {
+            switch (type) {
                 case ARG_ALSA:
                     opts->alsa_port = value;
                     break;
                 case ARG_MINVEL: {
                     int vel = atoi(value);
-                    if (vel < 0 || vel > 127) {
-                        fprintf(stderr, "minvel must be between 0 and 127\n");
+                    if (vel < -1 || vel > 127) {
+                        fprintf(stderr, "minvel must be between -1 and 127\n");
                         return 0;
                     }
                     opts->min_velocity = vel;
                     break;
                 }
                 case ARG_FILE:
-                    opts->filename = value;
+                    opts->files[opts->file_count++] = value;
+                    break;
+                case ARG_PLAYLIST:
+                    opts->playlist = value;
+                    break;
+                case ARG_DAEMON:
+                    opts->daemon_socket = value;
+                    break;
+                case ARG_SPEED: {
+                    double speed = atof(value);
+                    if (speed < 0.01 || speed > 100.0) {
+                        fprintf(stderr, "speed must be between 0.01 and 100\n");
+                        return 0;
+                    }
+                    opts->speed = speed;
+                    break;
+                }
+                case ARG_ANALYZE:
+                    opts->analyze = true;
+                    break;
+                case ARG_WINDOW:
+                    if (!parse_windows(value, opts)) return 0;
+                    break;
+                case ARG_COALESCE:
+                    opts->coalesce = true;
+                    break;
+                case ARG_CAPTURE:
+                    opts->capture_path = value;
+                    break;
+                case ARG_HEADLESS:
+                    opts->headless = true;
+                    break;
+                case ARG_QUIET:
+                    opts->quiet = true;
+                    break;
+                case ARG_HUGE_PAGES:
+                    if (strcmp(value, "off") == 0) {
+                        opts->memory.huge_pages = HUGE_PAGES_OFF;
+                    } else if (strcmp(value, "transparent") == 0) {
+                        opts->memory.huge_pages = HUGE_PAGES_TRANSPARENT;
+                    } else if (strcmp(value, "explicit") == 0) {
+                        opts->memory.huge_pages = HUGE_PAGES_EXPLICIT;
+                    } else {
+                        fprintf(stderr, "huge-pages must be off, transparent or explicit\n");
+                        return 0;
+                    }
+                    break;
+                case ARG_ENGINE:
+                    if (!playback_engine_from_name(value, &opts->engine)) {
+                        fprintf(stderr, "engine must be inline or buffered\n");
+                        return 0;
+                    }
                     break;
+                case ARG_PARSERS: {
+                    int threads = atoi(value);
+                    if (threads < 1 || threads > 8) {
+                        fprintf(stderr, "parsers must be between 1 and 8\n");
+                        return 0;
+                    }
+                    opts->parser_threads = threads;
+                    break;
+                }
+                case ARG_OVERLOAD:
+                    if (!overload_policy_from_name(value, &opts->overload)) {
+                        fprintf(stderr, "overload must be off, drop or thin\n");
+                        return 0;
+                    }
+                    break;
+                case ARG_OVERLOAD_THRESHOLD: {
+                    double ms = atof(value);
+                    if (ms < 1 || ms > 10000) {
+                        fprintf(stderr, "overload-threshold must be between 1 and 10000 ms\n");
+                        return 0;
+                    }
+                    opts->overload_threshold_ms = ms;
+                    break;
+                }
+                case ARG_PIN_PLAYBACK:
+                    opts->pin_cpus[THREAD_ROLE_PLAYBACK] = value;
+                    break;
+                case ARG_PIN_PARSER:
+                    opts->pin_cpus[THREAD_ROLE_PARSER] = value;
+                    break;
+                case ARG_PIN_LOGGER:
+                    opts->pin_cpus[THREAD_ROLE_LOGGER] = value;
+                    break;
+                case ARG_REALTIME:
+                    if (strcmp(value, "fifo") == 0) {
+                        opts->realtime = REALTIME_FIFO;
+                    } else if (strcmp(value, "rr") == 0) {
+                        opts->realtime = REALTIME_RR;
+                    } else if (strcmp(value, "off") == 0) {
+                        opts->realtime = REALTIME_OFF;
+                    } else {
+                        fprintf(stderr, "realtime must be fifo, rr or off\n");
+                        return 0;
+                    }
+                    break;
+                case ARG_RT_PRIORITY: {
+                    int priority = atoi(value);
+                    if (priority < 2 || priority > 99) {
+                        fprintf(stderr, "rt-priority must be between 2 and 99\n");
+                        return 0;
+                    }
+                    opts->realtime_priority = priority;
+                    break;
+                }
+                case ARG_KDMAPI:
+                    opts->kdmapi_lib = value;
+                    break;
+                case ARG_KDMAPI_BUFFERED:
+                    opts->kdmapi_buffered = true;
+                    break;
+                case ARG_SHM:
+                    opts->shm_name = value;
+                    break;
+                case ARG_REMAP:
+                    if (!transform_parse_remap(&opts->transform, value)) {
+                        fprintf(stderr, "remap must be a list of from:to channel pairs, channels 1-16\n");
+                        return 0;
+                    }
+                    break;
+                case ARG_TRANSPOSE:
+                    if (!transform_parse_transpose(&opts->transform, value)) {
+                        fprintf(stderr, "transpose must be semitones (-127 to 127), optionally followed by :channels\n");
+                        return 0;
+                    }
+                    break;
+                case ARG_MUTE_CHANNELS:
+                    if (!transform_parse_mute_channels(&opts->transform, value)) {
+                        fprintf(stderr, "mute-channels must be a list of channels 1-16\n");
+                        return 0;
+                    }
+                    break;
+                case ARG_MUTE_TRACKS:
+                    if (!transform_parse_mute_tracks(&opts->transform, value)) {
+                        fprintf(stderr, "mute-tracks must be a list of up to %d track numbers or ranges\n",
+                                TRANSFORM_MAX_TRACK_RANGES);
+                        return 0;
+                    }
+                    break;
+                case ARG_VELOCITY_CURVE:
+                    if (!transform_parse_velocity_curve(&opts->transform, value)) {
+                        fprintf(stderr, "velocity-curve must be a gamma between 0.1 and 10, optionally followed by :scale\n");
+                        return 0;
+                    }
+                    break;
+                case ARG_NO_PREFAULT:
+                    opts->memory.prefault = false;
+                    break;
+                case ARG_MLOCK:
+                    opts->memory.lock = true;
+                    break;
+                case ARG_COALESCE_WINDOW: {
+                    double ms = atof(value);
+                    if (ms < 0 || ms > 100.0) {
+                        fprintf(stderr, "coalesce-window must be between 0 and 100 ms\n");
+                        return 0;
+                    }
+                    opts->coalesce = true;
+                    opts->coalesce_window_ms = ms;
+                    break;
+                }
                 default:
                     fprintf(stderr, "Unknown option: --%s\n", key);
                     return 0;
             }
-        } else if (!opts->filename) {
-            opts->filename = arg;
         } else {
-            fprintf(stderr, "Unexpected argument: %s\n", arg);
-            return 0;
+            opts->files[opts->file_count++] = arg;
         }
     }
 
-    if (!opts->filename) {
+    if (opts->file_count == 0 && !opts->playlist && !opts->daemon_socket) {
         fprintf(stderr, "No MIDI file specified.\n");
         print_usage(argv[0]);
         return 0;
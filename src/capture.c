@@ -0,0 +1,37 @@
+#include <stdio.h>
+#include <stdint.h>
+
+#include "capture.h"
+#include "trace.h"
+
+static TraceWriter writer;
+static SendDirectDataFunc forward_to = NULL;
+static int64_t start_time = 0;
+
+bool capture_start(const char* path, SendDirectDataFunc forward) {
+    if (!trace_writer_open(&writer, path)) {
+        return false;
+    }
+    forward_to = forward;
+    start_time = getTime100ns();
+    return true;
+}
+
+void capture_send(uint32_t message) {
+    trace_writer_add(&writer, getTime100ns() - start_time, message);
+    if (forward_to) {
+        forward_to(message);
+    }
+}
+
+bool capture_stop(void) {
+    uint64_t count = writer.count;
+    bool ok = trace_writer_close(&writer);
+    if (ok) {
+        printf("mplayer: Captured %llu messages\n", (unsigned long long)count);
+    } else {
+        fprintf(stderr, "mplayer: Failed to write the capture trace\n");
+    }
+    forward_to = NULL;
+    return ok;
+}
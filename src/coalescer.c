@@ -0,0 +1,101 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "coalescer.h"
+
+// Keys: controller (channel, number), poly aftertouch (channel, note),
+// then program, channel aftertouch and pitch bend per channel
+#define KEY_CONTROLLER  0
+#define KEY_POLY_TOUCH  2048
+#define KEY_PROGRAM     4096
+#define KEY_CHAN_TOUCH  4112
+#define KEY_PITCH_BEND  4128
+#define KEY_COUNT       4144
+
+// Returns the key a message is merged on, or -1 for a barrier
+static int coalesce_key(uint32_t message) {
+    uint8_t channel = message & 0x0F;
+    uint8_t data1 = (message >> 8) & 0x7F;
+
+    switch (message & 0xF0) {
+        case 0xA0:
+            return KEY_POLY_TOUCH + channel * 128 + data1;
+        case 0xB0:
+            // Data entry depends on the (N)RPN selected before it, a program
+            // change on the bank selected before it, and mode messages act
+            // on other controllers
+            if (data1 == 0 || data1 == 32 || data1 == 6 || data1 == 38 ||
+                (data1 >= 96 && data1 <= 101) || data1 >= 120) {
+                return -1;
+            }
+            return KEY_CONTROLLER + channel * 128 + data1;
+        case 0xC0:
+            return KEY_PROGRAM + channel;
+        case 0xD0:
+            return KEY_CHAN_TOUCH + channel;
+        case 0xE0:
+            return KEY_PITCH_BEND + channel;
+        default:
+            return -1;
+    }
+}
+
+bool coalescer_init(Coalescer* c, size_t capacity) {
+    memset(c, 0, sizeof(*c));
+    c->capacity = capacity;
+    c->events = malloc(capacity * sizeof(uint32_t));
+    c->owner = calloc(KEY_COUNT, sizeof(uint32_t));
+    c->touched = malloc(KEY_COUNT * sizeof(uint16_t));
+    if (!c->events || !c->owner || !c->touched) {
+        coalescer_free(c);
+        return false;
+    }
+    return true;
+}
+
+void coalescer_free(Coalescer* c) {
+    free(c->events);
+    free(c->owner);
+    free(c->touched);
+    c->events = NULL;
+    c->owner = NULL;
+    c->touched = NULL;
+}
+
+void coalescer_push(Coalescer* c, uint32_t message, SendDirectDataFunc SendDirectData) {
+    if (c->count == c->capacity) {
+        coalescer_flush(c, SendDirectData);
+    }
+
+    uint32_t slot = (uint32_t)c->count + 1;
+    uint8_t channel = message & 0x0F;
+    int key = coalesce_key(message);
+
+    if (key < 0) {
+        c->barrier[channel] = slot;
+    } else {
+        uint32_t previous = c->owner[key];
+        if (previous > c->barrier[channel]) {
+            c->events[previous - 1] = 0;
+            c->dropped++;
+        } else if (previous == 0) {
+            c->touched[c->touched_count++] = (uint16_t)key;
+        }
+        c->owner[key] = slot;
+    }
+    c->events[c->count++] = message;
+}
+
+void coalescer_flush(Coalescer* c, SendDirectDataFunc SendDirectData) {
+    for (size_t i = 0; i < c->count; i++) {
+        if (c->events[i]) {
+            SendDirectData(c->events[i]);
+        }
+    }
+    for (size_t i = 0; i < c->touched_count; i++) {
+        c->owner[c->touched[i]] = 0;
+    }
+    memset(c->barrier, 0, sizeof(c->barrier));
+    c->touched_count = 0;
+    c->count = 0;
+}
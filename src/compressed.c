@@ -0,0 +1,454 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <zlib.h>
+#include <lzma.h>
+#include <zstd.h>
+
+#include "compressed.h"
+
+#define ZSTD_BLOCK_MAX (128 * 1024)
+// zlib counts in 32-bit units
+#define ZLIB_STEP      (1U << 30)
+
+Compression compression_detect(const char* filename) {
+    static const uint8_t xz_magic[6] = { 0xFD, '7', 'z', 'X', 'Z', 0x00 };
+    uint8_t magic[6] = { 0 };
+
+    FILE* file = fopen(filename, "rb");
+    if (!file) return COMPRESSION_NONE;
+    size_t got = fread(magic, 1, sizeof(magic), file);
+    fclose(file);
+
+    if (got >= 2 && magic[0] == 0x1F && magic[1] == 0x8B) return COMPRESSION_GZIP;
+    if (got >= 6 && memcmp(magic, xz_magic, 6) == 0) return COMPRESSION_XZ;
+    if (got >= 4 && magic[0] == 0x28 && magic[1] == 0xB5 && magic[2] == 0x2F && magic[3] == 0xFD) {
+        return COMPRESSION_ZSTD;
+    }
+    return COMPRESSION_NONE;
+}
+
+const char* compression_name(Compression format) {
+    switch (format) {
+        case COMPRESSION_GZIP: return "gzip";
+        case COMPRESSION_XZ:   return "xz";
+        case COMPRESSION_ZSTD: return "zstd";
+        default:               return "none";
+    }
+}
+
+bool compressed_open(CompressedFile* file, const char* filename) {
+    file->format = compression_detect(filename);
+    file->data = NULL;
+    file->size = 0;
+
+    int fd = open(filename, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0 || st.st_size == 0) {
+        fprintf(stderr, "Could not open file\n");
+        if (fd >= 0) close(fd);
+        return false;
+    }
+
+    void* data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        perror("mplayer: mmap");
+        return false;
+    }
+    // Read front to back, once
+    madvise(data, (size_t)st.st_size, MADV_SEQUENTIAL);
+
+    file->data = data;
+    file->size = (size_t)st.st_size;
+    return true;
+}
+
+void compressed_close(CompressedFile* file) {
+    if (file->data) {
+        munmap((void*)file->data, file->size);
+    }
+    file->data = NULL;
+    file->size = 0;
+}
+
+// ——— gzip ———
+
+// Members are decoded one after another; prefix stops once out is full.
+// Past capacity, the rest is only counted: ISIZE covers the last member
+// alone, so files of several members need a second try.
+static size_t gzip_decode(const CompressedFile* file, uint8_t* out, size_t capacity, bool prefix) {
+    z_stream z;
+    memset(&z, 0, sizeof(z));
+    // 32: gzip or zlib header, detected
+    if (inflateInit2(&z, 15 + 32) != Z_OK) return (size_t)-1;
+
+    uint8_t overflow[16384];
+    size_t in = 0, produced = 0;
+    size_t result = (size_t)-1;
+    while (true) {
+        size_t in_left = file->size - in, out_left = capacity - produced;
+        z.next_in = (Bytef*)file->data + in;
+        z.avail_in = in_left < ZLIB_STEP ? (uInt)in_left : ZLIB_STEP;
+        if (produced < capacity) {
+            z.next_out = out + produced;
+            z.avail_out = out_left < ZLIB_STEP ? (uInt)out_left : ZLIB_STEP;
+        } else {
+            z.next_out = overflow;
+            z.avail_out = sizeof(overflow);
+        }
+        uInt avail_in = z.avail_in, avail_out = z.avail_out;
+
+        int ret = inflate(&z, Z_NO_FLUSH);
+        in += avail_in - z.avail_in;
+        produced += avail_out - z.avail_out;
+
+        if (prefix && produced == capacity) {
+            result = produced;
+            break;
+        }
+        if (ret == Z_STREAM_END) {
+            // Another member follows, or padding that is ignored
+            if (in + 2 <= file->size && file->data[in] == 0x1F && file->data[in + 1] == 0x8B) {
+                inflateReset(&z);
+                continue;
+            }
+            result = produced;
+            break;
+        }
+        if (ret == Z_OK) continue;
+        if (ret == Z_BUF_ERROR && in == file->size && !prefix) {
+            fprintf(stderr, "mplayer: gzip data is truncated, playing %zu bytes\n", produced);
+            result = produced;
+        } else {
+            fprintf(stderr, "mplayer: Corrupt gzip data: %s\n", z.msg ? z.msg : "unknown error");
+        }
+        break;
+    }
+    inflateEnd(&z);
+    return result;
+}
+
+// ISIZE of the last member
+static size_t gzip_size(const CompressedFile* file) {
+    if (file->size < 18) return 0;
+    const uint8_t* isize = file->data + file->size - 4;
+    return (size_t)isize[0] | (size_t)isize[1] << 8 | (size_t)isize[2] << 16 | (size_t)isize[3] << 24;
+}
+
+// ——— xz ———
+
+// Sum over every stream's index, walking back from the end of the file
+static size_t xz_size(const CompressedFile* file) {
+    const uint8_t* data = file->data;
+    size_t end = file->size;
+    uint64_t total = 0;
+
+    while (end > 0) {
+        // Stream padding, in multiples of four zero bytes
+        while (end >= 4 && memcmp(data + end - 4, "\0\0\0\0", 4) == 0) end -= 4;
+        if (end < 2 * LZMA_STREAM_HEADER_SIZE) return 0;
+
+        lzma_stream_flags footer;
+        if (lzma_stream_footer_decode(&footer, data + end - LZMA_STREAM_HEADER_SIZE) != LZMA_OK) return 0;
+        if (footer.backward_size > end - 2 * LZMA_STREAM_HEADER_SIZE) return 0;
+        size_t index_start = end - LZMA_STREAM_HEADER_SIZE - (size_t)footer.backward_size;
+
+        lzma_index* index = NULL;
+        uint64_t memlimit = UINT64_MAX;
+        size_t pos = index_start;
+        if (lzma_index_buffer_decode(&index, &memlimit, NULL, data, &pos,
+                                     index_start + (size_t)footer.backward_size) != LZMA_OK) return 0;
+        total += lzma_index_uncompressed_size(index);
+        if (total > COMPRESSED_SIZE_MAX) {
+            lzma_index_end(index, NULL);
+            return 0;
+        }
+        lzma_vli blocks = lzma_index_total_size(index);
+        lzma_index_end(index, NULL);
+
+        if (blocks + LZMA_STREAM_HEADER_SIZE > index_start) return 0;
+        end = index_start - (size_t)blocks - LZMA_STREAM_HEADER_SIZE;
+    }
+    return total > COMPRESSED_SIZE_MAX ? 0 : (size_t)total;
+}
+
+// Blocks that record their sizes (xz -T writes them) are decoded in parallel
+static size_t xz_decode(const CompressedFile* file, uint8_t* out, size_t capacity, int threads, bool prefix) {
+    lzma_stream s = LZMA_STREAM_INIT;
+    lzma_mt mt;
+    memset(&mt, 0, sizeof(mt));
+    mt.flags = LZMA_CONCATENATED;
+    mt.threads = threads > 0 ? (uint32_t)threads : 1;
+    // Past this, the decoder falls back to one thread rather than failing
+    mt.memlimit_threading = lzma_physmem() / 4;
+    mt.memlimit_stop = UINT64_MAX;
+
+    lzma_ret ret = threads > 1 ? lzma_stream_decoder_mt(&s, &mt)
+                               : lzma_stream_decoder(&s, UINT64_MAX, LZMA_CONCATENATED);
+    if (ret != LZMA_OK) {
+        fprintf(stderr, "mplayer: xz decoder unavailable (%d)\n", ret);
+        return (size_t)-1;
+    }
+
+    s.next_in = file->data;
+    s.avail_in = file->size;
+    s.next_out = out;
+    s.avail_out = capacity;
+
+    do {
+        ret = lzma_code(&s, LZMA_FINISH);
+    } while (ret == LZMA_OK && !(prefix && s.avail_out == 0));
+
+    size_t produced = capacity - s.avail_out;
+    size_t result = (size_t)-1;
+    if (ret == LZMA_STREAM_END || (prefix && produced == capacity)) {
+        result = produced;
+    } else if (ret == LZMA_BUF_ERROR && s.avail_out == 0) {
+        fprintf(stderr, "mplayer: xz data is larger than its index (%zu bytes)\n", capacity);
+    } else if (ret == LZMA_BUF_ERROR && !prefix) {
+        fprintf(stderr, "mplayer: xz data is truncated, playing %zu bytes\n", produced);
+        result = produced;
+    } else {
+        fprintf(stderr, "mplayer: Corrupt xz data (%d)\n", ret);
+    }
+    lzma_end(&s);
+    return result;
+}
+
+// ——— zstd ———
+
+typedef struct {
+    const uint8_t* src;
+    size_t compressed;
+    size_t offset;     // where the frame's output starts
+    size_t size;       // its content size
+} ZstdFrame;
+
+// For frames without a content size: every block is at most 128 KiB
+// (RFC 8878, 3.1.1)
+static bool zstd_frame_bound(const uint8_t* src, size_t size, size_t* bound) {
+    static const size_t did_bytes[4] = { 0, 1, 2, 4 };
+    static const size_t fcs_bytes[4] = { 0, 2, 4, 8 };
+    if (size < 5) return false;
+    uint8_t descriptor = src[4];
+    bool single_segment = descriptor & 0x20;
+    size_t fcs = fcs_bytes[descriptor >> 6];
+    if (single_segment && fcs == 0) fcs = 1;
+    size_t pos = 5 + (single_segment ? 0 : 1) + did_bytes[descriptor & 3] + fcs;
+
+    *bound = 0;
+    while (pos + 3 <= size) {
+        uint32_t header = src[pos] | src[pos + 1] << 8 | (uint32_t)src[pos + 2] << 16;
+        uint32_t type = (header >> 1) & 3, block_size = header >> 3;
+        pos += 3;
+        // Raw and RLE blocks give their regenerated size
+        *bound += type == 2 ? ZSTD_BLOCK_MAX : block_size;
+        if (*bound > COMPRESSED_SIZE_MAX) return false;
+        pos += type == 1 ? 1 : block_size;
+        if (header & 1) return pos <= size;
+    }
+    return false;
+}
+
+// Lists the frames; *count is 0 for a file that is not valid zstd
+static ZstdFrame* zstd_frames(const CompressedFile* file, int* count, bool* sized) {
+    int capacity = 16;
+    ZstdFrame* frames = malloc(capacity * sizeof(ZstdFrame));
+    size_t pos = 0, offset = 0;
+    *count = 0;
+    *sized = true;
+
+    while (frames && pos < file->size) {
+        const uint8_t* src = file->data + pos;
+        size_t compressed = ZSTD_findFrameCompressedSize(src, file->size - pos);
+        if (ZSTD_isError(compressed)) {
+            fprintf(stderr, "mplayer: Corrupt zstd data: %s\n", ZSTD_getErrorName(compressed));
+            *count = 0;
+            break;
+        }
+
+        unsigned long long content = ZSTD_getFrameContentSize(src, compressed);
+        size_t size;
+        if (content == ZSTD_CONTENTSIZE_ERROR) {
+            *count = 0;
+            break;
+        } else if (content == ZSTD_CONTENTSIZE_UNKNOWN) {
+            *sized = false;
+            if (!zstd_frame_bound(src, compressed, &size)) {
+                *count = 0;
+                break;
+            }
+        } else if (content > COMPRESSED_SIZE_MAX) {
+            *count = 0;
+            break;
+        } else {
+            size = (size_t)content;  // 0 for skippable frames too
+        }
+        // Both are at most COMPRESSED_SIZE_MAX, so the sum does not wrap
+        if (offset + size > COMPRESSED_SIZE_MAX) {
+            fprintf(stderr, "mplayer: zstd frames add up to more than %zu GiB\n", COMPRESSED_SIZE_MAX >> 30);
+            *count = 0;
+            break;
+        }
+
+        if (*count == capacity) {
+            capacity *= 2;
+            ZstdFrame* grown = realloc(frames, capacity * sizeof(ZstdFrame));
+            if (!grown) break;
+            frames = grown;
+        }
+        frames[(*count)++] = (ZstdFrame){ src, compressed, offset, size };
+        pos += compressed;
+        offset += size;
+    }
+    if (!frames) fprintf(stderr, "Memory allocation failed\n");
+    return frames;
+}
+
+static size_t zstd_size(const CompressedFile* file) {
+    int count;
+    bool sized;
+    ZstdFrame* frames = zstd_frames(file, &count, &sized);
+    size_t size = count > 0 ? frames[count - 1].offset + frames[count - 1].size : 0;
+    free(frames);
+    return size;
+}
+
+// One frame after another, whatever sizes they record
+static size_t zstd_decode_stream(const CompressedFile* file, uint8_t* out, size_t capacity, bool prefix) {
+    ZSTD_DCtx* dctx = ZSTD_createDCtx();
+    if (!dctx) return (size_t)-1;
+
+    ZSTD_inBuffer in = { file->data, file->size, 0 };
+    ZSTD_outBuffer output = { out, capacity, 0 };
+    size_t ret = 0;
+    while (in.pos < in.size) {
+        size_t in_before = in.pos, out_before = output.pos;
+        ret = ZSTD_decompressStream(dctx, &output, &in);
+        if (ZSTD_isError(ret) || (prefix && output.pos == output.size)) break;
+        // Stuck with the output full
+        if (in.pos == in_before && output.pos == out_before) break;
+    }
+    ZSTD_freeDCtx(dctx);
+
+    if (ZSTD_isError(ret)) {
+        fprintf(stderr, "mplayer: Corrupt zstd data: %s\n", ZSTD_getErrorName(ret));
+        return (size_t)-1;
+    }
+    if (!prefix && in.pos < in.size) {
+        fprintf(stderr, "mplayer: zstd data is larger than its frames say (%zu bytes)\n", capacity);
+        return (size_t)-1;
+    }
+    if (!prefix && ret != 0) {
+        fprintf(stderr, "mplayer: zstd data is truncated, playing %zu bytes\n", output.pos);
+    }
+    return output.pos;
+}
+
+typedef struct {
+    const ZstdFrame* frames;
+    int count;
+    uint8_t* out;
+    size_t capacity;
+    atomic_int next;
+    atomic_bool failed;
+} ZstdJobs;
+
+// Workers take the next frame until none are left
+static void* zstd_worker(void* arg) {
+    ZstdJobs* jobs = arg;
+    ZSTD_DCtx* dctx = ZSTD_createDCtx();
+    if (!dctx) {
+        atomic_store(&jobs->failed, true);
+        return NULL;
+    }
+
+    int i;
+    while ((i = atomic_fetch_add(&jobs->next, 1)) < jobs->count && !atomic_load(&jobs->failed)) {
+        const ZstdFrame* frame = &jobs->frames[i];
+        // Never past out, whatever the headers say
+        size_t room = frame->offset < jobs->capacity ? jobs->capacity - frame->offset : 0;
+        size_t got = ZSTD_decompressDCtx(dctx, jobs->out + frame->offset, frame->size < room ? frame->size : room,
+                                         frame->src, frame->compressed);
+        if (ZSTD_isError(got) || got != frame->size) {
+            fprintf(stderr, "mplayer: Corrupt zstd frame %d: %s\n", i,
+                    ZSTD_isError(got) ? ZSTD_getErrorName(got) : "size differs from its header");
+            atomic_store(&jobs->failed, true);
+        }
+    }
+    ZSTD_freeDCtx(dctx);
+    return NULL;
+}
+
+// Frames that all record their size each have a known place in the
+// output, so they are decoded in parallel, straight there
+static size_t zstd_decode(const CompressedFile* file, uint8_t* out, size_t capacity, int threads, bool prefix) {
+    int count = 0;
+    bool sized = false;
+    ZstdFrame* frames = prefix || threads < 2 ? NULL : zstd_frames(file, &count, &sized);
+    size_t total = count > 0 ? frames[count - 1].offset + frames[count - 1].size : 0;
+
+    if (count < 2 || !sized || total > capacity) {
+        free(frames);
+        return zstd_decode_stream(file, out, capacity, prefix);
+    }
+
+    ZstdJobs jobs = { .frames = frames, .count = count, .out = out, .capacity = capacity };
+    atomic_init(&jobs.next, 0);
+    atomic_init(&jobs.failed, false);
+
+    if (threads > count) threads = count;
+    pthread_t* workers = malloc((threads - 1) * sizeof(pthread_t));
+    int started = 0;
+    while (workers && started < threads - 1 &&
+           pthread_create(&workers[started], NULL, zstd_worker, &jobs) == 0) {
+        started++;
+    }
+    zstd_worker(&jobs);
+    for (int i = 0; i < started; i++) {
+        pthread_join(workers[i], NULL);
+    }
+    free(workers);
+
+    free(frames);
+    return atomic_load(&jobs.failed) ? (size_t)-1 : total;
+}
+
+// ——— Dispatch ———
+
+size_t compressed_size_bound(const CompressedFile* file) {
+    switch (file->format) {
+        case COMPRESSION_GZIP: return gzip_size(file);
+        case COMPRESSION_XZ:   return xz_size(file);
+        case COMPRESSION_ZSTD: return zstd_size(file);
+        default:               return 0;
+    }
+}
+
+bool compressed_peek(const CompressedFile* file, uint8_t* out, size_t size) {
+    size_t got;
+    switch (file->format) {
+        case COMPRESSION_GZIP: got = gzip_decode(file, out, size, true); break;
+        case COMPRESSION_XZ:   got = xz_decode(file, out, size, 1, true); break;
+        case COMPRESSION_ZSTD: got = zstd_decode(file, out, size, 1, true); break;
+        default:               return false;
+    }
+    return got == size;
+}
+
+size_t compressed_decode(const CompressedFile* file, uint8_t* out, size_t capacity, int threads) {
+    switch (file->format) {
+        case COMPRESSION_GZIP: return gzip_decode(file, out, capacity, false);
+        case COMPRESSION_XZ:   return xz_decode(file, out, capacity, threads, false);
+        case COMPRESSION_ZSTD: return zstd_decode(file, out, capacity, threads, false);
+        default:               return (size_t)-1;
+    }
+}
@@ -0,0 +1,71 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "console-control.h"
+
+typedef struct {
+    PlaybackControl* control;
+    atomic_bool* quit;
+} ConsoleArgs;
+
+static void* console_thread_fn(void* arg) {
+    ConsoleArgs* args = (ConsoleArgs*)arg;
+    PlaybackControl* control = args->control;
+    char line[64];
+
+    while (fgets(line, sizeof(line), stdin)) {
+        switch (line[0]) {
+            case 'p': {
+                bool paused = !playback_control_paused(control);
+                playback_control_pause(control, paused);
+                printf("mplayer: %s\n", paused ? "Paused" : "Resumed");
+                break;
+            }
+            case 'n':
+                playback_control_stop(control);
+                break;
+            case 'q':
+                // In this order and sequentially consistent, see the
+                // playlist loop in main.c: if it misses quit, stop is set
+                // after its reset
+                atomic_store(args->quit, true);
+                atomic_store(&control->stop, true);
+                break;
+            case '+':
+            case '-': {
+                double speed = playback_control_speed(control) * (line[0] == '+' ? 1.1 : 1.0 / 1.1);
+                playback_control_set_speed(control, speed);
+                printf("mplayer: Speed %.2fx\n", playback_control_speed(control));
+                break;
+            }
+            case 'x': {
+                double speed = strtod(line + 1, NULL);
+                if (speed <= 0) break;
+                playback_control_set_speed(control, speed);
+                printf("mplayer: Speed %.2fx\n", playback_control_speed(control));
+                break;
+            }
+            default:
+                break;
+        }
+        fflush(stdout);
+    }
+
+    free(args);
+    return NULL;
+}
+
+void console_control_start(PlaybackControl* control, atomic_bool* quit) {
+    ConsoleArgs* args = malloc(sizeof(ConsoleArgs));
+    if (!args) return;
+    args->control = control;
+    args->quit = quit;
+
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, console_thread_fn, args) != 0) {
+        free(args);
+        return;
+    }
+    pthread_detach(thread);
+}
@@ -0,0 +1,310 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "daemon.h"
+#include "midi.h"
+#include "midi-player.h"
+#include "midi-output.h"
+
+#define DAEMON_CACHE_SIZE 8
+#define DAEMON_LINE_MAX   4096
+
+typedef struct {
+    char* path;
+    TrackData* tracks;   // never played directly, see share_tracks
+    int track_count;
+    uint16_t time_div;
+    uint64_t last_used;
+} CachedMidi;
+
+typedef struct {
+    MidiOutput output;
+    PlaybackOptions options;
+
+    CachedMidi cache[DAEMON_CACHE_SIZE];
+    uint64_t use_clock;
+    CachedMidi* current;
+
+    pthread_t player;
+    bool player_running;
+    atomic_bool playing;
+    PlaybackControl control;
+    TrackData* playing_tracks;
+    int playing_count;
+    uint16_t playing_time_div;
+} Daemon;
+
+static void cache_evict(CachedMidi* entry) {
+    free(entry->path);
+    free_tracks(entry->tracks, entry->track_count);
+    memset(entry, 0, sizeof(*entry));
+}
+
+static CachedMidi* cache_find(Daemon* d, const char* path) {
+    for (int i = 0; i < DAEMON_CACHE_SIZE; i++) {
+        if (d->cache[i].path && strcmp(d->cache[i].path, path) == 0) {
+            d->cache[i].last_used = ++d->use_clock;
+            return &d->cache[i];
+        }
+    }
+    return NULL;
+}
+
+static CachedMidi* cache_load(Daemon* d, const char* path) {
+    CachedMidi* entry = cache_find(d, path);
+    if (entry) return entry;
+
+    uint16_t time_div = 0;
+    int track_count = 0;
+    TrackData* tracks = load_midi_file(path, &time_div, &track_count);
+    if (!tracks) return NULL;
+
+    // Reuse a free slot, or evict the least recently used one that is not
+    // playing: playback shares its event data
+    bool playing = atomic_load(&d->playing);
+    entry = NULL;
+    for (int i = 0; i < DAEMON_CACHE_SIZE; i++) {
+        if (!d->cache[i].path) {
+            entry = &d->cache[i];
+            break;
+        }
+        if (playing && &d->cache[i] == d->current) continue;
+        if (!entry || d->cache[i].last_used < entry->last_used) {
+            entry = &d->cache[i];
+        }
+    }
+    if (entry->path) {
+        if (entry == d->current) d->current = NULL;
+        cache_evict(entry);
+    }
+
+    entry->path = strdup(path);
+    entry->tracks = tracks;
+    entry->track_count = track_count;
+    entry->time_div = time_div;
+    entry->last_used = ++d->use_clock;
+    return entry;
+}
+
+static void* player_thread_fn(void* arg) {
+    Daemon* d = (Daemon*)arg;
+
+    play_midi(d->playing_tracks, d->playing_count, d->playing_time_div,
+              d->output.SendDirectData, &d->options, &d->control);
+    all_notes_off(d->output.SendDirectData);
+
+    free_tracks(d->playing_tracks, d->playing_count);
+    d->playing_tracks = NULL;
+    atomic_store(&d->playing, false);
+    return NULL;
+}
+
+static void stop_playback(Daemon* d) {
+    if (!d->player_running) return;
+    playback_control_stop(&d->control);
+    pthread_join(d->player, NULL);
+    d->player_running = false;
+}
+
+static bool start_playback(Daemon* d, CachedMidi* entry, int64_t seek_100ns) {
+    stop_playback(d);
+
+    TrackData* tracks = share_tracks(entry->tracks, entry->track_count);
+    if (!tracks) return false;
+
+    d->current = entry;
+    d->playing_tracks = tracks;
+    d->playing_count = entry->track_count;
+    d->playing_time_div = entry->time_div;
+
+    // Speed carries over from one playback to the next
+    double speed = playback_control_speed(&d->control);
+    playback_control_init(&d->control);
+    playback_control_set_speed(&d->control, speed);
+    atomic_store(&d->control.seek_100ns, seek_100ns);
+    atomic_store(&d->control.position_100ns, seek_100ns);
+    atomic_store(&d->playing, true);
+
+    if (pthread_create(&d->player, NULL, player_thread_fn, d) != 0) {
+        atomic_store(&d->playing, false);
+        free_tracks(tracks, entry->track_count);
+        d->playing_tracks = NULL;
+        return false;
+    }
+    d->player_running = true;
+    return true;
+}
+
+// Handles one command line and writes the reply. Returns false on shutdown.
+static bool handle_command(Daemon* d, char* line, FILE* reply) {
+    char* arg = line;
+    char* cmd = strsep(&arg, " \t");
+    if (arg) arg += strspn(arg, " \t");
+    if (arg && *arg == '\0') arg = NULL;
+
+    if (strcmp(cmd, "load") == 0) {
+        if (!arg) {
+            fprintf(reply, "err usage: load <path>\n");
+            return true;
+        }
+        CachedMidi* entry = cache_load(d, arg);
+        if (!entry) {
+            fprintf(reply, "err failed to load %s\n", arg);
+            return true;
+        }
+        if (!atomic_load(&d->playing)) d->current = entry;
+        fprintf(reply, "ok loaded %s tracks=%d\n", entry->path, entry->track_count);
+    } else if (strcmp(cmd, "play") == 0) {
+        CachedMidi* entry = arg ? cache_load(d, arg) : d->current;
+        if (!entry) {
+            if (arg) fprintf(reply, "err failed to load %s\n", arg);
+            else fprintf(reply, "err nothing loaded\n");
+            return true;
+        }
+        if (!start_playback(d, entry, 0)) {
+            fprintf(reply, "err failed to start playback\n");
+            return true;
+        }
+        fprintf(reply, "ok playing %s\n", entry->path);
+    } else if (strcmp(cmd, "seek") == 0) {
+        double seconds = arg ? strtod(arg, NULL) : -1.0;
+        if (seconds < 0) {
+            fprintf(reply, "err usage: seek <seconds>\n");
+            return true;
+        }
+        if (!d->current) {
+            fprintf(reply, "err nothing loaded\n");
+            return true;
+        }
+        if (!start_playback(d, d->current, (int64_t)(seconds * 10000000.0))) {
+            fprintf(reply, "err failed to start playback\n");
+            return true;
+        }
+        fprintf(reply, "ok seek %.3f\n", seconds);
+    } else if (strcmp(cmd, "pause") == 0 || strcmp(cmd, "resume") == 0) {
+        bool pause = cmd[0] == 'p';
+        playback_control_pause(&d->control, pause);
+        fprintf(reply, "ok %s\n", pause ? "paused" : "resumed");
+    } else if (strcmp(cmd, "speed") == 0) {
+        double speed = arg ? strtod(arg, NULL) : 0.0;
+        if (speed <= 0) {
+            fprintf(reply, "err usage: speed <multiplier>\n");
+            return true;
+        }
+        playback_control_set_speed(&d->control, speed);
+        fprintf(reply, "ok speed %.3f\n", playback_control_speed(&d->control));
+    } else if (strcmp(cmd, "stop") == 0) {
+        stop_playback(d);
+        fprintf(reply, "ok stopped\n");
+    } else if (strcmp(cmd, "status") == 0) {
+        int cached = 0;
+        for (int i = 0; i < DAEMON_CACHE_SIZE; i++) {
+            if (d->cache[i].path) cached++;
+        }
+        bool playing = atomic_load(&d->playing);
+        double position = playing ? atomic_load(&d->control.position_100ns) / 10000000.0 : 0.0;
+        const char* state = !playing ? "stopped"
+                          : playback_control_paused(&d->control) ? "paused" : "playing";
+        fprintf(reply, "ok %s position=%.3f speed=%.3f cached=%d file=%s\n",
+                state, position, playback_control_speed(&d->control), cached,
+                d->current ? d->current->path : "-");
+    } else if (strcmp(cmd, "shutdown") == 0) {
+        stop_playback(d);
+        fprintf(reply, "ok bye\n");
+        return false;
+    } else {
+        fprintf(reply, "err unknown command: %s\n", cmd);
+    }
+    return true;
+}
+
+static bool serve_client(Daemon* d, int client) {
+    // Separate read and write streams: stdio may not switch direction on a socket
+    int write_fd = dup(client);
+    FILE* in = fdopen(client, "r");
+    FILE* out = write_fd >= 0 ? fdopen(write_fd, "w") : NULL;
+    if (!in || !out) {
+        if (in) fclose(in); else close(client);
+        if (out) fclose(out); else if (write_fd >= 0) close(write_fd);
+        return true;
+    }
+
+    bool keep_running = true;
+    char line[DAEMON_LINE_MAX];
+    while (keep_running && fgets(line, sizeof(line), in)) {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] == '\0') continue;
+
+        keep_running = handle_command(d, line, out);
+        fflush(out);
+    }
+
+    fclose(out);
+    fclose(in);
+    return keep_running;
+}
+
+int run_daemon(const char* socket_path, const char* alsa_port, const PlaybackOptions* options) {
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Socket path too long: %s\n", socket_path);
+        return 1;
+    }
+    strcpy(addr.sun_path, socket_path);
+
+    Daemon* d = calloc(1, sizeof(Daemon));
+    if (!d) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return 1;
+    }
+    d->options = *options;
+    playback_control_init(&d->control);
+
+    if (!midi_output_open(&d->output, alsa_port)) {
+        free(d);
+        return 1;
+    }
+    d->options.SendLongData = d->output.SendLongData;
+
+    int server = socket(AF_UNIX, SOCK_STREAM, 0);
+    unlink(socket_path);
+    if (server < 0 || bind(server, (struct sockaddr*)&addr, sizeof(addr)) < 0 ||
+        listen(server, 4) < 0) {
+        perror("mplayer: daemon socket");
+        if (server >= 0) close(server);
+        midi_output_close(&d->output);
+        free(d);
+        return 1;
+    }
+
+    // A client hanging up mid-reply must not kill the daemon
+    signal(SIGPIPE, SIG_IGN);
+
+    printf("mplayer: Daemon listening on %s\n", socket_path);
+    fflush(stdout);
+
+    bool keep_running = true;
+    while (keep_running) {
+        int client = accept(server, NULL, NULL);
+        if (client < 0) continue;
+        keep_running = serve_client(d, client);
+    }
+
+    close(server);
+    unlink(socket_path);
+
+    stop_playback(d);
+    for (int i = 0; i < DAEMON_CACHE_SIZE; i++) {
+        if (d->cache[i].path) cache_evict(&d->cache[i]);
+    }
+    midi_output_close(&d->output);
+    free(d);
+    return 0;
+}
@@ -1,4 +1,5 @@
 #include <stdio.h>
+#include <string.h>
 #include <stdbool.h>
 
 #ifdef _WIN32
@@ -9,17 +10,64 @@ typedef FARPROC ProcAddr;
 typedef void* ProcAddr;
 #endif
 
+#include "kdmapi.h"
+
 typedef bool (*IsKDMAPIAvailableFunc)();
 typedef bool (*InitializeKDMAPIStreamFunc)();
-typedef bool (*SendDirectDataFunc)(unsigned int);
+typedef bool (*TerminateKDMAPIStreamFunc)();
+typedef void (*ResetKDMAPIStreamFunc)();
+typedef bool (*ReturnKDMAPIVerFunc)(uint32_t* major, uint32_t* minor, uint32_t* build, uint32_t* revision);
+
+// MIDIHDR as KDMAPI takes it (the Windows layout, also on Linux)
+typedef struct KdmapiMidiHdr {
+    char* lpData;
+    uint32_t dwBufferLength;
+    uint32_t dwBytesRecorded;
+    uintptr_t dwUser;
+    uint32_t dwFlags;
+    struct KdmapiMidiHdr* lpNext;
+    uintptr_t reserved;
+    uint32_t dwOffset;
+    uintptr_t dwReserved[8];
+} KdmapiMidiHdr;
+
+#define KDMAPI_NOERROR 0   // MMSYSERR_NOERROR
+
+typedef uint32_t (*SendDirectLongDataFunc)(KdmapiMidiHdr* header, uint32_t header_size);
+typedef uint32_t (*PrepareLongDataFunc)(KdmapiMidiHdr* header, uint32_t header_size);
+typedef uint32_t (*UnprepareLongDataFunc)(KdmapiMidiHdr* header, uint32_t header_size);
+
+static const char* library_path = NULL;
+static bool prefer_buffered = false;
+
+static KdmapiFeatures features;
+static TerminateKDMAPIStreamFunc TerminateKDMAPIStream = NULL;
+static ResetKDMAPIStreamFunc ResetKDMAPIStream = NULL;
+static SendDirectLongDataFunc SendDirectLongData = NULL;
+static PrepareLongDataFunc PrepareLongData = NULL;
+static UnprepareLongDataFunc UnprepareLongData = NULL;
+static bool long_failed = false;
+
+void kdmapi_set_library(const char* path) {
+    library_path = path;
+}
+
+void kdmapi_prefer_buffered(bool buffered) {
+    prefer_buffered = buffered;
+}
+
+const KdmapiFeatures* kdmapi_features(void) {
+    return &features;
+}
 
 void* initialize_midi(SendDirectDataFunc* SendDirectData) {
     void* midi_lib = NULL;
 
 #ifdef _WIN32
-    HMODULE lib = LoadLibraryA("OmniMIDI.dll");
+    const char* path = library_path ? library_path : "OmniMIDI.dll";
+    HMODULE lib = LoadLibraryA(path);
     if (!lib) {
-        fprintf(stderr, "Failed to load OmniMIDI.dll\n");
+        fprintf(stderr, "Failed to load %s\n", path);
         return NULL;
     }
     midi_lib = (void*)lib;
@@ -27,9 +75,10 @@ void* initialize_midi(SendDirectDataFunc* SendDirectData) {
     #define LOAD_SYM(lib, name) (ProcAddr)GetProcAddress((HMODULE)(lib), name)
 
 #else
-    void* lib = dlopen("./libOmniMIDI.so", RTLD_LAZY);
+    const char* path = library_path ? library_path : "./libOmniMIDI.so";
+    void* lib = dlopen(path, RTLD_LAZY);
     if (!lib) {
-        fprintf(stderr, "Failed to load libOmniMIDI.so: %s\n", dlerror());
+        fprintf(stderr, "Failed to load %s: %s\n", path, dlerror());
         return NULL;
     }
     midi_lib = lib;
@@ -43,7 +92,7 @@ void* initialize_midi(SendDirectDataFunc* SendDirectData) {
     IsKDMAPIAvailableFunc IsKDMAPIAvailable = (IsKDMAPIAvailableFunc)LOAD_SYM(lib, "IsKDMAPIAvailable");
     InitializeKDMAPIStreamFunc InitializeKDMAPIStream = (InitializeKDMAPIStreamFunc)LOAD_SYM(lib, "InitializeKDMAPIStream");
 
-    if (!IsKDMAPIAvailable || !InitializeKDMAPIStream || 
+    if (!IsKDMAPIAvailable || !InitializeKDMAPIStream ||
         !IsKDMAPIAvailable() || !InitializeKDMAPIStream()) {
         fprintf(stderr, "MIDI initialization failed\n");
 #ifdef _WIN32
@@ -54,9 +103,32 @@ void* initialize_midi(SendDirectDataFunc* SendDirectData) {
         return NULL;
     }
 
-    *SendDirectData = (SendDirectDataFunc)LOAD_SYM(lib, "SendDirectData");
+    SendDirectDataFunc buffered = (SendDirectDataFunc)LOAD_SYM(lib, "SendDirectData");
+    SendDirectDataFunc no_buffer = (SendDirectDataFunc)LOAD_SYM(lib, "SendDirectDataNoBuf");
+    TerminateKDMAPIStream = (TerminateKDMAPIStreamFunc)LOAD_SYM(lib, "TerminateKDMAPIStream");
+    ResetKDMAPIStream = (ResetKDMAPIStreamFunc)LOAD_SYM(lib, "ResetKDMAPIStream");
+    SendDirectLongData = (SendDirectLongDataFunc)LOAD_SYM(lib, "SendDirectLongData");
+    PrepareLongData = (PrepareLongDataFunc)LOAD_SYM(lib, "PrepareLongData");
+    UnprepareLongData = (UnprepareLongDataFunc)LOAD_SYM(lib, "UnprepareLongData");
+    ReturnKDMAPIVerFunc ReturnKDMAPIVer = (ReturnKDMAPIVerFunc)LOAD_SYM(lib, "ReturnKDMAPIVer");
+
+    memset(&features, 0, sizeof(features));
+    features.no_buffer = no_buffer != NULL;
+    // The synth may keep the buffer until it is unprepared, so SysEx is only
+    // sent with all three
+    features.long_data = SendDirectLongData && PrepareLongData && UnprepareLongData;
+    long_failed = false;
+    features.terminate = TerminateKDMAPIStream != NULL;
+    features.reset = ResetKDMAPIStream != NULL;
+    features.version = ReturnKDMAPIVer &&
+        ReturnKDMAPIVer(&features.major, &features.minor, &features.build, &features.revision);
+
+    // The no-buffer variant hands each event to the synth right away instead
+    // of queueing it for the synth thread, so it is the faster path
+    *SendDirectData = no_buffer && !prefer_buffered ? no_buffer : buffered;
     if (!*SendDirectData) {
         fprintf(stderr, "Cannot load SendDirectData\n");
+        if (TerminateKDMAPIStream) TerminateKDMAPIStream();
 #ifdef _WIN32
         FreeLibrary((HMODULE)lib);
 #else
@@ -65,11 +137,63 @@ void* initialize_midi(SendDirectDataFunc* SendDirectData) {
         return NULL;
     }
 
+    char version[64] = "version unknown";
+    if (features.version) {
+        snprintf(version, sizeof(version), "%u.%u.%u.%u",
+                 features.major, features.minor, features.build, features.revision);
+    }
+    printf("mplayer: KDMAPI %s, events via %s%s%s\n", version,
+           *SendDirectData == no_buffer ? "SendDirectDataNoBuf" : "SendDirectData",
+           features.long_data ? ", SysEx via SendDirectLongData" : "",
+           features.terminate ? "" : ", no TerminateKDMAPIStream");
+
     return midi_lib;
 }
 
+static void long_data_failed(const char* call, uint32_t result) {
+    // Once, since it comes from the playback thread
+    if (!long_failed) {
+        fprintf(stderr, "mplayer: %s failed with error %u, SysEx may be lost\n", call, result);
+        long_failed = true;
+    }
+}
+
+void kdmapi_send_long(const uint8_t* data, uint32_t length) {
+    KdmapiMidiHdr header = {
+        .lpData = (char*)data,
+        .dwBufferLength = length,
+        .dwBytesRecorded = length,
+    };
+    uint32_t result = PrepareLongData(&header, sizeof(header));
+    if (result != KDMAPI_NOERROR) {
+        long_data_failed("PrepareLongData", result);
+        return;
+    }
+    result = SendDirectLongData(&header, sizeof(header));
+    if (result != KDMAPI_NOERROR) {
+        long_data_failed("SendDirectLongData", result);
+    }
+    result = UnprepareLongData(&header, sizeof(header));
+    if (result != KDMAPI_NOERROR) {
+        long_data_failed("UnprepareLongData", result);
+    }
+}
+
+void kdmapi_reset(void) {
+    if (ResetKDMAPIStream) ResetKDMAPIStream();
+}
+
 void unload_midi(void* midi_lib) {
     if (!midi_lib) return;
+    // Lets the synth stop its threads and release the audio device before
+    // its code is unmapped
+    if (TerminateKDMAPIStream) TerminateKDMAPIStream();
+    TerminateKDMAPIStream = NULL;
+    ResetKDMAPIStream = NULL;
+    SendDirectLongData = NULL;
+    PrepareLongData = NULL;
+    UnprepareLongData = NULL;
+    memset(&features, 0, sizeof(features));
 #ifdef _WIN32
     FreeLibrary((HMODULE)midi_lib);
 #else
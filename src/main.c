@@ -1,9 +1,18 @@
 #include <stdio.h>
 #include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
 
-#include "alsa_output.h"
 #include "midi.h"
 #include "midi-player.h"
+#include "midi-output.h"
+#include "playlist.h"
+#include "daemon.h"
+#include "console-control.h"
+#include "analyzer.h"
+#include "capture.h"
+#include "arena.h"
+#include "thread-placement.h"
 #include "kdmapi.h"
 #include "arg_parser.h"
 
@@ -13,36 +22,213 @@ int main(int argc, char* argv[]) {
         return 1;
     }
 
-    uint16_t time_div = 0;
-    int track_count = 0;
-    TrackData* tracks = load_midi_file(opts.filename, &time_div, &track_count);
-    if (!tracks) {
-        fprintf(stderr, "Failed to load MIDI file: %s\n", opts.filename);
-        return 1;
+    PlaybackOptions playback = {
+        .engine = opts.engine,
+        .parser_threads = opts.parser_threads,
+        .overload = opts.overload,
+        .overload_threshold_100ns = (int64_t)(opts.overload_threshold_ms * 10000.0),
+        .min_velocity = opts.min_velocity,
+        .transform = &opts.transform,
+        .quiet = opts.quiet,
+        .coalesce = opts.coalesce,
+        .coalesce_window_100ns = (int64_t)(opts.coalesce_window_ms * 10000.0),
+    };
+
+    for (int role = 0; role < THREAD_ROLE_COUNT; role++) {
+        if (opts.pin_cpus[role] && !thread_placement_pin(role, opts.pin_cpus[role])) {
+            fprintf(stderr, "Invalid or unavailable CPUs for the %s thread: %s\n",
+                    thread_role_name(role), opts.pin_cpus[role]);
+            return 1;
+        }
+    }
+    if (opts.realtime != REALTIME_OFF) {
+        thread_placement_realtime(opts.realtime, opts.realtime_priority);
     }
+    // Playback data goes on the node the playback thread runs on
+    opts.memory.numa_node = thread_role_numa_node(THREAD_ROLE_PLAYBACK);
 
-    SendDirectDataFunc SendDirectData = NULL;
+    // Before anything is loaded, so every arena follows the policy
+    arena_set_policy(&opts.memory);
+    kdmapi_set_library(opts.kdmapi_lib);
+    kdmapi_prefer_buffered(opts.kdmapi_buffered);
+    if (opts.memory.lock) {
+        lock_all_memory();
+    }
 
-    if (opts.alsa_port) {
-        if (!alsa_initialize(opts.alsa_port)) {
+    if (opts.daemon_socket) {
+        free(opts.files);
+        return run_daemon(opts.daemon_socket, opts.alsa_port, &playback);
+    }
+
+    // Command line files first, then the playlist entries
+    char** listed = NULL;
+    int listed_count = 0;
+    if (opts.playlist) {
+        listed_count = playlist_read(opts.playlist, &listed);
+        if (listed_count < 0) {
             return 1;
         }
-        SendDirectData = alsa_send;
-    } else {
-        void* midi_lib = initialize_midi(&SendDirectData);
-        if (!midi_lib) {
-            fprintf(stderr, "Failed to initialize MIDI library\n");
-            return 1;
+    }
+
+    int file_count = opts.file_count + listed_count;
+    if (file_count == 0) {
+        fprintf(stderr, "Playlist is empty: %s\n", opts.playlist);
+        playlist_free(listed, listed_count);
+        free(opts.files);
+        return 1;
+    }
+
+    const char** files = malloc(file_count * sizeof(const char*));
+    if (!files) {
+        fprintf(stderr, "Memory allocation failed\n");
+        playlist_free(listed, listed_count);
+        free(opts.files);
+        return 1;
+    }
+    for (int i = 0; i < opts.file_count; i++) files[i] = opts.files[i];
+    for (int i = 0; i < listed_count; i++) files[opts.file_count + i] = listed[i];
+
+    if (opts.analyze) {
+        int failures = 0;
+        for (int i = 0; i < file_count; i++) {
+            uint16_t time_div = 0;
+            int track_count = 0;
+            TrackData* tracks = load_midi_file(files[i], &time_div, &track_count);
+            MidiProfile* profile = tracks
+                ? analyze_midi(tracks, track_count, time_div, opts.windows_ms, opts.window_count)
+                : NULL;
+            if (!profile) {
+                fprintf(stderr, "Failed to analyze MIDI file: %s\n", files[i]);
+                failures++;
+            } else {
+                print_midi_profile(profile, files[i], stdout);
+            }
+            free_midi_profile(profile);
+            free_tracks(tracks, track_count);
+        }
+        playlist_free(listed, listed_count);
+        free(files);
+        free(opts.files);
+        return failures ? 1 : 0;
+    }
+
+    // Start loading the first file while the output initializes. Time to
+    // the first note is counted from here, and for each later file from
+    // the end of the one before.
+    int64_t requested = getRealTime100ns();
+    MidiPrefetch prefetch;
+    prefetch_start(&prefetch, files[0], &playback);
+
+    // Headless runs are unattended: virtual time, and no waiting on stdin
+    if (opts.headless) {
+        use_virtual_clock(true);
+    }
+
+    // Headless runs drop everything, unless a KDMAPI library or a shared
+    // memory ring was named: then it gets the events on the virtual clock
+    bool device = !opts.headless || opts.kdmapi_lib || opts.shm_name;
+    MidiOutput output = { .SendDirectData = midi_output_null };
+    bool output_ok = !device ||
+        (opts.shm_name ? midi_output_open_shm(&output, opts.shm_name)
+                       : midi_output_open(&output, opts.headless ? NULL : opts.alsa_port));
+    SendDirectDataFunc sink = output.SendDirectData;
+    playback.SendLongData = output.SendLongData;
+    if (output_ok && opts.capture_path) {
+        output_ok = capture_start(opts.capture_path, device ? output.SendDirectData : NULL);
+        if (!output_ok && device) midi_output_close(&output);
+        sink = capture_send;
+    }
+    if (!output_ok) {
+        LoadedMidi discard;
+        if (prefetch_finish(&prefetch, &discard)) {
+            loaded_midi_free(&discard);
+        }
+        playlist_free(listed, listed_count);
+        free(files);
+        free(opts.files);
+        return 1;
+    }
+
+    PlaybackControl control;
+    playback_control_init(&control);
+    playback_control_set_speed(&control, opts.speed);
+
+    atomic_bool quit = false;
+    if (!opts.headless) {
+        console_control_start(&control, &quit);
+    }
+
+    int failures = 0;
+    for (int i = 0; i < file_count && !atomic_load(&quit); i++) {
+        LoadedMidi current;
+        bool loaded = prefetch_finish(&prefetch, &current);
+
+        // Load (and for the buffered engine decode) the next file in the
+        // background while this one plays
+        if (i + 1 < file_count) {
+            prefetch_start(&prefetch, files[i + 1], &playback);
+        }
+
+        if (!loaded) {
+            fprintf(stderr, "Failed to load MIDI file: %s\n", current.filename);
+            failures++;
+            continue;
         }
 
-        play_midi(tracks, track_count, time_div, SendDirectData, opts.min_velocity);
-        unload_midi(midi_lib);
-        return 0;
+        // Only the skip ("n") is per file. quit persists: checked after the
+        // reset, a "q" that came in while switching files stops this one too
+        atomic_store(&control.stop, false);
+        if (atomic_load(&quit)) {
+            loaded_midi_free(&current);
+            break;
+        }
+        printf("mplayer: Playing MIDI file: %s\n", current.filename);
+        atomic_store(&control.first_note_100ns, 0);
+        playback.loading = current.stream;
+        // getTime100ns is virtual when headless, so time the run on the real clock
+        struct timespec started, finished;
+        clock_gettime(CLOCK_MONOTONIC, &started);
+        if (current.decoded) {
+            play_midi_buffered_prepared(current.decoded, sink, &playback, &control);
+            current.decoded = NULL;
+        } else {
+            play_midi(current.tracks, current.track_count, current.time_div,
+                      sink, &playback, &control);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &finished);
+        if (opts.headless) {
+            printf("mplayer: Headless playback took %.3f ms (%s engine)\n",
+                   (finished.tv_sec - started.tv_sec) * 1e3 + (finished.tv_nsec - started.tv_nsec) / 1e6,
+                   playback_engine_name(opts.engine));
+        }
+        int64_t first_note = atomic_load(&control.first_note_100ns);
+        if (first_note) {
+            printf("mplayer: First note after %.1f ms\n", (first_note - requested) / 1e4);
+        }
+        if (playback_control_stopped(&control)) {
+            all_notes_off(sink);
+        }
+        loaded_midi_free(&current);
+        requested = getRealTime100ns();
     }
 
-    printf("mplayer: Playing MIDI file: %s\n", opts.filename);
-    play_midi(tracks, track_count, time_div, SendDirectData, opts.min_velocity);
-    alsa_shutdown();
+    // A prefetch may still be running if playback was quit early
+    if (atomic_load(&quit)) {
+        LoadedMidi discard;
+        if (prefetch_finish(&prefetch, &discard)) {
+            loaded_midi_free(&discard);
+        }
+    }
+
+    if (opts.capture_path && !capture_stop()) {
+        failures = file_count;
+    }
+    if (device) {
+        midi_output_close(&output);
+    }
+    playlist_free(listed, listed_count);
+    free(files);
+    free(opts.files);
 
-    return 0;
+    return failures == file_count ? 1 : 0;
 }
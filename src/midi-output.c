@@ -0,0 +1,67 @@
+#include <stdio.h>
+
+#include "midi-output.h"
+#include "alsa_output.h"
+#include "kdmapi.h"
+#include "shm-output.h"
+
+bool midi_output_open(MidiOutput* out, const char* alsa_port) {
+    out->SendDirectData = NULL;
+    out->SendLongData = NULL;
+    out->midi_lib = NULL;
+    out->alsa = false;
+    out->shm = false;
+
+    if (alsa_port) {
+        if (!alsa_initialize(alsa_port)) {
+            return false;
+        }
+        out->SendDirectData = alsa_send;
+        out->alsa = true;
+        return true;
+    }
+
+    out->midi_lib = initialize_midi(&out->SendDirectData);
+    if (!out->midi_lib) {
+        fprintf(stderr, "Failed to initialize MIDI library\n");
+        return false;
+    }
+    if (kdmapi_features()->long_data) {
+        out->SendLongData = kdmapi_send_long;
+    }
+    return true;
+}
+
+bool midi_output_open_shm(MidiOutput* out, const char* name) {
+    out->SendDirectData = NULL;
+    out->SendLongData = NULL;
+    out->midi_lib = NULL;
+    out->alsa = false;
+    out->shm = false;
+
+    if (!shm_output_initialize(name)) {
+        return false;
+    }
+    out->SendDirectData = shm_output_send;
+    out->shm = true;
+    return true;
+}
+
+void midi_output_null(uint32_t message) {
+    (void)message;
+}
+
+void midi_output_close(MidiOutput* out) {
+    if (out->alsa) {
+        alsa_shutdown();
+    } else if (out->shm) {
+        shm_output_shutdown();
+    } else {
+        unload_midi(out->midi_lib);
+    }
+    out->SendDirectData = NULL;
+    out->SendLongData = NULL;
+    out->midi_lib = NULL;
+    out->alsa = false;
+    out->shm = false;
+}
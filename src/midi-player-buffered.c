@@ -0,0 +1,820 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <string.h>
+#include <unistd.h>       // usleep
+#include <xmmintrin.h>    // _mm_pause
+
+#include "midi-player.h"
+#include "playback-engines.h"
+#include "midi-utils.h"   // getTime100ns, delayExecution100Ns
+#include "coalescer.h"
+#include "midi-output.h"
+#include "alsa_output.h"
+#include "capture.h"
+#include "shm-output.h"
+#include "arena.h"
+#include "thread-placement.h"
+#include "track-schedule.h"
+
+#define RING_WORDS                (1UL << 22)  // 16 MiB of batches
+#define RING_MASK                 (RING_WORDS - 1)
+#define BATCH_HEADER_WORDS        3            // due time (low, high), count
+#define MAX_BATCH_EVENTS          4096
+#define LOG_INTERVAL_SEC          1
+#define BUSY_WAIT_THRESHOLD_100NS 50000LL       // ~5ms
+#define COALESCE_CAPACITY         65536
+#define SPIN_LIMIT                4096          // pauses before backing off
+#define MAX_SHARDS                8
+#define SHARD_RING_WORDS          (1UL << 18)  // 1 MiB per shard
+#define SHARD_RING_MASK           (SHARD_RING_WORDS - 1)
+#define SHARD_TEMPO               0xFF         // low byte of a tempo change in a shard batch
+
+// ——— Pipeline state ———
+// One per play_midi_buffered call, so several files can play at once.
+// The ring is single producer, single consumer, of 32-bit words. The
+// parser writes one batch per song time: a header with the due time (song
+// time, the dispatcher maps it to wall time) and the message count, then
+// the messages. head and tail count words and never wrap, so one release
+// store publishes a whole batch and one wait covers all of it.
+typedef struct {
+    uint32_t*          ring;
+    _Atomic size_t     ring_head;
+    _Atomic size_t     ring_tail;
+
+    atomic_bool        done_parsing;
+    atomic_bool        done_dispatch;
+    volatile uint64_t  note_on_cnt;
+    volatile uint64_t  event_count;
+    volatile uint64_t  parsed_event_count;
+    _Atomic int64_t    load_waited_100ns;  // parser time spent waiting for a streaming load
+
+    // Parser only: the batch being filled, every event due at batch_time
+    int64_t  batch_time;
+    uint32_t batch_count;
+    uint32_t batch_events[MAX_BATCH_EVENTS];
+} Pipeline;
+
+// ——— Logger thread ———
+static void* logger_thread_fn(void* arg) {
+    Pipeline* pl = arg;
+    place_current_thread(THREAD_ROLE_LOGGER);
+    while (!atomic_load(&pl->done_dispatch)) {
+        uint64_t start_nps = pl->note_on_cnt;
+        uint64_t start_evs = pl->event_count;
+        uint64_t start_pes = pl->parsed_event_count;
+        // Real time, also when the player runs on the virtual clock; in
+        // slices so play_midi_buffered does not wait long for the join
+        for (int i = 0; i < 10 * LOG_INTERVAL_SEC && !atomic_load(&pl->done_dispatch); i++) {
+            usleep(100000);
+        }
+        uint64_t end_nps = pl->note_on_cnt;
+        uint64_t end_evs = pl->event_count;
+        uint64_t end_pes = pl->parsed_event_count;
+        printf("mplayer: Notes/sec: %llu | Events/sec: %llu | Parsed/sec: %llu\n",
+            (unsigned long long)(end_nps - start_nps),
+            (unsigned long long)(end_evs - start_evs),
+            (unsigned long long)(end_pes - start_pes));
+    }
+    return NULL;
+}
+
+// Waiting on the other end of the ring: spin briefly, then sleep on the real
+// clock. A realtime thread must not starve its peer when both share a CPU,
+// and the virtual clock must not move while nothing plays.
+static inline void wait_for_peer(unsigned* spins) {
+    if (++*spins < SPIN_LIMIT) _mm_pause();
+    else usleep(50);
+}
+
+// ——— Batch primitives (parser side) ———
+static inline void ring_write(uint32_t* ring, size_t ring_words, size_t at, const uint32_t* words, size_t count) {
+    size_t start = at & (ring_words - 1);
+    size_t first = count < ring_words - start ? count : ring_words - start;
+    memcpy(&ring[start], words, first * sizeof(uint32_t));
+    memcpy(ring, words + first, (count - first) * sizeof(uint32_t));
+}
+
+// Waits for room and publishes the pending batch; false if playback was
+// stopped meanwhile
+static bool publish_batch(Pipeline* pl, PlaybackControl* control) {
+    if (pl->batch_count == 0) return true;
+    size_t words = BATCH_HEADER_WORDS + pl->batch_count;
+    size_t tail = atomic_load_explicit(&pl->ring_tail, memory_order_relaxed);
+    unsigned spins = 0;
+    while (tail + words - atomic_load_explicit(&pl->ring_head, memory_order_acquire) > RING_WORDS) {
+        if (control && playback_control_stopped(control)) return false;
+        wait_for_peer(&spins);
+    }
+
+    const uint32_t header[BATCH_HEADER_WORDS] = {
+        (uint32_t)pl->batch_time, (uint32_t)((uint64_t)pl->batch_time >> 32), pl->batch_count
+    };
+    ring_write(pl->ring, RING_WORDS, tail, header, BATCH_HEADER_WORDS);
+    ring_write(pl->ring, RING_WORDS, tail + BATCH_HEADER_WORDS, pl->batch_events, pl->batch_count);
+    atomic_store_explicit(&pl->ring_tail, tail + words, memory_order_release);
+
+    pl->parsed_event_count += pl->batch_count;
+    pl->batch_count = 0;
+    return true;
+}
+
+// Adds to the pending batch, publishing it first once the time moves on
+static bool push_event(Pipeline* pl, int64_t due_time_100ns, uint32_t message, PlaybackControl* control) {
+    if (pl->batch_count && (due_time_100ns != pl->batch_time || pl->batch_count == MAX_BATCH_EVENTS)) {
+        if (!publish_batch(pl, control)) return false;
+    }
+    pl->batch_time = due_time_100ns;
+    pl->batch_events[pl->batch_count++] = message;
+    return true;
+}
+
+// The coalescer flushes through a plain sink, so the parser thread hands
+// its pipeline, batch time and control over here
+static _Thread_local Pipeline*        coalesce_pipeline = NULL;
+static _Thread_local int64_t          coalesce_due_time = 0;
+static _Thread_local PlaybackControl* coalesce_control  = NULL;
+
+static void enqueue_coalesced(uint32_t message) {
+    push_event(coalesce_pipeline, coalesce_due_time, message, coalesce_control);
+}
+
+// ——— Shard threads ———
+// With several parser threads, each decodes a contiguous range of tracks
+// into a queue of its own, and the merge thread puts the shards back
+// together for the pipeline. Shard batches look like the pipeline's but
+// carry the tick instead of the time: the tempo track usually belongs to
+// another shard, so only the merge knows the time. Tempo changes travel in
+// the batches as SHARD_TEMPO words, the tempo in the upper 24 bits.
+typedef struct {
+    uint32_t*       ring;
+    _Atomic size_t  ring_head;    // merge side
+    _Atomic size_t  ring_tail;    // shard side
+    atomic_bool     done;
+    int             first_track;
+    int             track_count;
+
+    // Shard only: the batch being filled, every event at batch_tick. It
+    // may stay empty: the merge steps song time at every tick the parser
+    // would, so the rounding comes out the same.
+    bool     batch_open;
+    uint64_t batch_tick;
+    uint32_t batch_count;
+    uint32_t batch_events[MAX_BATCH_EVENTS];
+} Shard;
+
+static bool shard_publish(Shard* sh, PlaybackControl* control) {
+    if (!sh->batch_open) return true;
+    size_t words = BATCH_HEADER_WORDS + sh->batch_count;
+    size_t tail = atomic_load_explicit(&sh->ring_tail, memory_order_relaxed);
+    unsigned spins = 0;
+    while (tail + words - atomic_load_explicit(&sh->ring_head, memory_order_acquire) > SHARD_RING_WORDS) {
+        if (control && playback_control_stopped(control)) return false;
+        wait_for_peer(&spins);
+    }
+
+    const uint32_t header[BATCH_HEADER_WORDS] = {
+        (uint32_t)sh->batch_tick, (uint32_t)(sh->batch_tick >> 32), sh->batch_count
+    };
+    ring_write(sh->ring, SHARD_RING_WORDS, tail, header, BATCH_HEADER_WORDS);
+    ring_write(sh->ring, SHARD_RING_WORDS, tail + BATCH_HEADER_WORDS, sh->batch_events, sh->batch_count);
+    atomic_store_explicit(&sh->ring_tail, tail + words, memory_order_release);
+    sh->batch_open = false;
+    sh->batch_count = 0;
+    return true;
+}
+
+// Opens the batch for tick, publishing the previous one first
+static bool shard_at(Shard* sh, uint64_t tick, PlaybackControl* control) {
+    if (sh->batch_open && tick == sh->batch_tick && sh->batch_count < MAX_BATCH_EVENTS) return true;
+    if (!shard_publish(sh, control)) return false;
+    sh->batch_open = true;
+    sh->batch_tick = tick;
+    return true;
+}
+
+static inline bool shard_push(Shard* sh, uint64_t tick, uint32_t word, PlaybackControl* control) {
+    if (!shard_at(sh, tick, control)) return false;
+    sh->batch_events[sh->batch_count++] = word;
+    return true;
+}
+
+// Splits the tracks into count ranges of about the same number of bytes
+static void shard_tracks(Shard* shards, int count, const TrackData* tracks, int track_count) {
+    uint64_t total = 0;
+    for (int i = 0; i < track_count; i++) total += tracks[i].data_capacity;
+    int track = 0;
+    uint64_t assigned = 0;
+    for (int s = 0; s < count; s++) {
+        shards[s].first_track = track;
+        uint64_t target = total * (s + 1) / count;
+        // Leave at least one track for each shard still to come
+        while (track < track_count - (count - s - 1) &&
+               (track == shards[s].first_track || assigned + tracks[track].data_capacity / 2 < target)) {
+            assigned += tracks[track++].data_capacity;
+        }
+        if (s == count - 1) track = track_count;
+        shards[s].track_count = track - shards[s].first_track;
+    }
+}
+
+struct ShardArgs {
+    Shard* shard; Pipeline* pipeline; TrackData* tracks; uint16_t time_div;
+    const PlaybackOptions* options; const Transform* transform; PlaybackControl* control;
+    uint64_t tick;
+};
+static void* shard_thread_fn(void* arg) {
+    struct ShardArgs* sa = arg;
+    Shard* sh = sa->shard;
+    place_current_thread(THREAD_ROLE_PARSER);
+    TrackData* tracks = sa->tracks + sh->first_track;
+    int min_velocity = sa->options->min_velocity;
+    const Transform* transform = sa->transform;
+    uint64_t tick = sa->tick;
+    // The shard's own view of the tempo is never used, the merge keeps it
+    double multiplier = 1.0;
+    uint64_t bpm = 500000;
+
+    TrackSchedule schedule;
+    bool scheduled = track_schedule_init(&schedule, tracks, sh->track_count);
+
+    while (scheduled) {
+        if (sa->control && playback_control_stopped(sa->control)) break;
+        int slot = track_schedule_earliest(&schedule);
+        if (slot < 0) break;
+        int best = schedule.tracks[slot];
+        if (schedule.ticks[slot] > tick) tick = schedule.ticks[slot];
+
+        MidiStream* loading = sa->options->loading;
+        if (loading && tick >= midi_stream_loaded_tick(loading)) {
+            int64_t waited = 0;
+            bool loaded = wait_for_load(loading, tick, sa->control, &waited);
+            // Shards waiting at the same time add up here; the dispatcher
+            // never moves on by more than it is late
+            atomic_fetch_add_explicit(&sa->pipeline->load_waited_100ns, waited, memory_order_relaxed);
+            if (!loaded) break;
+        }
+
+        if (!shard_at(sh, tick, sa->control)) break;
+        TrackData* t = &tracks[best];
+        while (t->data && t->tick == tick) {
+            update_command(t);
+            update_message(t);
+            uint32_t msg = t->message;
+            uint8_t st = msg & 0xFF;
+            if (st < 0xF0) {
+                if (transform) {
+                    msg = transform_apply(transform, sh->first_track + best, msg);
+                    if (!msg) goto SKIP;
+                } else if (st >= 0x90 && st <= 0x9F) {
+                    uint8_t vel = (msg >> 16) & 0xFF;
+                    if (min_velocity >= 0 && vel <= min_velocity) goto SKIP;
+                }
+                if (!shard_push(sh, tick, msg, sa->control)) goto DONE;
+            } else if (st == 0xFF) {
+                process_meta_event(t, &multiplier, &bpm, sa->time_div);
+                if (((t->message >> 8) & 0xFF) == 0x51 && t->long_msg_len >= 3 &&
+                    !shard_push(sh, tick, (uint32_t)bpm << 8 | SHARD_TEMPO, sa->control)) goto DONE;
+            }
+        SKIP:
+            if (t->data) update_tick(t);
+        }
+
+        if (t->data) schedule.ticks[slot] = t->tick;
+        else track_schedule_remove(&schedule, slot);
+    }
+DONE:
+    track_schedule_free(&schedule);
+    shard_publish(sh, sa->control);
+    atomic_store_explicit(&sh->done, true, memory_order_release);
+    return NULL;
+}
+
+// ——— Parser thread ———
+// tick, multiplier, bpm and start_100ns carry over from the chase to the
+// seek position
+struct ParserArgs {
+    Pipeline* pipeline; TrackData* tracks; int track_count; uint16_t time_div;
+    const PlaybackOptions* options; const Transform* transform; PlaybackControl* control;
+    uint64_t tick; double multiplier; uint64_t bpm; int64_t start_100ns;
+    Shard* shards; int shard_count;   // merge_thread_fn only
+};
+static void* parser_thread_fn(void* arg) {
+    struct ParserArgs* pa = arg;
+    Pipeline* pl = pa->pipeline;
+    place_current_thread(THREAD_ROLE_PARSER);
+    TrackData* tracks = pa->tracks;
+    uint16_t time_div = pa->time_div;
+    int min_velocity = pa->options->min_velocity;
+    const Transform* transform = pa->transform;
+
+    Coalescer coalescer_state;
+    Coalescer* coalescer = NULL;
+    int64_t batch_age = 0;
+    if (pa->options->coalesce && coalescer_init(&coalescer_state, COALESCE_CAPACITY)) {
+        coalescer = &coalescer_state;
+        coalesce_pipeline = pl;
+        coalesce_control = pa->control;
+    }
+
+    uint64_t tick = pa->tick;
+    int64_t last_time = pa->start_100ns;
+    double multiplier = pa->multiplier;
+    uint64_t bpm = pa->bpm;
+
+    // Picking the next track reads only the schedule's packed ticks
+    TrackSchedule schedule;
+    bool scheduled = track_schedule_init(&schedule, tracks, pa->track_count);
+
+    while (scheduled) {
+        if (pa->control && playback_control_stopped(pa->control)) break;
+        int slot = track_schedule_earliest(&schedule);
+        if (slot < 0) break;
+        int best = schedule.tracks[slot];
+        uint64_t best_delta = schedule.ticks[slot] > tick
+                              ? schedule.ticks[slot] - tick
+                              : 0;
+
+        MidiStream* loading = pa->options->loading;
+        if (loading && tick + best_delta >= midi_stream_loaded_tick(loading)) {
+            int64_t waited = 0;
+            bool loaded = wait_for_load(loading, tick + best_delta, pa->control, &waited);
+            atomic_fetch_add_explicit(&pl->load_waited_100ns, waited, memory_order_relaxed);
+            if (!loaded) break;
+        }
+
+        // Events of a batch are stamped with the time of its last tick
+        if (coalescer && best_delta > 0) {
+            batch_age += (int64_t)(best_delta * multiplier);
+            if (batch_age >= pa->options->coalesce_window_100ns) {
+                coalesce_due_time = last_time;
+                coalescer_flush(coalescer, enqueue_coalesced);
+                batch_age = 0;
+            }
+        }
+
+        tick += best_delta;
+        last_time += (int64_t)(best_delta * multiplier);
+        TrackData* t = &tracks[best];
+
+        while (t->data && t->tick == tick) {
+            update_command(t);
+            update_message(t);
+            uint32_t msg = t->message;
+            uint8_t st = msg & 0xFF;
+            if (st < 0xF0) {
+                if (transform) {
+                    // Remapped, transposed or muted in a fixed number of lookups
+                    msg = transform_apply(transform, best, msg);
+                    if (!msg) goto SKIP;
+                } else if (st >= 0x90 && st <= 0x9F) {
+                    uint8_t vel = (msg >> 16) & 0xFF;
+                    if (min_velocity >= 0 && vel <= min_velocity) goto SKIP;
+                }
+                if (coalescer) {
+                    coalesce_due_time = last_time;
+                    coalescer_push(coalescer, msg, enqueue_coalesced);
+                } else if (!push_event(pl, last_time, msg, pa->control)) {
+                    goto DONE;
+                }
+            } else if (st == 0xFF) {
+                process_meta_event(t, &multiplier, &bpm, time_div);
+            }
+        SKIP:
+            if (t->data) update_tick(t);
+        }
+
+        if (t->data) schedule.ticks[slot] = t->tick;
+        else track_schedule_remove(&schedule, slot);
+    }
+DONE:
+    track_schedule_free(&schedule);
+    if (coalescer) {
+        coalesce_due_time = last_time;
+        coalescer_flush(coalescer, enqueue_coalesced);
+        printf("mplayer: Coalesced %llu superseded messages\n",
+               (unsigned long long)coalescer->dropped);
+        coalescer_free(coalescer);
+    }
+    publish_batch(pl, pa->control);
+    atomic_store_explicit(&pl->done_parsing, true, memory_order_release);
+    return NULL;
+}
+
+// ——— Merge thread ———
+// Stands in for the parser thread when the tracks are sharded. The next
+// batch is the one with the lowest tick, the lowest shard on a tie, which
+// keeps the parser's order: by tick, then by track. So it needs the next
+// batch of every shard that is not done yet before it can pick.
+static void* merge_thread_fn(void* arg) {
+    struct ParserArgs* pa = arg;
+    Pipeline* pl = pa->pipeline;
+    place_current_thread(THREAD_ROLE_PARSER);
+
+    Coalescer coalescer_state;
+    Coalescer* coalescer = NULL;
+    int64_t batch_age = 0;
+    if (pa->options->coalesce && coalescer_init(&coalescer_state, COALESCE_CAPACITY)) {
+        coalescer = &coalescer_state;
+        coalesce_pipeline = pl;
+        coalesce_control = pa->control;
+    }
+
+    uint64_t tick = pa->tick;
+    int64_t last_time = pa->start_100ns;
+    double multiplier = pa->multiplier;
+
+    // Per shard: read position and the tick of the batch there, once known
+    size_t heads[MAX_SHARDS] = { 0 };
+    uint64_t next_tick[MAX_SHARDS];
+    bool ready[MAX_SHARDS] = { false };
+    bool finished[MAX_SHARDS] = { false };
+
+    while (1) {
+        int best = -1;
+        for (int s = 0; s < pa->shard_count; s++) {
+            if (finished[s]) continue;
+            Shard* sh = &pa->shards[s];
+            if (!ready[s]) {
+                unsigned spins = 0;
+                while (atomic_load_explicit(&sh->ring_tail, memory_order_acquire) == heads[s]) {
+                    if (atomic_load_explicit(&sh->done, memory_order_acquire) &&
+                        atomic_load_explicit(&sh->ring_tail, memory_order_acquire) == heads[s]) break;
+                    if (pa->control && playback_control_stopped(pa->control)) goto DONE;
+                    wait_for_peer(&spins);
+                }
+                if (atomic_load_explicit(&sh->ring_tail, memory_order_acquire) == heads[s]) {
+                    finished[s] = true;
+                    continue;
+                }
+                next_tick[s] = (uint64_t)sh->ring[heads[s] & SHARD_RING_MASK] |
+                               (uint64_t)sh->ring[(heads[s] + 1) & SHARD_RING_MASK] << 32;
+                ready[s] = true;
+            }
+            if (best < 0 || next_tick[s] < next_tick[best]) best = s;
+        }
+        if (best < 0) break;
+
+        Shard* sh = &pa->shards[best];
+        uint64_t delta = next_tick[best] > tick ? next_tick[best] - tick : 0;
+        if (coalescer && delta > 0) {
+            batch_age += (int64_t)(delta * multiplier);
+            if (batch_age >= pa->options->coalesce_window_100ns) {
+                coalesce_due_time = last_time;
+                coalescer_flush(coalescer, enqueue_coalesced);
+                batch_age = 0;
+            }
+        }
+        tick += delta;
+        last_time += (int64_t)(delta * multiplier);
+
+        size_t at = heads[best] + BATCH_HEADER_WORDS;
+        uint32_t count = sh->ring[(heads[best] + 2) & SHARD_RING_MASK];
+        for (uint32_t i = 0; i < count; i++) {
+            uint32_t word = sh->ring[(at + i) & SHARD_RING_MASK];
+            if ((word & 0xFF) == SHARD_TEMPO) {
+                multiplier = tempo_multiplier(word >> 8, pa->time_div);
+            } else if (coalescer) {
+                coalesce_due_time = last_time;
+                coalescer_push(coalescer, word, enqueue_coalesced);
+            } else if (!push_event(pl, last_time, word, pa->control)) {
+                goto DONE;
+            }
+        }
+        heads[best] = at + count;
+        atomic_store_explicit(&sh->ring_head, heads[best], memory_order_release);
+        ready[best] = false;
+    }
+DONE:
+    if (coalescer) {
+        coalesce_due_time = last_time;
+        coalescer_flush(coalescer, enqueue_coalesced);
+        printf("mplayer: Coalesced %llu superseded messages\n",
+               (unsigned long long)coalescer->dropped);
+        coalescer_free(coalescer);
+    }
+    publish_batch(pl, pa->control);
+    atomic_store_explicit(&pl->done_parsing, true, memory_order_release);
+    return NULL;
+}
+
+// ——— Dispatcher thread ———
+struct DispatcherArgs {
+    Pipeline* pipeline; SendDirectDataFunc SendDirectData; const PlaybackOptions* options;
+    PlaybackControl* control; int64_t start_100ns;
+};
+
+// Instantiated per sink below, so the send is a direct call
+static inline __attribute__((always_inline))
+void dispatch_core(struct DispatcherArgs* da, SendDirectDataFunc SendDirectData) {
+    Pipeline* pl = da->pipeline;
+    PlaybackControl* ctl = da->control;
+    uint32_t* ring = pl->ring;
+
+    // Song time base_song plays at wall time base_wall; rebased on speed changes
+    int64_t base_wall = getTime100ns();
+    int64_t base_song = da->start_100ns;
+    double speed = 1.0;
+    // The virtual clock only moves on delays, spinning would never get there
+    const bool spin = !virtual_clock_enabled();
+    // A prepared playback may have waited before the dispatcher started
+    int64_t load_waited = atomic_load_explicit(&pl->load_waited_100ns, memory_order_relaxed);
+    bool first_note_pending = ctl != NULL;
+    OverloadGuard guard;
+    overload_init(&guard, da->options->overload, da->options->overload_threshold_100ns
+                                                 ? da->options->overload_threshold_100ns
+                                                 : OVERLOAD_DEFAULT_THRESHOLD_100NS);
+
+    if (da->options->bind_sink_thread) {
+        da->options->bind_sink_thread(da->options->sink_context);
+    }
+
+    // CPUs and realtime priority (--pin-playback, --realtime)
+    place_current_thread(THREAD_ROLE_PLAYBACK);
+
+    while (1) {
+        size_t head = atomic_load_explicit(&pl->ring_head, memory_order_relaxed);
+        unsigned spins = 0;
+        while (atomic_load_explicit(&pl->ring_tail, memory_order_acquire) == head) {
+            // The last batch is published before done_parsing is set
+            if (atomic_load_explicit(&pl->done_parsing, memory_order_acquire) &&
+                atomic_load_explicit(&pl->ring_tail, memory_order_acquire) == head) goto STOPPED;
+            if (ctl && playback_control_stopped(ctl)) goto STOPPED;
+            wait_for_peer(&spins);
+        }
+        if (ctl && playback_control_stopped(ctl)) break;
+
+        int64_t due_time_100ns = (int64_t)((uint64_t)ring[head & RING_MASK] |
+                                           (uint64_t)ring[(head + 1) & RING_MASK] << 32);
+        uint32_t count = ring[(head + 2) & RING_MASK];
+
+        // The ring ran dry while the parser waited for the file to load:
+        // carry on from here rather than rush through what is late
+        if (spins > 0) {
+            int64_t waited = atomic_load_explicit(&pl->load_waited_100ns, memory_order_relaxed);
+            if (waited != load_waited) {
+                int64_t late = getTime100ns() - base_wall - (int64_t)((due_time_100ns - base_song) / speed);
+                int64_t skip = waited - load_waited;
+                if (late > 0) base_wall += late < skip ? late : skip;
+                load_waited = waited;
+            }
+        }
+
+        // Timing control: hybrid delay and spin
+        int64_t overdue = 0;
+        while (1) {
+            int64_t now = getTime100ns();
+            if (ctl) {
+                if (playback_control_stopped(ctl)) goto STOPPED;
+                if (playback_control_paused(ctl)) {
+                    all_notes_off(SendDirectData);
+                    while (playback_control_paused(ctl) && !playback_control_stopped(ctl))
+                        delayExecution100Ns(CONTROL_SLICE_100NS);
+                    base_wall += getTime100ns() - now;
+                    continue;
+                }
+                double requested = playback_control_speed(ctl);
+                if (requested != speed) {
+                    base_song += (int64_t)((now - base_wall) * speed);
+                    base_wall = now;
+                    speed = requested;
+                }
+            }
+            int64_t until = base_wall + (int64_t)((due_time_100ns - base_song) / speed) - now;
+            if (until <= 0) {
+                overdue = -until;
+                break;
+            }
+            else if (until > BUSY_WAIT_THRESHOLD_100NS || !spin) {
+                int64_t sleep = spin ? until - BUSY_WAIT_THRESHOLD_100NS : until;
+                if (ctl && sleep > CONTROL_SLICE_100NS) sleep = CONTROL_SLICE_100NS;
+                delayExecution100Ns(sleep);
+            }
+            else
+                _mm_pause();
+        }
+
+        // Overdue batches shed note-ons under an overload policy, rather
+        // than going out late in a burst
+        if (guard.policy != OVERLOAD_OFF) {
+            overload_update(&guard, overdue, getTime100ns());
+        }
+
+        // Playback: the whole batch is due, send it straight from the ring
+        size_t at = head + BATCH_HEADER_WORDS;
+        uint64_t note_ons = 0;
+        for (uint32_t i = 0; i < count; i++) {
+            uint32_t message = ring[(at + i) & RING_MASK];
+            if (guard.velocity_cut && overload_sheds(&guard, message)) continue;
+            SendDirectData(message);
+            // Accurate Note On counting (playback time)
+            note_ons += (message & 0xF0) == 0x90 && ((message >> 16) & 0xFF) > 0;
+        }
+        atomic_store_explicit(&pl->ring_head, at + count, memory_order_release);
+
+        pl->event_count += count;
+        pl->note_on_cnt += note_ons;
+        if (first_note_pending && note_ons) {
+            atomic_store_explicit(&ctl->first_note_100ns, getRealTime100ns(), memory_order_relaxed);
+            first_note_pending = false;
+        }
+        if (ctl) {
+            atomic_store_explicit(&ctl->position_100ns, due_time_100ns, memory_order_relaxed);
+        }
+    }
+
+STOPPED:
+    overload_report(&guard, getTime100ns());
+    atomic_store(&pl->done_dispatch, true);
+}
+
+static inline void drop_message(uint32_t message) {
+    (void)message;
+}
+
+#define DISPATCH_VARIANT(name, sink)                  \
+    static void* name(void* arg) {                    \
+        struct DispatcherArgs* da = arg;              \
+        dispatch_core(da, sink);                      \
+        return NULL;                                  \
+    }
+
+DISPATCH_VARIANT(dispatch_null,    drop_message)
+DISPATCH_VARIANT(dispatch_alsa,    alsa_send)
+DISPATCH_VARIANT(dispatch_capture, capture_send)
+DISPATCH_VARIANT(dispatch_shm,     shm_output_send)
+DISPATCH_VARIANT(dispatch_generic, da->SendDirectData)   // KDMAPI and anything else
+
+static void* (*select_dispatcher(SendDirectDataFunc SendDirectData))(void*) {
+    if (SendDirectData == midi_output_null) return dispatch_null;
+    if (SendDirectData == alsa_send)        return dispatch_alsa;
+    if (SendDirectData == capture_send)     return dispatch_capture;
+    if (SendDirectData == shm_output_send)  return dispatch_shm;
+    return dispatch_generic;
+}
+
+
+// ——— Setup, threads, teardown ———
+// PlaybackOptions.parser_threads, never more than one per track. One parser
+// unless asked for more: sharding pays off only on files with many dense
+// tracks and costs a merge thread and CPUs everywhere else
+static int parser_thread_count(const PlaybackOptions* options, int track_count) {
+    int count = options->parser_threads;
+    if (count > MAX_SHARDS) count = MAX_SHARDS;
+    if (count > track_count) count = track_count;
+    return count < 1 ? 1 : count;
+}
+
+// The parser side of one playback, in the arena with its ring. It can be
+// started ahead of the dispatcher, see buffered_prepare.
+struct BufferedPlayback {
+    Arena* arena;
+    Pipeline* pipeline;
+    Transform* transform;
+    PlaybackOptions options;     // the producers' copy
+    PlaybackControl producers;   // stops the parser and the shards
+    struct ParserArgs parser;
+    struct ShardArgs shard_args[MAX_SHARDS];
+    pthread_t parser_thread;
+    pthread_t shard_threads[MAX_SHARDS];
+    int shards_started;
+    bool parsing;
+};
+
+static BufferedPlayback* buffered_create(TrackData* tracks, int track_count, uint16_t time_div,
+                                         const PlaybackOptions* options) {
+    // From an arena, so the ring is prefaulted (and locked, on huge pages
+    // and on the playback thread's NUMA node) like the track data
+    int shard_count = parser_thread_count(options, track_count);
+    size_t shard_bytes = shard_count > 1 ? shard_count * (sizeof(Shard) + SHARD_RING_WORDS * sizeof(uint32_t) + 128) : 0;
+    Arena* arena = arena_create(sizeof(BufferedPlayback) + sizeof(Pipeline) + RING_WORDS * sizeof(uint32_t) + 192 + shard_bytes);
+    if (!arena) {
+        fprintf(stderr, "mplayer: Failed to allocate event buffer\n");
+        return NULL;
+    }
+    BufferedPlayback* bp = arena_alloc(arena, sizeof(BufferedPlayback), 64);
+    Pipeline* pl = arena_alloc(arena, sizeof(Pipeline), 64);
+    pl->ring = arena_alloc(arena, RING_WORDS * sizeof(uint32_t), 64);
+    Shard* shards = NULL;
+    if (shard_count > 1) {
+        shards = arena_alloc(arena, shard_count * sizeof(Shard), 64);
+        for (int s = 0; s < shard_count; s++) {
+            shards[s].ring = arena_alloc(arena, SHARD_RING_WORDS * sizeof(uint32_t), 64);
+        }
+        shard_tracks(shards, shard_count, tracks, track_count);
+    }
+    arena_finish(arena);
+
+    bp->arena = arena;
+    bp->pipeline = pl;
+    bp->options = *options;
+    playback_control_init(&bp->producers);
+    // Compiled per file, the track mutes depend on its track count
+    bp->transform = transform_compile(options->transform, options->min_velocity, track_count);
+    bp->parser = (struct ParserArgs){ pl, tracks, track_count, time_div, &bp->options, bp->transform,
+                                      &bp->producers, 0, 500000.0 / time_div * 10.0, 500000, 0,
+                                      shards, shard_count };
+    bp->shards_started = 0;
+    bp->parsing = false;
+    return bp;
+}
+
+static void buffered_start_producers(BufferedPlayback* bp) {
+    struct ParserArgs* pa = &bp->parser;
+    Shard* shards = pa->shards;
+
+    // Sharded: one thread per shard, and the merge in the parser's place
+    for (; shards && bp->shards_started < pa->shard_count; bp->shards_started++) {
+        int s = bp->shards_started;
+        bp->shard_args[s] = (struct ShardArgs){ &shards[s], pa->pipeline, pa->tracks, pa->time_div,
+                                                pa->options, pa->transform, pa->control, pa->tick };
+        if (pthread_create(&bp->shard_threads[s], NULL, shard_thread_fn, &bp->shard_args[s]) != 0) break;
+    }
+    bp->parsing = (!shards || bp->shards_started == pa->shard_count) &&
+                  pthread_create(&bp->parser_thread, NULL, shards ? merge_thread_fn : parser_thread_fn, pa) == 0;
+    if (!bp->parsing) {
+        // Nothing publishes done_parsing now, so the dispatcher gets it here
+        fprintf(stderr, "mplayer: Failed to start the parser threads\n");
+        playback_control_stop(&bp->producers);
+        atomic_store(&pa->pipeline->done_parsing, true);
+    }
+}
+
+static void buffered_free(BufferedPlayback* bp) {
+    // Whatever is still decoding goes nowhere now
+    playback_control_stop(&bp->producers);
+    if (bp->parsing) {
+        pthread_join(bp->parser_thread, NULL);
+    }
+    for (int s = 0; s < bp->shards_started; s++) {
+        pthread_join(bp->shard_threads[s], NULL);
+    }
+    transform_free(bp->transform);
+    arena_destroy(bp->arena);
+}
+
+static void buffered_dispatch(BufferedPlayback* bp, SendDirectDataFunc SendDirectData,
+                              const PlaybackOptions* options, PlaybackControl* control) {
+    Pipeline* pl = bp->pipeline;
+    struct DispatcherArgs da = { pl, SendDirectData, options, control, bp->parser.start_100ns };
+
+    // The logger only reports, so playback goes on without it
+    pthread_t d, l;
+    bool logging = !options->quiet && pthread_create(&l, NULL, logger_thread_fn, pl) == 0;
+
+    if (pthread_create(&d, NULL, select_dispatcher(SendDirectData), &da) == 0) {
+        pthread_join(d, NULL);
+    } else {
+        fprintf(stderr, "mplayer: Failed to start the dispatcher thread\n");
+        atomic_store(&pl->done_dispatch, true);
+    }
+    if (logging) {
+        pthread_join(l, NULL);
+    }
+    buffered_free(bp);
+}
+
+BufferedPlayback* buffered_prepare(TrackData* tracks, int track_count, uint16_t time_div,
+                                   const PlaybackOptions* options) {
+    BufferedPlayback* bp = buffered_create(tracks, track_count, time_div, options);
+    if (bp) {
+        buffered_start_producers(bp);
+    }
+    return bp;
+}
+
+void play_midi_buffered_prepared(BufferedPlayback* prepared, SendDirectDataFunc SendDirectData,
+                                 const PlaybackOptions* options, PlaybackControl* control) {
+    buffered_dispatch(prepared, SendDirectData, options, control);
+}
+
+void buffered_discard(BufferedPlayback* prepared) {
+    if (prepared) buffered_free(prepared);
+}
+
+void play_midi_buffered(TrackData* tracks, int track_count, uint16_t time_div,
+                        SendDirectDataFunc SendDirectData, const PlaybackOptions* options,
+                        PlaybackControl* control) {
+    BufferedPlayback* bp = buffered_create(tracks, track_count, time_div, options);
+    if (!bp) return;
+    struct ParserArgs* pa = &bp->parser;
+
+    // Controllers up to the seek position go out before the threads start
+    if (control) {
+        int64_t seek = atomic_load_explicit(&control->seek_100ns, memory_order_relaxed);
+        // The chase runs through the whole file, so it waits for all of it
+        int64_t waited = 0;
+        if (seek > 0 && (!options->loading ||
+                         wait_for_load(options->loading, UINT64_MAX - 1, control, &waited))) {
+            pa->tick = chase_to(tracks, track_count, time_div, SendDirectData, NULL, bp->transform, seek,
+                                &pa->multiplier, &pa->bpm, &pa->start_100ns);
+        }
+    }
+
+    buffered_start_producers(bp);
+    buffered_dispatch(bp, SendDirectData, options, control);
+}
@@ -1,124 +1,468 @@
 #include <stdio.h>
+#include <string.h>
 #include <pthread.h>
 
 #include "midi-player.h"
+#include "playback-engines.h"
+#include "midi-output.h"
+#include "alsa_output.h"
+#include "capture.h"
+#include "shm-output.h"
+#include "coalescer.h"
 #include "stats_logger.h"
+#include "thread-placement.h"
+#include "track-schedule.h"
+
+// Messages held back per coalescing batch before it is flushed early
+#define COALESCE_CAPACITY 65536
+
+void all_notes_off(SendDirectDataFunc SendDirectData) {
+    for (uint32_t channel = 0; channel < 16; channel++) {
+        SendDirectData((0xB0 | channel) | (64 << 8));   // Sustain off
+        SendDirectData((0xB0 | channel) | (123 << 8));  // All notes off
+    }
+}
+
+// Sends through the coalescer when coalescing is enabled
+static inline void emit(Coalescer* coalescer, SendDirectDataFunc SendDirectData, uint32_t message) {
+    if (coalescer) {
+        coalescer_push(coalescer, message, SendDirectData);
+    } else {
+        SendDirectData(message);
+    }
+}
+
+uint64_t chase_to(TrackData* tracks, int track_count, uint16_t time_div,
+                  SendDirectDataFunc SendDirectData, Coalescer* coalescer,
+                  const Transform* transform, int64_t target_100ns,
+                  double* multiplier, uint64_t* bpm, int64_t* elapsed_100ns) {
+    uint64_t tick = 0;
+    int64_t elapsed = 0;
+
+    TrackSchedule schedule;
+    if (!track_schedule_init(&schedule, tracks, track_count)) {
+        *elapsed_100ns = 0;
+        return 0;
+    }
+
+    while (true) {
+        int earliest = track_schedule_earliest(&schedule);
+        if (earliest < 0) break;
+        uint64_t next_tick = schedule.ticks[earliest];
+
+        int64_t next_elapsed = elapsed + (int64_t)((next_tick - tick) * *multiplier);
+        if (next_elapsed >= target_100ns) break;
+        elapsed = next_elapsed;
+        tick = next_tick;
+
+        int kept = 0;
+        for (int slot = 0; slot < schedule.count; slot++) {
+            int i = schedule.tracks[slot];
+            while (tracks[i].data != NULL && tracks[i].tick <= tick) {
+                update_command(&tracks[i]);
+                update_message(&tracks[i]);
+
+                uint32_t message = tracks[i].message;
+                uint8_t msg_type = message & 0xFF;
+                if (msg_type >= 0xA0 && msg_type < 0xF0) {
+                    if (transform) message = transform_apply(transform, i, message);
+                    if (message) emit(coalescer, SendDirectData, message);
+                } else if (msg_type == 0xFF) {
+                    process_meta_event(&tracks[i], multiplier, bpm, time_div);
+                }
+
+                if (tracks[i].data != NULL) {
+                    update_tick(&tracks[i]);
+                }
+            }
+            if (tracks[i].data == NULL) continue;
+            schedule.tracks[kept] = i;
+            schedule.ticks[kept] = tracks[i].tick;
+            kept++;
+        }
+        schedule.count = kept;
+    }
+    track_schedule_free(&schedule);
+
+    // Without notes in between, only the last state of each controller is sent
+    if (coalescer) {
+        coalescer_flush(coalescer, SendDirectData);
+    }
+
+    *elapsed_100ns = elapsed;
+    return tick;
+}
+
+// Releases all notes and sleeps until the pause is lifted or playback stops.
+// Returns how long playback was held so timing can skip over it.
+static int64_t hold_while_paused(PlaybackControl* control, SendDirectDataFunc SendDirectData) {
+    int64_t start = getTime100ns();
+    all_notes_off(SendDirectData);
+    while (playback_control_paused(control) && !playback_control_stopped(control)) {
+        delayExecution100Ns(CONTROL_SLICE_100NS);
+    }
+    return getTime100ns() - start;
+}
+
+// delayExecution100Ns in short slices, so stop and pause requests are noticed
+// during long rests. Time spent paused is added to *held.
+static void controlled_delay(PlaybackControl* control, SendDirectDataFunc SendDirectData,
+                             int64_t delay, int64_t* held) {
+    while (delay > 0 && !playback_control_stopped(control)) {
+        if (playback_control_paused(control)) {
+            *held += hold_while_paused(control, SendDirectData);
+            continue;
+        }
+        int64_t slice = delay < CONTROL_SLICE_100NS ? delay : CONTROL_SLICE_100NS;
+        delayExecution100Ns(slice);
+        delay -= slice;
+    }
+}
+
+bool wait_for_load(MidiStream* stream, uint64_t tick, PlaybackControl* control, int64_t* held) {
+    int64_t start = getTime100ns();
+    bool loaded;
+    while (!(loaded = midi_stream_wait(stream, tick, CONTROL_SLICE_100NS))) {
+        if (control && playback_control_stopped(control)) break;
+    }
+    *held += getTime100ns() - start;
+    return loaded;
+}
+
+// How a variant decides which channel messages go out
+typedef enum {
+    FILTER_NONE,       // all of them
+    FILTER_VELOCITY,   // all but note-ons at or below min_velocity
+    FILTER_TRANSFORM,  // through the compiled transform tables, which hold min_velocity too
+} EventFilter;
+
+// The playback loop, written once and instantiated below for each sink and
+// filter combination. SendDirectData, filter and stats are compile-time
+// constants in every instantiation, so the compiler can call (or inline)
+// the sink directly and drop the branches that are switched off.
+static inline __attribute__((always_inline))
+void play_core(TrackData* tracks, int track_count, uint16_t time_div, SendDirectDataFunc SendDirectData,
+               const PlaybackOptions* options, const Transform* transform, PlaybackControl* control,
+               const EventFilter filter, const bool stats) {
+    int min_velocity = options->min_velocity;
+    // CPUs and realtime priority (--pin-playback, --realtime)
+    place_current_thread(THREAD_ROLE_PLAYBACK);
 
-void play_midi(TrackData* tracks, int track_count, uint16_t time_div, SendDirectDataFunc SendDirectData, int min_velocity) {
     uint64_t tick = 0;
-    double multiplier = 0;
     uint64_t bpm = 500000; // Default tempo: 120 BPM
+    double multiplier = (double)(bpm * 10) / (double)time_div;
     uint64_t delta_tick = 0;
     uint64_t last_time = 0;
     const uint64_t max_drift = 100000;
     int64_t delta = 0;
     uint64_t old = 0;
     int64_t temp = 0;
+    double speed = 1.0;
+    int64_t held = 0;
 
     uint64_t note_on_count = 0;
     bool is_playing = true;
+    bool first_note_pending = control != NULL;
+    MidiStream* loading = options->loading;
+
+    OverloadGuard guard;
+    overload_init(&guard, options->overload, options->overload_threshold_100ns
+                                             ? options->overload_threshold_100ns
+                                             : OVERLOAD_DEFAULT_THRESHOLD_100NS);
+
+    Coalescer coalescer_state;
+    Coalescer* coalescer = NULL;
+    int64_t batch_age = 0;
+    if (options->coalesce) {
+        if (coalescer_init(&coalescer_state, COALESCE_CAPACITY)) {
+            coalescer = &coalescer_state;
+        } else {
+            fprintf(stderr, "mplayer: Not enough memory to coalesce, sending everything\n");
+        }
+    }
+
+    int64_t position = 0;
+    if (control) {
+        int64_t seek = atomic_load_explicit(&control->seek_100ns, memory_order_relaxed);
+        // The chase runs through the whole file, so it waits for all of it;
+        // the clock only starts after it
+        int64_t waited = 0;
+        if (seek > 0 && (!loading || wait_for_load(loading, UINT64_MAX - 1, control, &waited))) {
+            tick = chase_to(tracks, track_count, time_div, SendDirectData, coalescer, transform,
+                            seek, &multiplier, &bpm, &position);
+        }
+    }
 
     uint64_t now = getTime100ns();
     last_time = now;
 
     // Setup and start logger thread
-    StatsLogger*   logger       = stats_logger_create(144);
+    StatsLogger*   logger       = NULL;
     pthread_t      logger_thread;
-    FrameLoggerArgs logger_args = { .lg = logger, .is_playing = &is_playing };
+    FrameLoggerArgs logger_args = { .lg = NULL, .is_playing = &is_playing };
 
-    pthread_create(&logger_thread, NULL, log_notes_per_second, &logger_args);
+    if (stats) {
+        logger = stats_logger_create(144);
+        logger_args.lg = logger;
+        pthread_create(&logger_thread, NULL, log_notes_per_second, &logger_args);
+    }
 
-    bool has_active_tracks = true;
+    // Built after the chase, which may already have finished some tracks
+    TrackSchedule schedule;
+    bool scheduled = track_schedule_init(&schedule, tracks, track_count);
 
-    while (true) {
-        // Check if there are any active tracks
-        has_active_tracks = false;
-        int active_track_count = 0;
-        int* active_tracks = malloc(track_count * sizeof(int));
-
-        for (int i = 0; i < track_count; i++) {
-            if (tracks[i].data != NULL) {
-                if (tracks[i].tick <= tick) {
-                    // Process events in this track
-                    while (tracks[i].data != NULL && tracks[i].tick <= tick) {
-                        update_command(&tracks[i]);
-                        update_message(&tracks[i]);
-
-                        uint32_t message = tracks[i].message;
-                        uint8_t msg_type = message & 0xFF;
-                        if (msg_type < 0xF0) {
-                            // Check if it's a note-on message
-                            if (msg_type >= 0x90 && msg_type <= 0x9F) {
-                                uint8_t velocity = (message >> 16) & 0xFF;
-                                // note_on_count++;
+    while (scheduled) {
+        // Reads of the next deltas stay within what is loaded too, see midi.h
+        if (loading && tick >= midi_stream_loaded_tick(loading) &&
+            !wait_for_load(loading, tick, control, &held)) break;
+
+        // One pass over the schedule: play the tracks that are due, drop the
+        // ones that finished and find the next tick. Tracks that are not due
+        // cost a look at their tick and nothing else.
+        uint64_t next_tick = UINT64_MAX;
+        int kept = 0;
+
+        for (int slot = 0; slot < schedule.count; slot++) {
+            int i = schedule.tracks[slot];
+            uint64_t track_tick = schedule.ticks[slot];
+
+            if (track_tick <= tick) {
+                // Process events in this track
+                while (tracks[i].data != NULL && tracks[i].tick <= tick) {
+                    update_command(&tracks[i]);
+                    update_message(&tracks[i]);
+
+                    uint32_t message = tracks[i].message;
+                    uint8_t msg_type = message & 0xFF;
+                    if (msg_type < 0xF0) {
+                        // Check if it's a note-on message
+                        if (msg_type >= 0x90 && msg_type <= 0x9F) {
+                            uint8_t velocity = (message >> 16) & 0xFF;
+                            // note_on_count++;
+                            if (stats) {
                                 stats_logger_increment(logger);
+                            }
 
-                                if (velocity > min_velocity) {
-                                    SendDirectData(message);
-                                }
-                            } else {
-                                // Pass through all other message types
-                                SendDirectData(message);
+                            if (filter == FILTER_TRANSFORM) {
+                                message = transform_apply(transform, i, message);
+                            } else if (filter != FILTER_NONE && velocity <= min_velocity) {
+                                message = 0;
                             }
+                            // Behind schedule: shed note-ons, see overload.h
+                            if (message && guard.velocity_cut && overload_sheds(&guard, message)) {
+                                message = 0;
+                            }
+                            if (message) emit(coalescer, SendDirectData, message);
+                            if (first_note_pending && (message >> 16 & 0xFF) > 0) {
+                                atomic_store_explicit(&control->first_note_100ns, getRealTime100ns(),
+                                                      memory_order_relaxed);
+                                first_note_pending = false;
+                            }
+                        } else if (filter == FILTER_TRANSFORM) {
+                            // Same lookups for every message, 0 when it is dropped
+                            message = transform_apply(transform, i, message);
+                            if (message) emit(coalescer, SendDirectData, message);
+                        } else {
+                            // Pass through all other message types
+                            emit(coalescer, SendDirectData, message);
                         }
-                        else if (msg_type == 0xFF) {
-                            process_meta_event(&tracks[i], &multiplier, &bpm, time_div);
-                        }
-                        else if (msg_type == 0xF0) {
+                    }
+                    else if (msg_type == 0xFF) {
+                        process_meta_event(&tracks[i], &multiplier, &bpm, time_div);
+                    }
+                    else if (msg_type == 0xF0) {
+                        if (options->SendLongData) {
+                            // SysEx bypasses the coalescer, so send what it holds first
+                            if (coalescer) coalescer_flush(coalescer, SendDirectData);
+                            tracks[i].long_msg[-1] = 0xF0;
+                            options->SendLongData(tracks[i].long_msg - 1, tracks[i].long_msg_len + 1);
+                        } else {
                             printf("mplayer: TODO: Handle SysEx\n");
                         }
-
-                        if (tracks[i].data != NULL) {
-                            update_tick(&tracks[i]);
-                        }
                     }
-                }
 
-                if (tracks[i].data != NULL) {
-                    active_tracks[active_track_count++] = i;
-                    has_active_tracks = true;
+                    if (tracks[i].data != NULL) {
+                        update_tick(&tracks[i]);
+                    }
                 }
+                if (tracks[i].data == NULL) continue;
+                track_tick = tracks[i].tick;
             }
+
+            schedule.tracks[kept] = i;
+            schedule.ticks[kept] = track_tick;
+            kept++;
+            if (track_tick < next_tick) next_tick = track_tick;
         }
+        schedule.count = kept;
 
-        if (!has_active_tracks) {
-            free(active_tracks);
+        if (kept == 0) {
             break;
         }
+        delta_tick = next_tick - tick;
 
-        // Find next tick
-        delta_tick = UINT64_MAX;
-        for (int i = 0; i < active_track_count; i++) {
-            int idx = active_tracks[i];
-            if (tracks[idx].data != NULL) {
-                uint64_t track_delta = tracks[idx].tick - tick;
-                if (track_delta < delta_tick) {
-                    delta_tick = track_delta;
-                }
+        // Keep collecting while the next tick is still inside the window
+        if (coalescer) {
+            batch_age += (int64_t)(delta_tick * multiplier);
+            if (batch_age >= options->coalesce_window_100ns) {
+                coalescer_flush(coalescer, SendDirectData);
+                batch_age = 0;
             }
         }
 
-        free(active_tracks);
+        if (control) {
+            if (playback_control_stopped(control)) break;
+            if (playback_control_paused(control)) {
+                if (coalescer) {
+                    coalescer_flush(coalescer, SendDirectData);
+                    batch_age = 0;
+                }
+                held += hold_while_paused(control, SendDirectData);
+            }
+            speed = playback_control_speed(control);
+            position += (int64_t)(delta_tick * multiplier);
+            atomic_store_explicit(&control->position_100ns, position, memory_order_relaxed);
+        }
 
         tick += delta_tick;
 
         now = getTime100ns();
-        temp = now - last_time;
+        temp = now - last_time - held;
         last_time = now;
+        held = 0;
         temp -= old;
-        old = delta_tick * multiplier;
+        old = delta_tick * multiplier / speed;
         delta += temp;
 
         temp = (delta > 0) ? (old - delta) : old;
 
+        // With an overload policy the lateness is kept, not clamped, so
+        // playback catches up with the song clock instead of drifting
+        if (guard.policy != OVERLOAD_OFF) {
+            overload_update(&guard, -temp, now);
+        }
+
         if (temp <= 0) {
-            delta = (delta < (int64_t)max_drift) ? delta : (int64_t)max_drift;
+            if (guard.policy == OVERLOAD_OFF) {
+                delta = (delta < (int64_t)max_drift) ? delta : (int64_t)max_drift;
+            }
+        } else if (control) {
+            controlled_delay(control, SendDirectData, temp, &held);
+            if (playback_control_stopped(control)) break;
         } else {
             delayExecution100Ns(temp);
         }
     }
+    track_schedule_free(&schedule);
+
+    if (coalescer) {
+        coalescer_flush(coalescer, SendDirectData);
+        printf("mplayer: Coalesced %llu superseded messages\n",
+               (unsigned long long)coalescer->dropped);
+        coalescer_free(coalescer);
+    }
+    overload_report(&guard, getTime100ns());
 
     is_playing = false;
-    pthread_join(logger_thread, NULL);
-    stats_logger_destroy(logger);
-}
\ No newline at end of file
+    if (stats) {
+        pthread_join(logger_thread, NULL);
+        stats_logger_destroy(logger);
+    }
+    release_current_thread();
+}
+
+// Stands in for midi_output_null so the null variant compiles to nothing
+static inline void drop_message(uint32_t message) {
+    (void)message;
+}
+
+typedef void (*PlayCore)(TrackData* tracks, int track_count, uint16_t time_div,
+                         SendDirectDataFunc SendDirectData, const PlaybackOptions* options,
+                         const Transform* transform, PlaybackControl* control);
+
+#define PLAY_VARIANT(name, sink, filter, stats)                                             \
+    static void name(TrackData* tracks, int track_count, uint16_t time_div,                 \
+                     SendDirectDataFunc SendDirectData, const PlaybackOptions* options,     \
+                     const Transform* transform, PlaybackControl* control) {                \
+        (void)SendDirectData;                                                               \
+        play_core(tracks, track_count, time_div, sink, options, transform, control,         \
+                  filter, stats);                                                           \
+    }
+
+#define PLAY_VARIANTS(prefix, sink)                                        \
+    PLAY_VARIANT(prefix##_plain,           sink, FILTER_NONE,      false)  \
+    PLAY_VARIANT(prefix##_stats,           sink, FILTER_NONE,      true)   \
+    PLAY_VARIANT(prefix##_filter,          sink, FILTER_VELOCITY,  false)  \
+    PLAY_VARIANT(prefix##_filter_stats,    sink, FILTER_VELOCITY,  true)   \
+    PLAY_VARIANT(prefix##_transform,       sink, FILTER_TRANSFORM, false)  \
+    PLAY_VARIANT(prefix##_transform_stats, sink, FILTER_TRANSFORM, true)
+
+PLAY_VARIANTS(play_null,    drop_message)
+PLAY_VARIANTS(play_alsa,    alsa_send)
+PLAY_VARIANTS(play_capture, capture_send)
+PLAY_VARIANTS(play_shm,     shm_output_send)
+PLAY_VARIANTS(play_generic, SendDirectData)   // KDMAPI and anything else
+
+#define PLAY_VARIANT_ROW(prefix)                                         \
+    { { prefix##_plain,     prefix##_stats     },                        \
+      { prefix##_filter,    prefix##_filter_stats    },                  \
+      { prefix##_transform, prefix##_transform_stats } }
+
+// [sink][filter][stats]
+static const PlayCore play_variants[5][3][2] = {
+    PLAY_VARIANT_ROW(play_null),
+    PLAY_VARIANT_ROW(play_alsa),
+    PLAY_VARIANT_ROW(play_capture),
+    PLAY_VARIANT_ROW(play_shm),
+    PLAY_VARIANT_ROW(play_generic),
+};
+
+void play_midi_inline(TrackData* tracks, int track_count, uint16_t time_div, SendDirectDataFunc SendDirectData, const PlaybackOptions* options, PlaybackControl* control) {
+    int sink = SendDirectData == midi_output_null ? 0
+             : SendDirectData == alsa_send        ? 1
+             : SendDirectData == capture_send     ? 2
+             : SendDirectData == shm_output_send  ? 3
+             : 4;
+    // Compiled per file, the track mutes depend on its track count
+    Transform* transform = transform_compile(options->transform, options->min_velocity, track_count);
+    EventFilter filter = transform                  ? FILTER_TRANSFORM
+                       : options->min_velocity >= 0 ? FILTER_VELOCITY
+                       : FILTER_NONE;
+    bool stats = !options->quiet;
+
+    play_variants[sink][filter][stats](tracks, track_count, time_div, SendDirectData, options, transform, control);
+    transform_free(transform);
+}
+
+static const char* const engine_names[] = {
+    [PLAYBACK_ENGINE_INLINE]   = "inline",
+    [PLAYBACK_ENGINE_BUFFERED] = "buffered",
+};
+
+bool playback_engine_from_name(const char* name, PlaybackEngine* engine) {
+    for (int i = 0; i < (int)(sizeof(engine_names) / sizeof(engine_names[0])); i++) {
+        if (strcmp(name, engine_names[i]) == 0) {
+            *engine = (PlaybackEngine)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+const char* playback_engine_name(PlaybackEngine engine) {
+    return engine_names[engine];
+}
+
+void play_midi(TrackData* tracks, int track_count, uint16_t time_div, SendDirectDataFunc SendDirectData, const PlaybackOptions* options, PlaybackControl* control) {
+    static const PlaybackOptions defaults = { 0 };
+    if (!options) options = &defaults;
+
+    switch (options->engine) {
+        case PLAYBACK_ENGINE_BUFFERED:
+            play_midi_buffered(tracks, track_count, time_div, SendDirectData, options, control);
+            break;
+        default:
+            play_midi_inline(tracks, track_count, time_div, SendDirectData, options, control);
+            break;
+    }
+}
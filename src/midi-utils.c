@@ -1,11 +1,31 @@
 #include "midi-utils.h"
 #include "stats_logger.h"
+#include "thread-placement.h"
 
 #include <time.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdatomic.h>
+
+static bool virtual_clock = false;
+static _Atomic int64_t virtual_now = 0;
+
+void use_virtual_clock(bool enabled) {
+    virtual_clock = enabled;
+}
+
+bool virtual_clock_enabled(void) {
+    return virtual_clock;
+}
 
 int64_t getTime100ns() {
+    if (virtual_clock) {
+        return atomic_load_explicit(&virtual_now, memory_order_relaxed);
+    }
+    return getRealTime100ns();
+}
+
+int64_t getRealTime100ns() {
     struct timespec ts;
     clock_gettime(CLOCK_MONOTONIC, &ts);
 
@@ -14,6 +34,11 @@ int64_t getTime100ns() {
 }
 
 void delayExecution100Ns(const int64_t delayIn100Ns) {
+    if (virtual_clock) {
+        atomic_fetch_add_explicit(&virtual_now, delayIn100Ns, memory_order_relaxed);
+        return;
+    }
+
     struct timespec req = {0};
     req.tv_sec = delayIn100Ns / 10000000;
     req.tv_nsec = (delayIn100Ns % 10000000) * 100;
@@ -36,6 +61,7 @@ void* log_notes_per_second(void* _args) {
     FrameLoggerArgs* args = (FrameLoggerArgs*)_args;
     StatsLogger* lg       = args->lg;
     bool* is_playing      = args->is_playing;
+    place_current_thread(THREAD_ROLE_LOGGER);
 
     // sleep interval = 1/fps seconds
     struct timespec ts;
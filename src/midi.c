@@ -1,116 +1,264 @@
 #include "midi.h"
+#include "arena.h"
+#include "compressed.h"
 #include <stdio.h>
 #include <time.h>
 #include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
 
-TrackData* load_midi_file(const char* filename, uint16_t* time_div, int* track_count) {
-    TrackData* tracks = NULL;
-    FILE* file = fopen(filename, "rb");
+// Alignment of every buffer in a file's arena
+#define TRACK_ALIGN 64
 
-    if (!file) {
-        fprintf(stderr, "Could not open file\n");
-        return NULL;
+static bool parse_header(const uint8_t mthd[14], uint16_t* num_tracks, uint16_t* time_div) {
+    if (memcmp(mthd, "MThd", 4) != 0) {
+        fprintf(stderr, "Not a MIDI file\n");
+        return false;
     }
 
-    clock_t start_time = clock();
+    uint32_t header_length = (mthd[4] << 24) | (mthd[5] << 16) | (mthd[6] << 8) | mthd[7];
+    if (header_length != 6) {
+        fprintf(stderr, "Invalid header length\n");
+        return false;
+    }
+
+    *num_tracks = (mthd[10] << 8) | mthd[11];
+    *time_div = (mthd[12] << 8) | mthd[13];
 
-    char header[4];
-    fread(header, 1, 4, file);
-    if (strncmp(header, "MThd", 4) != 0) {
+    if (*time_div >= 0x8000) {
+        fprintf(stderr, "SMPTE timing not supported\n");
+        return false;
+    }
+    if (*time_div == 0) {
+        fprintf(stderr, "Invalid time division\n");
+        return false;
+    }
+    return true;
+}
+
+// Reads MThd, leaving the file at the first chunk
+static bool read_header(FILE* file, uint16_t* num_tracks, uint16_t* time_div) {
+    uint8_t mthd[14];
+    if (fread(mthd, 1, sizeof(mthd), file) != sizeof(mthd)) {
         fprintf(stderr, "Not a MIDI file\n");
-        fclose(file);
-        return NULL;
+        return false;
     }
+    return parse_header(mthd, num_tracks, time_div);
+}
 
-    uint32_t header_length;
-    fread(&header_length, 4, 1, file);
-    header_length = fntohl(header_length);
-    if (header_length != 6) {
-        fprintf(stderr, "Invalid header length\n");
-        fclose(file);
+// Length of the chunk whose 8-byte header this is, cut to what is left of
+// the file, so the decoders never have to check it
+static uint32_t chunk_length(const uint8_t chunk[8], size_t remaining) {
+    uint32_t length = (chunk[4] << 24) | (chunk[5] << 16) | (chunk[6] << 8) | chunk[7];
+    if (length > remaining) {
+        fprintf(stderr, "mplayer: Chunk truncated (%zu of %u bytes)\n", remaining, length);
+        length = (uint32_t)remaining;
+    }
+    return length;
+}
+
+// Skips to the data of the next MTrk chunk
+static bool next_track_chunk(FILE* file, long file_size, uint32_t* length) {
+    while (true) {
+        uint8_t chunk[8];
+        if (fread(chunk, 1, sizeof(chunk), file) != sizeof(chunk)) {
+            return false;
+        }
+        *length = chunk_length(chunk, (size_t)(file_size - ftell(file)));
+
+        if (memcmp(chunk, "MTrk", 4) == 0) {
+            return true;
+        }
+        // Skip unknown chunks
+        fseek(file, *length, SEEK_CUR);
+    }
+}
+
+static long file_size_of(FILE* file) {
+    fseek(file, 0, SEEK_END);
+    long file_size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    return file_size;
+}
+
+// The whole file is decompressed into the arena, right after the TrackData
+// array, and the tracks are played in place: each one's sentinel overwrites
+// the chunk header after it, once all headers have been read
+static TrackData* load_compressed(const char* filename, uint16_t* time_div, int* track_count) {
+    CompressedFile file;
+    if (!compressed_open(&file, filename)) {
         return NULL;
     }
 
-    uint16_t format;
-    fread(&format, 2, 1, file);
-    format = fntohs(format);
+    int64_t start_time = getRealTime100ns();
 
+    // The header is read ahead, the track count decides where the data goes
+    uint8_t mthd[14];
     uint16_t num_tracks;
-    fread(&num_tracks, 2, 1, file);
-    num_tracks = fntohs(num_tracks);
+    size_t bound = compressed_size_bound(&file);
+    if (!compressed_peek(&file, mthd, sizeof(mthd)) || !parse_header(mthd, &num_tracks, time_div)) {
+        compressed_close(&file);
+        return NULL;
+    }
+    if (bound < sizeof(mthd)) {
+        fprintf(stderr, "mplayer: Unreadable %s size records\n", compression_name(file.format));
+        compressed_close(&file);
+        return NULL;
+    }
 
-    fread(time_div, 2, 1, file);
-    *time_div = fntohs(*time_div);
+    printf("mplayer: %d tracks\n", num_tracks);
 
-    if (*time_div >= 0x8000) {
-        fprintf(stderr, "SMPTE timing not supported\n");
+    Arena* arena = NULL;
+    TrackData* tracks = NULL;
+    uint8_t* image = NULL;
+    size_t size = bound;
+    long threads = sysconf(_SC_NPROCESSORS_ONLN);
+    // A second time only for gzip files longer than their size field says
+    for (int attempt = 0; attempt < 2 && size >= bound; attempt++) {
+        bound = size;
+        arena_destroy(arena);
+        arena = NULL;
+        if (bound > COMPRESSED_SIZE_MAX) {
+            fprintf(stderr, "mplayer: %s data is larger than %zu GiB\n",
+                    compression_name(file.format), COMPRESSED_SIZE_MAX >> 30);
+            size = (size_t)-1;
+            break;
+        }
+
+        // As in load_midi_file, with the decompressed size for the file's
+        size_t capacity = num_tracks * sizeof(TrackData) + 2 * bound
+                        + (size_t)num_tracks * (TRACK_PADDING + 2 * TRACK_ALIGN) + 2 * TRACK_ALIGN;
+        arena = arena_create(capacity);
+        if (!arena) {
+            compressed_close(&file);
+            return NULL;
+        }
+        tracks = arena_alloc(arena, num_tracks * sizeof(TrackData), TRACK_ALIGN);
+        // Room for the sentinel of a last track that runs to the end
+        image = arena_alloc(arena, bound + TRACK_PADDING, TRACK_ALIGN);
+        if (!tracks || !image) {
+            fprintf(stderr, "Memory allocation failed\n");
+            size = (size_t)-1;
+            break;
+        }
+        size = compressed_decode(&file, image, bound, threads > 0 ? (int)threads : 1);
+        if (size == (size_t)-1 || size <= bound) break;
+    }
+    compressed_close(&file);
+    if (size == (size_t)-1 || size > bound) {
+        arena_destroy(arena);
+        return NULL;
+    }
+    arena_shrink_last(arena, image, size + TRACK_PADDING);
+
+    int valid_tracks = 0;
+    size_t pos = sizeof(mthd);
+    while (valid_tracks < num_tracks && size - pos >= 8) {
+        const uint8_t* chunk = image + pos;
+        pos += 8;
+        uint32_t length = chunk_length(chunk, size - pos);
+        if (memcmp(chunk, "MTrk", 4) == 0) {
+            init_track_data(&tracks[valid_tracks]);
+            tracks[valid_tracks].data = image + pos;
+            tracks[valid_tracks].length = length;
+            tracks[valid_tracks].data_capacity = length + TRACK_PADDING;
+            valid_tracks++;
+        }
+        pos += length;
+    }
+
+    for (int i = 0; i < valid_tracks; i++) {
+        size_t longest;
+        if (!seal_track_data(&tracks[i], &longest)) {
+            fprintf(stderr, "mplayer: Track %d is truncated, playing %zu bytes\n", i, tracks[i].length);
+        }
+        tracks[i].long_msg_capacity = longest;
+        update_tick(&tracks[i]);
+    }
+    for (int i = 0; i < valid_tracks; i++) {
+        tracks[i].long_msg = (uint8_t*)arena_alloc(arena, tracks[i].long_msg_capacity + 1, TRACK_ALIGN) + 1;
+    }
+    arena_finish(arena);
+
+    *track_count = valid_tracks;
+    printf("mplayer: Decompressed %zu KiB of %s in %ldms.\n", size / 1024,
+           compression_name(file.format), (long)((getRealTime100ns() - start_time) / 10000));
+    return tracks;
+}
+
+TrackData* load_midi_file(const char* filename, uint16_t* time_div, int* track_count) {
+    if (compression_detect(filename) != COMPRESSION_NONE) {
+        return load_compressed(filename, time_div, track_count);
+    }
+
+    TrackData* tracks = NULL;
+    FILE* file = fopen(filename, "rb");
+
+    if (!file) {
+        fprintf(stderr, "Could not open file\n");
+        return NULL;
+    }
+
+    clock_t start_time = clock();
+
+    long file_size = file_size_of(file);
+    uint16_t num_tracks;
+    if (!read_header(file, &num_tracks, time_div)) {
         fclose(file);
         return NULL;
     }
 
     printf("mplayer: %d tracks\n", num_tracks);
 
-    tracks = malloc(num_tracks * sizeof(TrackData));
-    if (!tracks) {
-        fprintf(stderr, "Memory allocation failed\n");
+    // Track data can not exceed the file, and neither can the long messages
+    // copied out of it. Only the pages actually used get backed.
+    size_t capacity = num_tracks * sizeof(TrackData) + 2 * (size_t)file_size
+                    + (size_t)num_tracks * (TRACK_PADDING + 2 * TRACK_ALIGN) + TRACK_ALIGN;
+    Arena* arena = arena_create(capacity);
+    if (!arena) {
         fclose(file);
         return NULL;
     }
 
+    // The array is the arena's first allocation, see free_tracks
+    tracks = arena_alloc(arena, num_tracks * sizeof(TrackData), TRACK_ALIGN);
+
     // Initialize tracks
     for (int i = 0; i < num_tracks; i++) {
         init_track_data(&tracks[i]);
     }
 
     int valid_tracks = 0;
-    for (int i = 0; i < num_tracks; ++i) {
-        fread(header, 1, 4, file);
-        if (strncmp(header, "MTrk", 4) != 0) {
-            continue;
-        }
-
-        uint32_t length;
-        fread(&length, 4, 1, file);
-        length = fntohl(length);
-
-        // Allocate memory for track data
-        tracks[valid_tracks].data = malloc(length);
-        if (!tracks[valid_tracks].data) {
-            fprintf(stderr, "Memory allocation failed\n");
-            for (int j = 0; j < valid_tracks; j++) {
-                free_track_data(&tracks[j]);
-            }
-            free(tracks);
-            fclose(file);
-            return NULL;
-        }
-
-        // Allocate initial long message buffer
-        tracks[valid_tracks].long_msg = malloc(256);
-        if (!tracks[valid_tracks].long_msg) {
-            fprintf(stderr, "Memory allocation failed\n");
-            free(tracks[valid_tracks].data);
-            for (int j = 0; j < valid_tracks; j++) {
-                free_track_data(&tracks[j]);
-            }
-            free(tracks);
-            fclose(file);
-            return NULL;
-        }
-
-        tracks[valid_tracks].long_msg_capacity = 256;
-        tracks[valid_tracks].length = length;
-        tracks[valid_tracks].data_capacity = length;
+    uint32_t length;
+    while (valid_tracks < num_tracks && next_track_chunk(file, file_size, &length)) {
+        // Track data plus the end-of-track sentinel
+        tracks[valid_tracks].data = arena_alloc(arena, length + TRACK_PADDING, TRACK_ALIGN);
+        tracks[valid_tracks].length = fread(tracks[valid_tracks].data, 1, length, file);
+        tracks[valid_tracks].data_capacity = length + TRACK_PADDING;
         tracks[valid_tracks].tick = 0;
         tracks[valid_tracks].offset = 0;
         tracks[valid_tracks].message = 0;
         tracks[valid_tracks].temp = 0;
 
-        fread(tracks[valid_tracks].data, 1, length, file);
+        size_t longest;
+        if (!seal_track_data(&tracks[valid_tracks], &longest)) {
+            fprintf(stderr, "mplayer: Track %d is truncated, playing %zu bytes\n",
+                    valid_tracks, tracks[valid_tracks].length);
+        }
+        tracks[valid_tracks].long_msg_capacity = longest;
         update_tick(&tracks[valid_tracks]);
         valid_tracks++;
     }
 
+    // Long message buffers go after all the data, sized for the longest
+    // message of each track, plus the status byte in front
+    for (int i = 0; i < valid_tracks; i++) {
+        tracks[i].long_msg = (uint8_t*)arena_alloc(arena, tracks[i].long_msg_capacity + 1, TRACK_ALIGN) + 1;
+    }
+    arena_finish(arena);
+
     *track_count = valid_tracks;
 
     clock_t end_time = clock();
@@ -122,3 +270,330 @@ TrackData* load_midi_file(const char* filename, uint16_t* time_div, int* track_c
     fclose(file);
     return tracks;
 }
+
+void free_tracks(TrackData* tracks, int track_count) {
+    (void)track_count;
+    if (!tracks) return;
+    arena_destroy(arena_of_first(tracks));
+}
+
+TrackData* share_tracks(const TrackData* tracks, int track_count) {
+    size_t capacity = track_count * sizeof(TrackData) + TRACK_ALIGN;
+    for (int i = 0; i < track_count; i++) {
+        capacity += tracks[i].long_msg_capacity + 2 * TRACK_ALIGN;
+    }
+
+    Arena* arena = arena_create(capacity);
+    if (!arena) return NULL;
+
+    TrackData* copy = arena_alloc(arena, track_count * sizeof(TrackData), TRACK_ALIGN);
+    for (int i = 0; i < track_count; i++) {
+        copy[i] = tracks[i];
+        if (tracks[i].long_msg) {
+            copy[i].long_msg = (uint8_t*)arena_alloc(arena, tracks[i].long_msg_capacity + 1, TRACK_ALIGN) + 1;
+        }
+    }
+    arena_finish(arena);
+    return copy;
+}
+
+// ——— Streaming loads ———
+
+// Read from every track before playback starts, then per step
+#define STREAM_HEAD_BYTES  (64 * 1024)
+#define STREAM_BLOCK_BYTES (256 * 1024)
+
+typedef struct {
+    uint8_t* data;     // the track buffer; playback clears TrackData.data at its end
+    long file_offset;
+    size_t length;     // chunk length
+    size_t loaded;     // bytes read so far
+    size_t committed;  // of those, prefaulted and locked, see arena_commit
+    size_t long_ready; // long message buffer bytes prefaulted and locked
+    TrackScan scan;
+    bool done;         // read and sealed
+} StreamTrack;
+
+typedef enum { STREAM_LOADING, STREAM_PLAYABLE, STREAM_FAILED } StreamState;
+
+struct MidiStream {
+    const char* filename;
+    pthread_t thread;
+    bool threaded;
+
+    TrackData* tracks;
+    int track_count;
+    uint16_t time_div;
+    StreamTrack* pending;
+    Arena* arena;      // of an uncompressed file
+
+    _Atomic uint64_t loaded_tick;
+    atomic_bool cancel;
+
+    pthread_mutex_t lock;
+    pthread_cond_t progress;   // broadcast on every change of the below
+    StreamState state;
+    int64_t waited_100ns;      // real time playback spent in midi_stream_wait
+    int waiters;               // threads in midi_stream_wait; overlapping waits count once
+    int64_t wait_started;
+};
+
+// Everything before this tick is loaded in the track
+static inline uint64_t stream_track_ready(const StreamTrack* st) {
+    return st->done ? UINT64_MAX : st->scan.tick;
+}
+
+// Reads up to max more bytes of a track and seals it once complete
+static void stream_read(MidiStream* stream, int fd, int index, size_t max) {
+    StreamTrack* st = &stream->pending[index];
+    size_t wanted = st->length - st->loaded < max ? st->length - st->loaded : max;
+
+    while (wanted > 0) {
+        ssize_t got = pread(fd, st->data + st->loaded, wanted, st->file_offset + (long)st->loaded);
+        if (got < 0 && errno == EINTR) continue;
+        if (got <= 0) {
+            // Play what arrived, like a truncated file
+            if (got < 0) perror("mplayer: read");
+            st->length = st->loaded;
+            break;
+        }
+        st->loaded += (size_t)got;
+        wanted -= (size_t)got;
+    }
+
+    bool complete = track_scan(&st->scan, st->data, st->loaded) || st->loaded == st->length;
+    if (complete) {
+        track_seal(&stream->tracks[index], st->data, &st->scan);
+        st->done = true;
+        if (!st->scan.ended) {
+            fprintf(stderr, "mplayer: Track %d is truncated, playing %zu bytes\n",
+                    index, st->scan.offset);
+        }
+    }
+
+    // Before playback gets to it, so it does not fault: what was read, the
+    // sentinel, and as much of the long message buffer as the messages
+    // scanned so far need
+    size_t ready = complete ? st->scan.offset + TRACK_PADDING : st->loaded;
+    if (ready > st->committed) {
+        arena_commit(stream->arena, st->data + st->committed, ready - st->committed);
+        st->committed = ready;
+    }
+    if (st->scan.longest > st->long_ready) {
+        uint8_t* long_msg = stream->tracks[index].long_msg - 1;
+        arena_commit(stream->arena, long_msg + st->long_ready, st->scan.longest + 1 - st->long_ready);
+        st->long_ready = st->scan.longest + 1;
+    }
+}
+
+static void stream_set_state(MidiStream* stream, StreamState state) {
+    pthread_mutex_lock(&stream->lock);
+    stream->state = state;
+    pthread_cond_broadcast(&stream->progress);
+    pthread_mutex_unlock(&stream->lock);
+}
+
+static void stream_publish(MidiStream* stream, uint64_t loaded_tick) {
+    pthread_mutex_lock(&stream->lock);
+    atomic_store_explicit(&stream->loaded_tick, loaded_tick, memory_order_release);
+    pthread_cond_broadcast(&stream->progress);
+    pthread_mutex_unlock(&stream->lock);
+}
+
+static void* stream_thread_fn(void* arg) {
+    MidiStream* stream = arg;
+    int64_t started = getRealTime100ns();
+
+    // Compressed files can only be read front to back, so they play once
+    // they are in whole; decompression is the bound, not the disk
+    if (compression_detect(stream->filename) != COMPRESSION_NONE) {
+        stream->tracks = load_compressed(stream->filename, &stream->time_div, &stream->track_count);
+        stream_publish(stream, UINT64_MAX);
+        stream_set_state(stream, stream->tracks ? STREAM_PLAYABLE : STREAM_FAILED);
+        return NULL;
+    }
+
+    FILE* file = fopen(stream->filename, "rb");
+    if (!file) {
+        fprintf(stderr, "Could not open file\n");
+        stream_set_state(stream, STREAM_FAILED);
+        return NULL;
+    }
+
+    long file_size = file_size_of(file);
+    uint16_t num_tracks;
+    if (!read_header(file, &num_tracks, &stream->time_div)) {
+        fclose(file);
+        stream_set_state(stream, STREAM_FAILED);
+        return NULL;
+    }
+    printf("mplayer: %d tracks\n", num_tracks);
+
+    // The chunk table first, so every buffer can be placed before any of
+    // them is read
+    stream->pending = calloc(num_tracks ? num_tracks : 1, sizeof(StreamTrack));
+    if (!stream->pending) {
+        fprintf(stderr, "Memory allocation failed\n");
+        fclose(file);
+        stream_set_state(stream, STREAM_FAILED);
+        return NULL;
+    }
+    int count = 0;
+    size_t capacity = TRACK_ALIGN;
+    uint32_t length;
+    while (count < num_tracks && next_track_chunk(file, file_size, &length)) {
+        stream->pending[count].file_offset = ftell(file);
+        stream->pending[count].length = length;
+        capacity += sizeof(TrackData) + 2 * (size_t)length + TRACK_PADDING + 1 + 2 * TRACK_ALIGN;
+        fseek(file, length, SEEK_CUR);
+        count++;
+    }
+
+    Arena* arena = arena_create(capacity);
+    if (!arena) {
+        fclose(file);
+        stream_set_state(stream, STREAM_FAILED);
+        return NULL;
+    }
+
+    // The array is the arena's first allocation, see free_tracks. The
+    // buffers are committed as they are read, and the long message buffers,
+    // sized for a message as long as the track since the longest one is
+    // not known yet, as far as the messages read so far need them.
+    stream->arena = arena;
+    TrackData* tracks = arena_alloc(arena, count * sizeof(TrackData), TRACK_ALIGN);
+    arena_begin_lazy(arena);
+    for (int i = 0; i < count; i++) {
+        StreamTrack* st = &stream->pending[i];
+        init_track_data(&tracks[i]);
+        st->data = arena_alloc(arena, st->length + TRACK_PADDING, TRACK_ALIGN);
+        tracks[i].data = st->data;
+        tracks[i].length = st->length;
+        tracks[i].data_capacity = st->length + TRACK_PADDING;
+        tracks[i].long_msg = (uint8_t*)arena_alloc(arena, st->length + 1, TRACK_ALIGN) + 1;
+        tracks[i].long_msg_capacity = st->length;
+    }
+    arena_finish(arena);
+    stream->tracks = tracks;
+    stream->track_count = count;
+
+    // The opening of every track, in file order
+    int fd = fileno(file);
+    size_t head_bytes = 0, total_bytes = 0;
+    for (int i = 0; i < count && !atomic_load(&stream->cancel); i++) {
+        stream_read(stream, fd, i, STREAM_HEAD_BYTES);
+        head_bytes += stream->pending[i].loaded;
+        total_bytes += stream->pending[i].length;
+    }
+    for (int i = 0; i < count; i++) {
+        update_tick(&tracks[i]);
+    }
+
+    // Then whichever track holds playback back, until all are in
+    bool playable = false;
+    while (true) {
+        uint64_t loaded_tick = UINT64_MAX;
+        int behind = -1;
+        for (int i = 0; i < count; i++) {
+            uint64_t ready = stream_track_ready(&stream->pending[i]);
+            if (ready < loaded_tick) {
+                loaded_tick = ready;
+                behind = i;
+            }
+        }
+        stream_publish(stream, loaded_tick);
+
+        if (!playable) {
+            printf("mplayer: Playable after %ldms (%zu of %zu KiB loaded)\n",
+                   (long)((getRealTime100ns() - started) / 10000), head_bytes / 1024, total_bytes / 1024);
+            stream_set_state(stream, STREAM_PLAYABLE);
+            playable = true;
+        }
+        if (behind < 0 || atomic_load(&stream->cancel)) break;
+        stream_read(stream, fd, behind, STREAM_BLOCK_BYTES);
+    }
+
+    if (midi_stream_loaded_tick(stream) == UINT64_MAX) {
+        printf("mplayer: Loaded in %ldms.\n", (long)((getRealTime100ns() - started) / 10000));
+    }
+    fclose(file);
+    return NULL;
+}
+
+MidiStream* midi_stream_start(const char* filename) {
+    MidiStream* stream = calloc(1, sizeof(MidiStream));
+    if (!stream) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return NULL;
+    }
+    stream->filename = filename;
+    atomic_init(&stream->loaded_tick, 0);
+    atomic_init(&stream->cancel, false);
+    stream->state = STREAM_LOADING;
+
+    // Timed waits go by the monotonic clock, like everything else
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&stream->progress, &attr);
+    pthread_condattr_destroy(&attr);
+    pthread_mutex_init(&stream->lock, NULL);
+
+    stream->threaded = pthread_create(&stream->thread, NULL, stream_thread_fn, stream) == 0;
+    if (!stream->threaded) {
+        // Fall back to loading synchronously
+        stream_thread_fn(stream);
+    }
+    return stream;
+}
+
+bool midi_stream_wait_playable(MidiStream* stream, TrackData** tracks, uint16_t* time_div, int* track_count) {
+    pthread_mutex_lock(&stream->lock);
+    while (stream->state == STREAM_LOADING) {
+        pthread_cond_wait(&stream->progress, &stream->lock);
+    }
+    bool playable = stream->state == STREAM_PLAYABLE;
+    pthread_mutex_unlock(&stream->lock);
+
+    *tracks = playable ? stream->tracks : NULL;
+    *time_div = stream->time_div;
+    *track_count = playable ? stream->track_count : 0;
+    return playable;
+}
+
+uint64_t midi_stream_loaded_tick(const MidiStream* stream) {
+    return atomic_load_explicit(&((MidiStream*)stream)->loaded_tick, memory_order_acquire);
+}
+
+bool midi_stream_wait(MidiStream* stream, uint64_t tick, int64_t timeout_100ns) {
+    if (midi_stream_loaded_tick(stream) > tick) return true;
+
+    int64_t start = getRealTime100ns();
+    int64_t deadline = start + timeout_100ns;
+    struct timespec until = { .tv_sec = deadline / 10000000, .tv_nsec = deadline % 10000000 * 100 };
+
+    pthread_mutex_lock(&stream->lock);
+    if (stream->waiters++ == 0) stream->wait_started = start;
+    while (midi_stream_loaded_tick(stream) <= tick) {
+        if (pthread_cond_timedwait(&stream->progress, &stream->lock, &until) == ETIMEDOUT) break;
+    }
+    if (--stream->waiters == 0) stream->waited_100ns += getRealTime100ns() - stream->wait_started;
+    pthread_mutex_unlock(&stream->lock);
+    return midi_stream_loaded_tick(stream) > tick;
+}
+
+void midi_stream_close(MidiStream* stream) {
+    if (!stream) return;
+    atomic_store(&stream->cancel, true);
+    if (stream->threaded) {
+        pthread_join(stream->thread, NULL);
+    }
+    if (stream->waited_100ns > 0) {
+        printf("mplayer: Playback waited %ldms for the file to load\n",
+               (long)(stream->waited_100ns / 10000));
+    }
+    pthread_cond_destroy(&stream->progress);
+    pthread_mutex_destroy(&stream->lock);
+    free(stream->pending);
+    free(stream);
+}
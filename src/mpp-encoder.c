@@ -0,0 +1,122 @@
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "mpp-encoder.h"
+
+static uint8_t* alloc_packet(size_t max_notes) {
+    return malloc(MPP_HEADER_SIZE + max_notes * MPP_NOTE_SIZE);
+}
+
+bool mpp_encoder_init(MppEncoder* enc, size_t max_notes, int note_offset) {
+    enc->data = alloc_packet(max_notes);
+    enc->count = 0;
+    enc->max_notes = max_notes;
+    enc->time_ms = 0;
+    enc->note_offset = note_offset;
+    memset(enc->held, 0, sizeof(enc->held));
+    return enc->data != NULL;
+}
+
+void mpp_encoder_free(MppEncoder* enc) {
+    free(enc->data);
+    enc->data = NULL;
+    enc->count = 0;
+}
+
+static bool add_note(MppEncoder* enc, uint8_t note, uint8_t velocity, uint64_t now_ms) {
+    if (enc->count == 0) {
+        enc->time_ms = now_ms;
+    } else if (enc->count >= enc->max_notes || now_ms - enc->time_ms > MPP_MAX_DELAY) {
+        return false;
+    }
+
+    uint8_t* out = enc->data + MPP_HEADER_SIZE + enc->count * MPP_NOTE_SIZE;
+    out[0] = note;
+    out[1] = (uint8_t)(now_ms - enc->time_ms);
+    out[2] = velocity;
+    enc->count++;
+    return true;
+}
+
+bool mpp_encoder_push(MppEncoder* enc, uint32_t message, uint64_t now_ms) {
+    uint8_t command = message & 0xF0;
+    if (command != 0x90 && command != 0x80) return true;
+
+    int note = (int)((message >> 8) & 0x7F) + enc->note_offset;
+    if (note < 0 || note > 127) return true;
+    uint8_t velocity = command == 0x90 ? (message >> 16) & 0x7F : 0;
+
+    if (!add_note(enc, (uint8_t)note, velocity, now_ms)) return false;
+    if (velocity) {
+        if (enc->held[note] < UINT16_MAX) enc->held[note]++;
+    } else if (enc->held[note]) {
+        enc->held[note]--;
+    }
+    return true;
+}
+
+bool mpp_encoder_release_all(MppEncoder* enc, uint64_t now_ms) {
+    for (int note = 0; note < 128; note++) {
+        if (!enc->held[note]) continue;
+        if (!add_note(enc, (uint8_t)note, 0, now_ms)) return false;
+        enc->held[note] = 0;
+    }
+    return true;
+}
+
+uint8_t* mpp_encoder_take(MppEncoder* enc, int64_t time_offset_ms, size_t* size) {
+    if (enc->count == 0) return NULL;
+
+    uint8_t* next = alloc_packet(enc->max_notes);
+    if (!next) return NULL;
+
+    uint8_t* packet = enc->data;
+    uint64_t timestamp = enc->time_ms + time_offset_ms;
+    for (int i = 0; i < MPP_HEADER_SIZE; i++) {
+        packet[i] = (timestamp >> (8 * i)) & 0xFF;
+    }
+    *size = MPP_HEADER_SIZE + enc->count * MPP_NOTE_SIZE;
+
+    enc->data = next;
+    enc->count = 0;
+    enc->time_ms = 0;
+    return packet;
+}
+
+char* mpp_base64_encode(const uint8_t* data, size_t size, size_t* out_len) {
+    static const char alphabet[] =
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+    size_t len = 4 * ((size + 2) / 3);
+    char* out = malloc(len + 1);
+    if (!out) return NULL;
+
+    char* p = out;
+    size_t i = 0;
+    for (; i + 2 < size; i += 3) {
+        uint32_t v = (data[i] << 16) | (data[i + 1] << 8) | data[i + 2];
+        *p++ = alphabet[(v >> 18) & 0x3F];
+        *p++ = alphabet[(v >> 12) & 0x3F];
+        *p++ = alphabet[(v >> 6) & 0x3F];
+        *p++ = alphabet[v & 0x3F];
+    }
+    if (i < size) {
+        uint32_t v = data[i] << 16;
+        if (i + 1 < size) v |= data[i + 1] << 8;
+        *p++ = alphabet[(v >> 18) & 0x3F];
+        *p++ = alphabet[(v >> 12) & 0x3F];
+        *p++ = i + 1 < size ? alphabet[(v >> 6) & 0x3F] : '=';
+        *p++ = '=';
+    }
+    *p = '\0';
+
+    if (out_len) *out_len = len;
+    return out;
+}
+
+uint64_t mpp_wall_clock_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
@@ -4,45 +4,183 @@
 #include <stdint.h>
 #include <string.h>
 #include <pthread.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <sched.h>
 
 #include "midi.h"
 #include "midi-player.h"
+#include "midi-output.h"
+#include "mpp-encoder.h"
+#include "note-index.h"
 
 #ifdef ENABLE_MIDI_DEBUG
-  #define LOG(...) LOG(stderr, __VA_ARGS__)
+  #define LOG(...) fprintf(__VA_ARGS__)
 #else
   #define LOG(...) (void)0
 #endif
 
 // —————————————————————————————————————————————————————————————————
-// Globals
+// Player handles
 // —————————————————————————————————————————————————————————————————
 
-// Our single threadsafe function handle
-static napi_threadsafe_function g_tsfn = NULL;
+// One per playMIDI() call. Owned by the returned promise (napi_wrap) and
+// kept alive by promise_ref until the playback thread is done with it.
+typedef struct
+{
+    napi_threadsafe_function tsfn;
+    napi_deferred deferred;
+    napi_ref promise_ref;
+    PlaybackControl control;
+
+    char filepath[512];
+    PlaybackOptions options;
+    TransformSpec transform;
+    double speed;
+
+    // Native mode: events go straight to KDMAPI/ALSA from the playback
+    // thread, JS only sees the optional rate-limited tap
+    bool native;
+    bool use_alsa;
+    char alsa_port[128];
+    SendDirectDataFunc output;
+    struct TapBatch *tap;
+    uint32_t tap_max;
+    int64_t tap_interval_100ns;
+    int64_t tap_last;
+
+    // MPP mode: notes are packed into MPP note-buffer packets here and
+    // only finished packets reach JS. The playback thread queues them with
+    // their time, the flusher thread encodes and sends them.
+    bool mpp;
+    bool mpp_base64;
+    int mpp_note_offset;
+    uint32_t mpp_max_notes;
+    int64_t mpp_interval_ms;
+    _Atomic int64_t mpp_time_offset_ms;
+    MppEncoder mpp_encoder;               // the flusher's
+    struct MppQueued *mpp_queue;
+    _Atomic size_t mpp_head;              // written by the playback thread
+    _Atomic size_t mpp_tail;              // written by the flusher
+    pthread_mutex_t mpp_lock;
+    pthread_cond_t mpp_wake;
+    pthread_t mpp_flusher;
+    bool mpp_chunk;                       // a chunk is waiting, under mpp_lock
+    bool mpp_done;
+
+    // Written by the playback thread, read once it has released the TSFN
+    const char *error;
+    uint64_t events;
+    uint64_t notes;
+    int64_t duration_100ns;
+} Player;
 
-// Worker arguments
+// Events handed to the JS tap in one call
+typedef struct TapBatch
+{
+    uint32_t count;
+    uint32_t dropped;
+    uint32_t events[];
+} TapBatch;
+
+// A note event on its way to the MPP flusher
+typedef struct MppQueued
+{
+    uint32_t message;
+    uint64_t time_ms;
+} MppQueued;
+
+// Events queued for the flusher, and how many wake it early
+#define MPP_QUEUE_SIZE 65536
+#define MPP_CHUNK      4096
+
+// A finished MPP packet on its way to JS
 typedef struct
 {
-    TrackData *tracks;
-    int track_count;
-    uint16_t time_div;
-    uint8_t min_velocity;
-} WorkerArgs;
+    uint8_t *data;
+    size_t size;
+} MppPacket;
+
+// The player whose playback runs on the current thread
+static _Thread_local Player *tls_player = NULL;
+
+// PlaybackOptions.bind_sink_thread: the buffered engine sends from its own thread
+static void BindPlayerThread(void *context)
+{
+    tls_player = (Player *)context;
+}
 
 // —————————————————————————————————————————————————————————————————
-// Utility: free up TrackData[]
+// Native output, shared by every native playback in the process.
+// KDMAPI and the ALSA client are process-wide, so only one
+// configuration can be open at a time, and players take turns on it.
 // —————————————————————————————————————————————————————————————————
 
-static void free_tracks(TrackData *tracks, int track_count)
+static pthread_mutex_t g_native_lock = PTHREAD_MUTEX_INITIALIZER;
+static MidiOutput g_native;
+static int g_native_refs = 0;
+static bool g_native_alsa = false;
+static char g_native_port[128];
+
+// Held for each send, so concurrent players never interleave on the handle
+static pthread_mutex_t g_native_send_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void NativeOutputSend(uint32_t data)
 {
-    if (!tracks)
-        return;
-    for (int i = 0; i < track_count; i++)
+    pthread_mutex_lock(&g_native_send_lock);
+    g_native.SendDirectData(data);
+    pthread_mutex_unlock(&g_native_send_lock);
+}
+
+static void NativeOutputSendLong(const uint8_t *data, uint32_t length)
+{
+    pthread_mutex_lock(&g_native_send_lock);
+    g_native.SendLongData(data, length);
+    pthread_mutex_unlock(&g_native_send_lock);
+}
+
+static bool NativeOutputAcquire(Player *p)
+{
+    bool ok = true;
+    pthread_mutex_lock(&g_native_lock);
+    if (g_native_refs > 0)
     {
-        free_track_data(&tracks[i]);
+        if (g_native_alsa != p->use_alsa ||
+            (p->use_alsa && strcmp(g_native_port, p->alsa_port) != 0))
+        {
+            fprintf(stderr, "mplayer: Native output is already open as %s\n",
+                    g_native_alsa ? g_native_port : "kdmapi");
+            ok = false;
+        }
     }
-    free(tracks);
+    else if (midi_output_open(&g_native, p->use_alsa ? p->alsa_port : NULL))
+    {
+        g_native_alsa = p->use_alsa;
+        strcpy(g_native_port, p->alsa_port);
+    }
+    else
+    {
+        ok = false;
+    }
+
+    if (ok)
+    {
+        g_native_refs++;
+        p->output = NativeOutputSend;
+        p->options.SendLongData = g_native.SendLongData ? NativeOutputSendLong : NULL;
+    }
+    pthread_mutex_unlock(&g_native_lock);
+    return ok;
+}
+
+static void NativeOutputRelease(void)
+{
+    pthread_mutex_lock(&g_native_lock);
+    if (--g_native_refs == 0)
+    {
+        midi_output_close(&g_native);
+    }
+    pthread_mutex_unlock(&g_native_lock);
 }
 
 // —————————————————————————————————————————————————————————————————
@@ -50,14 +188,10 @@ static void free_tracks(TrackData *tracks, int track_count)
 // —————————————————————————————————————————————————————————————————
 static void CallJs(napi_env env,
                    napi_value js_cb,
-                   void * /*context*/,
+                   void *context,
                    void *data)
 {
-    if (!env || !js_cb)
-    {
-        LOG(stderr, "[CallJs] invalid env or js_cb\n");
-        return;
-    }
+    (void)context;
     if (!data)
     {
         LOG(stderr, "[CallJs] no data to send\n");
@@ -67,6 +201,12 @@ static void CallJs(napi_env env,
     uint32_t value = *(uint32_t *)data;
     free(data);
 
+    // env is NULL while the TSFN is being torn down
+    if (!env || !js_cb)
+    {
+        return;
+    }
+
     LOG(stderr, "[CallJs] invoking JS callback with %u\n", value);
 
     // 1) Get the global object to use as 'this'
@@ -96,19 +236,160 @@ static void CallJs(napi_env env,
 }
 
 // —————————————————————————————————————————————————————————————————
-// This is passed into play_midi.  It runs on the MIDI thread.
+// Tap delivery for native mode, on the JS thread: cb(Uint32Array, dropped)
 // —————————————————————————————————————————————————————————————————
+static void CallJsTap(napi_env env,
+                      napi_value js_cb,
+                      void *context,
+                      void *data)
+{
+    (void)context;
+    TapBatch *batch = (TapBatch *)data;
+    if (!batch)
+    {
+        return;
+    }
+    if (!env || !js_cb)
+    {
+        free(batch);
+        return;
+    }
 
-void ThreadSendDirectData(uint32_t data)
+    void *bytes;
+    napi_value buffer, argv[2], global;
+    napi_status st = napi_create_arraybuffer(env, batch->count * sizeof(uint32_t), &bytes, &buffer);
+    if (st == napi_ok)
+    {
+        memcpy(bytes, batch->events, batch->count * sizeof(uint32_t));
+        napi_create_typedarray(env, napi_uint32_array, batch->count, buffer, 0, &argv[0]);
+        napi_create_uint32(env, batch->dropped, &argv[1]);
+        napi_get_global(env, &global);
+        st = napi_call_function(env, global, js_cb, 2, argv, NULL);
+    }
+    if (st != napi_ok)
+    {
+        LOG(stderr, "[CallJsTap] delivery failed with code %d\n", st);
+    }
+    free(batch);
+}
+
+// —————————————————————————————————————————————————————————————————
+// MPP packet delivery, on the JS thread: cb(base64 string | Buffer)
+// —————————————————————————————————————————————————————————————————
+static void CallJsPacket(napi_env env,
+                         napi_value js_cb,
+                         void *context,
+                         void *data)
+{
+    Player *p = (Player *)context;
+    MppPacket *packet = (MppPacket *)data;
+    if (!packet)
+    {
+        return;
+    }
+
+    napi_value argv, global;
+    napi_status st = napi_generic_failure;
+    if (env && js_cb)
+    {
+        if (p->mpp_base64)
+        {
+            size_t len;
+            char *text = mpp_base64_encode(packet->data, packet->size, &len);
+            if (text)
+            {
+                st = napi_create_string_latin1(env, text, len, &argv);
+                free(text);
+            }
+        }
+        else
+        {
+            st = napi_create_buffer_copy(env, packet->size, packet->data, NULL, &argv);
+        }
+        if (st == napi_ok)
+        {
+            napi_get_global(env, &global);
+            st = napi_call_function(env, global, js_cb, 1, &argv, NULL);
+        }
+        if (st != napi_ok)
+        {
+            LOG(stderr, "[CallJsPacket] delivery failed with code %d\n", st);
+        }
+    }
+    free(packet->data);
+    free(packet);
+}
+
+// —————————————————————————————————————————————————————————————————
+// These are passed into play_midi.  They run on the MIDI thread.
+// —————————————————————————————————————————————————————————————————
+
+static TapBatch *TapAlloc(uint32_t capacity)
+{
+    TapBatch *batch = malloc(sizeof(TapBatch) + capacity * sizeof(uint32_t));
+    if (batch)
+    {
+        batch->count = 0;
+        batch->dropped = 0;
+    }
+    return batch;
+}
+
+// Hands the current batch to JS and starts a new one
+static void TapFlush(Player *p, int64_t now)
 {
-    if (!g_tsfn)
+    p->tap_last = now;
+    TapBatch *batch = p->tap;
+    if (batch->count == 0 && batch->dropped == 0)
     {
-        LOG(stderr, "[ThreadSend] no TSFN (was it created?)\n");
         return;
     }
 
-    LOG(stderr, "[ThreadSend] queueing %u\n", data);
+    TapBatch *next = TapAlloc(p->tap_max);
+    if (!next)
+    {
+        // Keep the old batch and drop its contents instead
+        batch->count = 0;
+        batch->dropped = 0;
+        return;
+    }
+    if (napi_call_threadsafe_function(p->tsfn, batch, napi_tsfn_nonblocking) != napi_ok)
+    {
+        free(batch);
+    }
+    p->tap = next;
+}
+
+static void NativeSendDirectData(uint32_t data)
+{
+    Player *p = tls_player;
+
+    p->output(data);
+    p->events++;
+    if ((data & 0xF0) == 0x90 && ((data >> 16) & 0xFF) > 0)
+    {
+        p->notes++;
+    }
+
+    if (p->tap)
+    {
+        TapBatch *batch = p->tap;
+        if (batch->count < p->tap_max)
+            batch->events[batch->count++] = data;
+        else
+            batch->dropped++;
 
+        int64_t now = getTime100ns();
+        if (now - p->tap_last >= p->tap_interval_100ns)
+        {
+            TapFlush(p, now);
+        }
+    }
+}
+
+// Queues one message for the JS callback
+static void JsSend(Player *p, uint32_t data)
+{
     uint32_t *boxed = malloc(sizeof(uint32_t));
     if (!boxed)
     {
@@ -118,7 +399,7 @@ void ThreadSendDirectData(uint32_t data)
     *boxed = data;
 
     napi_status st = napi_call_threadsafe_function(
-        g_tsfn,
+        p->tsfn,
         boxed,
         napi_tsfn_nonblocking);
     if (st != napi_ok)
@@ -128,44 +409,600 @@ void ThreadSendDirectData(uint32_t data)
     }
 }
 
+void ThreadSendDirectData(uint32_t data)
+{
+    Player *p = tls_player;
+
+    p->events++;
+    if ((data & 0xF0) == 0x90 && ((data >> 16) & 0xFF) > 0)
+    {
+        p->notes++;
+    }
+    JsSend(p, data);
+}
+
+// Sends the pending MPP packet, if any. Called on the flusher thread.
+static void MppFlush(Player *p)
+{
+    MppPacket *packet = malloc(sizeof(MppPacket));
+    if (!packet)
+    {
+        return;
+    }
+    packet->data = mpp_encoder_take(&p->mpp_encoder,
+                                    atomic_load(&p->mpp_time_offset_ms),
+                                    &packet->size);
+    if (!packet->data ||
+        napi_call_threadsafe_function(p->tsfn, packet, napi_tsfn_nonblocking) != napi_ok)
+    {
+        free(packet->data);
+        free(packet);
+    }
+}
+
+// Wakes the flusher for the queued chunk
+static void MppWake(Player *p)
+{
+    pthread_mutex_lock(&p->mpp_lock);
+    p->mpp_chunk = true;
+    pthread_cond_signal(&p->mpp_wake);
+    pthread_mutex_unlock(&p->mpp_lock);
+}
+
+// Takes no lock, except once per chunk to wake the flusher
+static void MppSendDirectData(uint32_t data)
+{
+    Player *p = tls_player;
+
+    p->events++;
+    if ((data & 0xF0) == 0x90 && ((data >> 16) & 0xFF) > 0)
+    {
+        p->notes++;
+    }
+    if ((data & 0xE0) != 0x80)
+    {
+        return;
+    }
+
+    size_t head = atomic_load_explicit(&p->mpp_head, memory_order_relaxed);
+    while (head - atomic_load_explicit(&p->mpp_tail, memory_order_acquire) == MPP_QUEUE_SIZE)
+    {
+        MppWake(p);
+        sched_yield();
+    }
+    p->mpp_queue[head % MPP_QUEUE_SIZE] = (MppQueued){data, mpp_wall_clock_ms()};
+    atomic_store_explicit(&p->mpp_head, head + 1, memory_order_release);
+    if ((head + 1) % MPP_CHUNK == 0)
+    {
+        MppWake(p);
+    }
+}
+
+// Encodes everything queued, sending each packet that fills up
+static void MppDrain(Player *p)
+{
+    size_t tail = atomic_load_explicit(&p->mpp_tail, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&p->mpp_head, memory_order_acquire);
+    for (; tail != head; tail++)
+    {
+        const MppQueued *event = &p->mpp_queue[tail % MPP_QUEUE_SIZE];
+        if (!mpp_encoder_push(&p->mpp_encoder, event->message, event->time_ms))
+        {
+            // Full, or the note is more than 255ms after the packet start
+            MppFlush(p);
+            mpp_encoder_push(&p->mpp_encoder, event->message, event->time_ms);
+        }
+    }
+    atomic_store_explicit(&p->mpp_tail, tail, memory_order_release);
+}
+
+static void AddMilliseconds(struct timespec *ts, int64_t ms)
+{
+    ts->tv_sec += ms / 1000;
+    ts->tv_nsec += (ms % 1000) * 1000000;
+    if (ts->tv_nsec >= 1000000000)
+    {
+        ts->tv_sec++;
+        ts->tv_nsec -= 1000000000;
+    }
+}
+
+// Flushes the MPP packet every flushIntervalMs, like the JS setInterval
+// did, and encodes queued chunks in between. Once playback is done it
+// sends what is left, after releasing held notes if it was stopped.
+static void *MppFlusher(void *arg)
+{
+    Player *p = (Player *)arg;
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    AddMilliseconds(&deadline, p->mpp_interval_ms);
+
+    pthread_mutex_lock(&p->mpp_lock);
+    while (true)
+    {
+        bool timed_out = false;
+        if (!p->mpp_done && !p->mpp_chunk)
+        {
+            timed_out = pthread_cond_timedwait(&p->mpp_wake, &p->mpp_lock, &deadline) != 0;
+        }
+        bool done = p->mpp_done;
+        p->mpp_chunk = false;
+        pthread_mutex_unlock(&p->mpp_lock);
+
+        MppDrain(p);
+        if (done && playback_control_stopped(&p->control))
+        {
+            uint64_t now = mpp_wall_clock_ms();
+            while (!mpp_encoder_release_all(&p->mpp_encoder, now))
+            {
+                MppFlush(p);
+            }
+        }
+        if (timed_out || done)
+        {
+            MppFlush(p);
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            AddMilliseconds(&deadline, p->mpp_interval_ms);
+        }
+        if (done)
+        {
+            return NULL;
+        }
+        pthread_mutex_lock(&p->mpp_lock);
+    }
+}
+
 // —————————————————————————————————————————————————————————————————
-// Worker entry point: calls your blocking play_midi.
+// Worker entry point: loads the file, then calls the blocking play_midi.
 // —————————————————————————————————————————————————————————————————
 
+static bool MppStart(Player *p)
+{
+    p->mpp_queue = malloc(MPP_QUEUE_SIZE * sizeof(MppQueued));
+    if (!p->mpp_queue || !mpp_encoder_init(&p->mpp_encoder, p->mpp_max_notes, p->mpp_note_offset))
+    {
+        free(p->mpp_queue);
+        mpp_encoder_free(&p->mpp_encoder);
+        return false;
+    }
+    atomic_init(&p->mpp_head, 0);
+    atomic_init(&p->mpp_tail, 0);
+    if (pthread_create(&p->mpp_flusher, NULL, MppFlusher, p) != 0)
+    {
+        free(p->mpp_queue);
+        mpp_encoder_free(&p->mpp_encoder);
+        return false;
+    }
+    return true;
+}
+
+static void MppFinish(Player *p)
+{
+    pthread_join(p->mpp_flusher, NULL);
+    free(p->mpp_queue);
+    p->mpp_queue = NULL;
+    mpp_encoder_free(&p->mpp_encoder);
+}
+
 void *PlayMidiWorker(void *arg)
 {
-    WorkerArgs *w = (WorkerArgs *)arg;
+    Player *p = (Player *)arg;
+    tls_player = p;
 
-    LOG(stderr, "[Worker] starting play_midi()\n");
-    play_midi(
-        w->tracks,
-        w->track_count,
-        w->time_div,
-        ThreadSendDirectData,
-        w->min_velocity);
-    LOG(stderr, "[Worker] play_midi() returned\n");
+    uint16_t time_div = 0;
+    int track_count = 0;
+    TrackData *tracks = load_midi_file(p->filepath, &time_div, &track_count);
+    if (!tracks)
+    {
+        p->error = "Failed to load MIDI file";
+    }
+    else if (p->native && !NativeOutputAcquire(p))
+    {
+        p->error = "Failed to open native MIDI output";
+    }
+    else if (p->mpp && !MppStart(p))
+    {
+        p->error = "Failed to start the MPP encoder";
+    }
+    else
+    {
+        SendDirectDataFunc sink = ThreadSendDirectData;
+        if (p->native)
+        {
+            sink = NativeSendDirectData;
+        }
+        else if (p->mpp)
+        {
+            sink = MppSendDirectData;
+        }
+
+        LOG(stderr, "[Worker] starting play_midi()\n");
+        p->tap_last = getTime100ns();
+        int64_t start = p->tap_last;
+        play_midi(
+            tracks,
+            track_count,
+            time_div,
+            sink,
+            &p->options,
+            &p->control);
+        p->duration_100ns = getTime100ns() - start;
+        LOG(stderr, "[Worker] play_midi() returned\n");
 
-    free_tracks(w->tracks, w->track_count);
-    free(w);
+        if (p->mpp)
+        {
+            // The flusher sends whatever is left on its way out
+            pthread_mutex_lock(&p->mpp_lock);
+            p->mpp_done = true;
+            pthread_cond_signal(&p->mpp_wake);
+            pthread_mutex_unlock(&p->mpp_lock);
+            MppFinish(p);
+        }
 
-    // let JS side know we're done with the TSFN
+        if (!p->native && !p->mpp && playback_control_stopped(&p->control))
+        {
+            // A synth in JS would keep the held notes sounding
+            for (uint32_t channel = 0; channel < 16; channel++)
+            {
+                JsSend(p, (0xB0 | channel) | (123 << 8)); // All notes off
+                JsSend(p, (0xB0 | channel) | (120 << 8)); // All sound off
+            }
+        }
+
+        if (p->native)
+        {
+            if (playback_control_stopped(&p->control))
+            {
+                all_notes_off(p->output);
+            }
+            NativeOutputRelease();
+            if (p->tap)
+            {
+                TapFlush(p, getTime100ns());
+            }
+        }
+    }
+    free_tracks(tracks, track_count);
+    free(p->tap);
+    p->tap = NULL;
+
+    // Last reference: the TSFN finalizer settles the promise on the JS thread
     napi_status st = napi_release_threadsafe_function(
-        g_tsfn,
+        p->tsfn,
         napi_tsfn_release);
     if (st != napi_ok)
     {
         LOG(stderr, "[Worker] napi_release_threadsafe_function failed\n");
     }
+    return NULL;
+}
+
+// —————————————————————————————————————————————————————————————————
+// Runs on the JS thread once the playback thread has released the TSFN
+// —————————————————————————————————————————————————————————————————
+
+static void PlaybackFinished(napi_env env, void *finalize_data, void *hint)
+{
+    (void)hint;
+    Player *p = (Player *)finalize_data;
+
+    if (p->error)
+    {
+        napi_value message, error;
+        napi_create_string_utf8(env, p->error, NAPI_AUTO_LENGTH, &message);
+        napi_create_error(env, NULL, message, &error);
+        napi_reject_deferred(env, p->deferred, error);
+    }
     else
     {
-        LOG(stderr, "[Worker] TSFN released\n");
+        napi_value stats, value;
+        napi_create_object(env, &stats);
+        napi_create_double(env, (double)p->events, &value);
+        napi_set_named_property(env, stats, "events", value);
+        napi_create_double(env, (double)p->notes, &value);
+        napi_set_named_property(env, stats, "notes", value);
+        napi_create_double(env, p->duration_100ns / 10000.0, &value);
+        napi_set_named_property(env, stats, "durationMs", value);
+        napi_get_boolean(env, playback_control_stopped(&p->control), &value);
+        napi_set_named_property(env, stats, "stopped", value);
+        napi_resolve_deferred(env, p->deferred, stats);
+    }
+
+    // The promise alone owns the handle from now on
+    napi_delete_reference(env, p->promise_ref);
+    p->promise_ref = NULL;
+}
+
+static void PlayerFinalize(napi_env env, void *data, void *hint)
+{
+    (void)env;
+    (void)hint;
+    Player *p = (Player *)data;
+    if (p->mpp)
+    {
+        pthread_mutex_destroy(&p->mpp_lock);
+        pthread_cond_destroy(&p->mpp_wake);
+    }
+    free(p);
+}
+
+// —————————————————————————————————————————————————————————————————
+// Handle methods: stop(), pause(), resume(), setSpeed(multiplier)
+// —————————————————————————————————————————————————————————————————
+
+static Player *UnwrapPlayer(napi_env env, napi_callback_info info, size_t *argc, napi_value *argv)
+{
+    napi_value self;
+    Player *p = NULL;
+    if (napi_get_cb_info(env, info, argc, argv, &self, NULL) != napi_ok ||
+        napi_unwrap(env, self, (void **)&p) != napi_ok)
+    {
+        napi_throw_error(env, NULL, "Not a playback handle");
+        return NULL;
+    }
+    return p;
+}
+
+static napi_value Undefined(napi_env env)
+{
+    napi_value undef;
+    napi_get_undefined(env, &undef);
+    return undef;
+}
+
+static napi_value PlayerStop(napi_env env, napi_callback_info info)
+{
+    size_t argc = 0;
+    Player *p = UnwrapPlayer(env, info, &argc, NULL);
+    if (!p)
+        return NULL;
+    playback_control_stop(&p->control);
+    return Undefined(env);
+}
+
+static napi_value PlayerPause(napi_env env, napi_callback_info info)
+{
+    size_t argc = 0;
+    Player *p = UnwrapPlayer(env, info, &argc, NULL);
+    if (!p)
+        return NULL;
+    playback_control_pause(&p->control, true);
+    return Undefined(env);
+}
+
+static napi_value PlayerResume(napi_env env, napi_callback_info info)
+{
+    size_t argc = 0;
+    Player *p = UnwrapPlayer(env, info, &argc, NULL);
+    if (!p)
+        return NULL;
+    playback_control_pause(&p->control, false);
+    return Undefined(env);
+}
+
+static napi_value PlayerSetSpeed(napi_env env, napi_callback_info info)
+{
+    size_t argc = 1;
+    napi_value argv[1];
+    double speed;
+
+    Player *p = UnwrapPlayer(env, info, &argc, argv);
+    if (!p)
+        return NULL;
+    if (argc < 1 || napi_get_value_double(env, argv[0], &speed) != napi_ok || speed <= 0)
+    {
+        napi_throw_error(env, NULL, "Expected (multiplier: number > 0)");
+        return NULL;
+    }
+    playback_control_set_speed(&p->control, speed);
+    return Undefined(env);
+}
+
+// MPP packets are stamped with time + offset, e.g. client.serverTimeOffset
+static napi_value PlayerSetTimeOffset(napi_env env, napi_callback_info info)
+{
+    size_t argc = 1;
+    napi_value argv[1];
+    double offset;
+
+    Player *p = UnwrapPlayer(env, info, &argc, argv);
+    if (!p)
+        return NULL;
+    if (argc < 1 || napi_get_value_double(env, argv[0], &offset) != napi_ok)
+    {
+        napi_throw_error(env, NULL, "Expected (offsetMs: number)");
+        return NULL;
+    }
+    atomic_store(&p->mpp_time_offset_ms, (int64_t)offset);
+    return Undefined(env);
+}
+
+// —————————————————————————————————————————————————————————————————
+// Options: playMIDI(path, cb, minVelocity) or playMIDI(path, cb, { ... })
+// —————————————————————————————————————————————————————————————————
+
+static bool GetNamedNumber(napi_env env, napi_value obj, const char *name, double *out)
+{
+    bool has;
+    napi_value value;
+    if (napi_has_named_property(env, obj, name, &has) != napi_ok || !has)
+        return false;
+    if (napi_get_named_property(env, obj, name, &value) != napi_ok)
+        return false;
+    return napi_get_value_double(env, value, out) == napi_ok;
+}
+
+static bool GetNamedString(napi_env env, napi_value obj, const char *name, char *out, size_t size)
+{
+    bool has;
+    napi_value value;
+    if (napi_has_named_property(env, obj, name, &has) != napi_ok || !has)
+        return false;
+    if (napi_get_named_property(env, obj, name, &value) != napi_ok)
+        return false;
+    return napi_get_value_string_utf8(env, value, out, size, NULL) == napi_ok;
+}
+
+// The transform options take the command line syntax, or a plain number
+static bool GetNamedSpec(napi_env env, napi_value obj, const char *name, char *out, size_t size)
+{
+    double number;
+    if (GetNamedNumber(env, obj, name, &number))
+    {
+        snprintf(out, size, "%g", number);
+        return true;
+    }
+    return GetNamedString(env, obj, name, out, size);
+}
+
+static const struct
+{
+    const char *name;
+    bool (*parse)(TransformSpec *spec, const char *value);
+    const char *error;
+} transform_options[] = {
+    {"remap", transform_parse_remap, "remap must be like \"1:2,10:11\" (channels 1-16)"},
+    {"transpose", transform_parse_transpose, "transpose must be semitones, optionally followed by \":channels\""},
+    {"muteChannels", transform_parse_mute_channels, "muteChannels must be like \"10\" or \"1-4,9\""},
+    {"muteTracks", transform_parse_mute_tracks, "muteTracks must be like \"0,3-5\""},
+    {"velocityCurve", transform_parse_velocity_curve, "velocityCurve must be a gamma (0.1-10), optionally followed by \":scale\""},
+};
+
+// Returns an error message for invalid options, NULL when they are fine
+static const char *ParseOptions(napi_env env, napi_value arg, Player *p)
+{
+    napi_valuetype type;
+    if (napi_typeof(env, arg, &type) != napi_ok)
+        return NULL;
+
+    double number;
+    napi_value value;
+    bool has;
+    if (type == napi_number)
+    {
+        if (napi_get_value_double(env, arg, &number) == napi_ok)
+            p->options.min_velocity = number > 127 ? 127 : (number < 0 ? -1 : (int)number);
+    }
+    else if (type == napi_object)
+    {
+        if (GetNamedNumber(env, arg, "minVelocity", &number))
+            p->options.min_velocity = number > 127 ? 127 : (number < 0 ? -1 : (int)number);
+        if (GetNamedNumber(env, arg, "speed", &number) && number > 0)
+            p->speed = number;
+        if (napi_has_named_property(env, arg, "quiet", &has) == napi_ok && has &&
+            napi_get_named_property(env, arg, "quiet", &value) == napi_ok)
+            napi_get_value_bool(env, value, &p->options.quiet);
+        if (GetNamedNumber(env, arg, "coalesceWindowMs", &number) && number >= 0)
+        {
+            p->options.coalesce = true;
+            p->options.coalesce_window_100ns = (int64_t)(number * 10000);
+        }
+        if (napi_has_named_property(env, arg, "coalesce", &has) == napi_ok && has &&
+            napi_get_named_property(env, arg, "coalesce", &value) == napi_ok)
+            napi_get_value_bool(env, value, &p->options.coalesce);
+
+        char engine[16];
+        if (GetNamedString(env, arg, "engine", engine, sizeof(engine)) &&
+            !playback_engine_from_name(engine, &p->options.engine))
+            return "engine must be \"inline\" or \"buffered\"";
+        if (GetNamedNumber(env, arg, "parserThreads", &number) && number >= 0)
+            p->options.parser_threads = (int)number;
+
+        char overload[16];
+        if (GetNamedString(env, arg, "overload", overload, sizeof(overload)) &&
+            !overload_policy_from_name(overload, &p->options.overload))
+            return "overload must be \"off\", \"drop\" or \"thin\"";
+        if (GetNamedNumber(env, arg, "overloadThresholdMs", &number) && number > 0)
+            p->options.overload_threshold_100ns = (int64_t)(number * 10000);
+
+        char spec[256];
+        for (size_t i = 0; i < sizeof(transform_options) / sizeof(transform_options[0]); i++)
+        {
+            if (GetNamedSpec(env, arg, transform_options[i].name, spec, sizeof(spec)) &&
+                !transform_options[i].parse(&p->transform, spec))
+                return transform_options[i].error;
+        }
+
+        // output: "js" (default), "kdmapi", "alsa" or "mpp"; alsaPort implies "alsa"
+        char output[16] = "js";
+        GetNamedString(env, arg, "output", output, sizeof(output));
+        if (GetNamedString(env, arg, "alsaPort", p->alsa_port, sizeof(p->alsa_port)))
+            strcpy(output, "alsa");
+
+        if (strcmp(output, "kdmapi") == 0 || strcmp(output, "alsa") == 0)
+        {
+            p->native = true;
+            p->use_alsa = output[0] == 'a';
+            if (p->use_alsa && p->alsa_port[0] == '\0')
+                return "output \"alsa\" needs an alsaPort";
+        }
+        else if (strcmp(output, "mpp") == 0)
+        {
+            p->mpp = true;
+        }
+        else if (strcmp(output, "js") != 0)
+        {
+            return "output must be \"js\", \"kdmapi\", \"alsa\" or \"mpp\"";
+        }
+
+        // MPP packets: flushed every flushIntervalMs or at maxNotes notes
+        bool base64 = true;
+        p->mpp_base64 = true;
+        p->mpp_interval_ms = 200;
+        p->mpp_max_notes = 65000;
+        if (GetNamedNumber(env, arg, "noteOffset", &number))
+            p->mpp_note_offset = (int)number;
+        if (GetNamedNumber(env, arg, "flushIntervalMs", &number) && number >= 1)
+            p->mpp_interval_ms = (int64_t)number;
+        if (GetNamedNumber(env, arg, "maxNotes", &number) && number >= 1)
+            p->mpp_max_notes = number > (1 << 24) ? (1 << 24) : (uint32_t)number;
+        if (GetNamedNumber(env, arg, "timeOffsetMs", &number))
+            atomic_store(&p->mpp_time_offset_ms, (int64_t)number);
+        if (napi_has_named_property(env, arg, "base64", &has) == napi_ok && has &&
+            napi_get_named_property(env, arg, "base64", &value) == napi_ok &&
+            napi_get_value_bool(env, value, &base64) == napi_ok)
+            p->mpp_base64 = base64;
+
+        // The tap: at most tapMaxEvents every tapIntervalMs, extras are counted as dropped
+        p->tap_interval_100ns = 50 * 10000;
+        p->tap_max = 4096;
+        if (GetNamedNumber(env, arg, "tapIntervalMs", &number) && number >= 0)
+            p->tap_interval_100ns = (int64_t)(number * 10000);
+        if (GetNamedNumber(env, arg, "tapMaxEvents", &number) && number >= 1)
+            p->tap_max = number > (1 << 24) ? (1 << 24) : (uint32_t)number;
     }
-    g_tsfn = NULL;
     return NULL;
 }
 
 // —————————————————————————————————————————————————————————————————
-// N‑API binding for playMIDI(filePath, callback, [minVelocity])
+// N‑API binding for playMIDI(filePath, callback, [minVelocity | options])
+//
+// Returns a Promise for { events, notes, durationMs, stopped } that also
+// carries stop(), pause(), resume() and setSpeed(multiplier). Every call
+// gets its own thread, so several files can play at once.
+//
+// With { output: "kdmapi" } or { output: "alsa", alsaPort } the playback
+// thread sends to the native synth itself. The callback is then optional
+// and becomes a display tap, called with (Uint32Array events, dropped)
+// at most every tapIntervalMs.
+//
+// With { output: "mpp" } the callback receives finished MPP note-buffer
+// packets (base64 by default, a Buffer with base64: false) instead of
+// single events. The handle also gets setTimeOffset(ms).
+//
+// { quiet: true } turns off the notes-per-second log and a negative
+// minVelocity sends every note.
+//
+// { coalesce: true } drops controller, pitch bend and aftertouch messages
+// overwritten in the same tick; coalesceWindowMs widens that window.
+//
+// { engine: "buffered" } decodes on a separate thread ahead of the one
+// sending, which keeps dense files on time; "inline" is the default.
+// parserThreads splits its decoding over that many threads (0 picks by
+// the number of CPUs).
+//
+// { overload: "drop" } or "thin" sheds note-ons while playback is more
+// than overloadThresholdMs (default 50) behind, instead of playing late.
 // —————————————————————————————————————————————————————————————————
 
 napi_value PlayMIDI(napi_env env, napi_callback_info info)
@@ -178,106 +1015,312 @@ napi_value PlayMIDI(napi_env env, napi_callback_info info)
     if (st != napi_ok || argc < 2)
     {
         napi_throw_error(env, NULL,
-                         "Expected (filePath: string, callback: function, [minVelocity: number])");
+                         "Expected (filePath: string, callback: function, [minVelocity: number | options: object])");
         return NULL;
     }
 
+    Player *p = calloc(1, sizeof(Player));
+    if (!p)
+    {
+        napi_throw_error(env, NULL, "Out of memory");
+        return NULL;
+    }
+    playback_control_init(&p->control);
+    p->speed = 1.0;
+    p->options.bind_sink_thread = BindPlayerThread;
+    p->options.sink_context = p;
+    transform_spec_init(&p->transform);
+    p->options.transform = &p->transform;
+
     // — extract file path
-    char filepath[512];
     size_t path_len;
     st = napi_get_value_string_utf8(env, argv[0],
-                                    filepath, sizeof(filepath),
+                                    p->filepath, sizeof(p->filepath),
                                     &path_len);
     if (st != napi_ok)
     {
+        free(p);
         napi_throw_error(env, NULL, "Invalid filePath");
         return NULL;
     }
 
-    // — extract min velocity
-    uint8_t min_velocity = 0;
-    if (argc >= 3)
+    // — extract min velocity / options
+    const char *invalid = argc >= 3 ? ParseOptions(env, argv[2], p) : NULL;
+    if (invalid)
     {
-        uint32_t tmp;
-        st = napi_get_value_uint32(env, argv[2], &tmp);
-        if (st == napi_ok)
-        {
-            min_velocity = tmp > 127 ? 127 : (uint8_t)tmp;
-        }
+        free(p);
+        napi_throw_error(env, NULL, invalid);
+        return NULL;
     }
+    playback_control_set_speed(&p->control, p->speed);
 
-    // — create TSFN
-    napi_value resource_name;
-    st = napi_create_string_utf8(env, "midi_callback",
-                                 NAPI_AUTO_LENGTH,
-                                 &resource_name);
-    if (st != napi_ok)
+    // — the callback is required unless a native output plays the events
+    napi_valuetype cb_type;
+    napi_typeof(env, argv[1], &cb_type);
+    napi_value callback = cb_type == napi_function ? argv[1] : NULL;
+    if (!callback && !p->native)
+    {
+        free(p);
+        napi_throw_error(env, NULL, "callback must be a function");
+        return NULL;
+    }
+    if (callback && p->native)
+    {
+        p->tap = TapAlloc(p->tap_max);
+    }
+    if (p->mpp)
+    {
+        pthread_mutex_init(&p->mpp_lock, NULL);
+        pthread_cond_init(&p->mpp_wake, NULL);
+    }
+
+    // — the promise doubles as the handle object
+    napi_value promise;
+    st = napi_create_promise(env, &p->deferred, &promise);
+    if (st != napi_ok || napi_wrap(env, promise, p, PlayerFinalize, NULL, NULL) != napi_ok)
     {
-        napi_throw_error(env, NULL, "Failed to create resource name");
+        free(p);
+        napi_throw_error(env, NULL, "Failed to create promise");
         return NULL;
     }
 
+    const napi_property_attributes attrs = napi_writable | napi_configurable;
+    napi_property_descriptor methods[] = {
+        {"stop",     NULL, PlayerStop,     NULL, NULL, NULL, attrs, NULL},
+        {"pause",    NULL, PlayerPause,    NULL, NULL, NULL, attrs, NULL},
+        {"resume",   NULL, PlayerResume,   NULL, NULL, NULL, attrs, NULL},
+        {"setSpeed", NULL, PlayerSetSpeed, NULL, NULL, NULL, attrs, NULL},
+        {"setTimeOffset", NULL, PlayerSetTimeOffset, NULL, NULL, NULL, attrs, NULL},
+    };
+    napi_define_properties(env, promise, sizeof(methods) / sizeof(methods[0]), methods);
+
+    // — create TSFN; its finalizer settles the promise
+    napi_value resource_name;
+    napi_create_string_utf8(env, "midi_callback", NAPI_AUTO_LENGTH, &resource_name);
+
     st = napi_create_threadsafe_function(
         env,
-        argv[1],       // JS callback
-        NULL,          // async_resource
-        resource_name, // resource name
-        0,             // max queue size (0 = unlimited)
-        1,             // initial thread count
-        NULL,          // thread finalize data
-        NULL,          // thread finalize cb
-        NULL,          // context for CallJs
-        CallJs,        // call_js_cb
-        &g_tsfn);
+        callback,         // JS callback, NULL for native output without a tap
+        NULL,             // async_resource
+        resource_name,    // resource name
+        0,                // max queue size (0 = unlimited)
+        1,                // initial thread count: the playback thread
+        p,                // thread finalize data
+        PlaybackFinished, // thread finalize cb
+        p,                // context for call_js_cb
+        p->native ? CallJsTap : p->mpp ? CallJsPacket : CallJs,
+        &p->tsfn);
     if (st != napi_ok)
     {
+        free(p->tap);
+        p->tap = NULL;
         napi_throw_error(env, NULL, "Failed to create TSFN");
         return NULL;
     }
 
-    // MUST acquire it before using
-    st = napi_acquire_threadsafe_function(g_tsfn);
-    if (st != napi_ok)
+    napi_create_reference(env, promise, 1, &p->promise_ref);
+
+    // — spawn the worker; the file is loaded there, off the JS thread
+    pthread_t tid;
+    if (pthread_create(&tid, NULL, PlayMidiWorker, p) != 0)
     {
-        napi_throw_error(env, NULL, "Failed to acquire TSFN");
-        return NULL;
+        free(p->tap);
+        p->tap = NULL;
+        p->error = "Failed to start playback thread";
+        napi_release_threadsafe_function(p->tsfn, napi_tsfn_release);
+        return promise;
     }
+    pthread_detach(tid);
+
+    return promise;
+}
+
+// —————————————————————————————————————————————————————————————————
+// loadNoteIndex(filePath) → Promise<NoteIndex> for piano rolls:
+// index.query(fromMs, toMs) returns the notes sounding in that range as
+// typed arrays { start, end (ms), key, velocity, channel, track }
+// —————————————————————————————————————————————————————————————————
 
-    // — load the MIDI file
-    uint16_t time_div;
-    int track_count;
-    TrackData *tracks = load_midi_file(filepath, &time_div, &track_count);
+typedef struct
+{
+    char filepath[512];
+    napi_async_work work;
+    napi_deferred deferred;
+    NoteIndex *index;   // built off the JS thread, owned by the JS object once resolved
+    const char *error;
+
+    // Query results, reused from call to call
+    size_t *hits;
+    size_t hit_capacity;
+} NoteIndexHandle;
+
+static void NoteIndexFinalize(napi_env env, void *data, void *hint)
+{
+    (void)env;
+    (void)hint;
+    NoteIndexHandle *h = (NoteIndexHandle *)data;
+    note_index_free(h->index);
+    free(h->hits);
+    free(h);
+}
+
+static void BuildNoteIndex(napi_env env, void *data)
+{
+    (void)env;
+    NoteIndexHandle *h = (NoteIndexHandle *)data;
+    uint16_t time_div = 0;
+    int track_count = 0;
+    TrackData *tracks = load_midi_file(h->filepath, &time_div, &track_count);
     if (!tracks)
     {
-        napi_throw_error(env, NULL, "Failed to load MIDI file");
-        napi_release_threadsafe_function(g_tsfn, napi_tsfn_release);
-        g_tsfn = NULL;
+        h->error = "Failed to load MIDI file";
+        return;
+    }
+    h->index = note_index_build(tracks, track_count, time_div);
+    if (!h->index)
+        h->error = "Not enough memory to index the notes";
+    free_tracks(tracks, track_count);
+}
+
+static napi_value NoteColumn(napi_env env, napi_typedarray_type type, size_t element, size_t count, void **data)
+{
+    napi_value buffer, array;
+    if (napi_create_arraybuffer(env, count * element, data, &buffer) != napi_ok ||
+        napi_create_typedarray(env, type, count, buffer, 0, &array) != napi_ok)
+        return NULL;
+    return array;
+}
+
+static napi_value NoteIndexQuery(napi_env env, napi_callback_info info)
+{
+    size_t argc = 2;
+    napi_value argv[2], self;
+    NoteIndexHandle *h = NULL;
+    double from_ms, to_ms;
+    if (napi_get_cb_info(env, info, &argc, argv, &self, NULL) != napi_ok ||
+        napi_unwrap(env, self, (void **)&h) != napi_ok)
+    {
+        napi_throw_error(env, NULL, "Not a note index");
+        return NULL;
+    }
+    if (argc < 2 || napi_get_value_double(env, argv[0], &from_ms) != napi_ok ||
+        napi_get_value_double(env, argv[1], &to_ms) != napi_ok)
+    {
+        napi_throw_error(env, NULL, "Expected (fromMs: number, toMs: number)");
         return NULL;
     }
 
-    // — spawn the worker
-    WorkerArgs *w = malloc(sizeof(*w));
-    w->tracks = tracks;
-    w->track_count = track_count;
-    w->time_div = time_div;
-    w->min_velocity = min_velocity;
+    const NoteIndex *index = h->index;
+    size_t count = note_index_query(index, (int64_t)(from_ms * 10000), (int64_t)(to_ms * 10000),
+                                    &h->hits, &h->hit_capacity);
+    if (count == (size_t)-1)
+    {
+        napi_throw_error(env, NULL, "Out of memory");
+        return NULL;
+    }
 
-    pthread_t tid;
-    if (pthread_create(&tid, NULL, PlayMidiWorker, w) != 0)
+    double *start, *end;
+    uint8_t *key, *velocity, *channel;
+    uint32_t *track;
+    napi_value columns[6], result;
+    columns[0] = NoteColumn(env, napi_float64_array, sizeof(double), count, (void **)&start);
+    columns[1] = NoteColumn(env, napi_float64_array, sizeof(double), count, (void **)&end);
+    columns[2] = NoteColumn(env, napi_uint8_array, 1, count, (void **)&key);
+    columns[3] = NoteColumn(env, napi_uint8_array, 1, count, (void **)&velocity);
+    columns[4] = NoteColumn(env, napi_uint8_array, 1, count, (void **)&channel);
+    columns[5] = NoteColumn(env, napi_uint32_array, sizeof(uint32_t), count, (void **)&track);
+    for (int i = 0; i < 6; i++)
+    {
+        if (!columns[i])
+        {
+            napi_throw_error(env, NULL, "Out of memory");
+            return NULL;
+        }
+    }
+
+    for (size_t i = 0; i < count; i++)
     {
-        napi_throw_error(env, NULL, "Failed to create worker thread");
-        free_tracks(tracks, track_count);
-        free(w);
-        napi_release_threadsafe_function(g_tsfn, napi_tsfn_release);
-        g_tsfn = NULL;
+        size_t at = h->hits[i];
+        start[i] = index->start_100ns[at] / 10000.0;
+        end[i] = index->end_100ns[at] / 10000.0;
+        key[i] = index->key[at];
+        velocity[i] = index->velocity[at];
+        channel[i] = index->channel[at];
+        track[i] = index->track[at];
+    }
+
+    static const char *const names[6] = {"start", "end", "key", "velocity", "channel", "track"};
+    napi_create_object(env, &result);
+    for (int i = 0; i < 6; i++)
+        napi_set_named_property(env, result, names[i], columns[i]);
+    return result;
+}
+
+static void NoteIndexBuilt(napi_env env, napi_status status, void *data)
+{
+    NoteIndexHandle *h = (NoteIndexHandle *)data;
+    napi_delete_async_work(env, h->work);
+
+    napi_value object, value;
+    if (status != napi_ok || h->error || napi_create_object(env, &object) != napi_ok ||
+        napi_wrap(env, object, h, NoteIndexFinalize, NULL, NULL) != napi_ok)
+    {
+        napi_value message, error;
+        napi_create_string_utf8(env, h->error ? h->error : "Failed to build the note index",
+                                NAPI_AUTO_LENGTH, &message);
+        napi_create_error(env, NULL, message, &error);
+        napi_reject_deferred(env, h->deferred, error);
+        NoteIndexFinalize(env, h, NULL);
+        return;
+    }
+
+    napi_create_double(env, (double)h->index->count, &value);
+    napi_set_named_property(env, object, "count", value);
+    napi_create_double(env, h->index->duration_100ns / 10000.0, &value);
+    napi_set_named_property(env, object, "durationMs", value);
+    napi_create_double(env, (double)h->index->build_ms, &value);
+    napi_set_named_property(env, object, "buildMs", value);
+
+    napi_property_descriptor methods[] = {
+        {"query", NULL, NoteIndexQuery, NULL, NULL, NULL, napi_default, NULL},
+    };
+    napi_define_properties(env, object, 1, methods);
+    napi_resolve_deferred(env, h->deferred, object);
+}
+
+static napi_value LoadNoteIndex(napi_env env, napi_callback_info info)
+{
+    size_t argc = 1;
+    napi_value argv[1], promise, name;
+    if (napi_get_cb_info(env, info, &argc, argv, NULL, NULL) != napi_ok || argc < 1)
+    {
+        napi_throw_error(env, NULL, "Expected (filePath: string)");
         return NULL;
     }
-    pthread_detach(tid);
 
-    // return undefined
-    napi_value undef;
-    napi_get_undefined(env, &undef);
-    return undef;
+    NoteIndexHandle *h = calloc(1, sizeof(NoteIndexHandle));
+    if (!h)
+    {
+        napi_throw_error(env, NULL, "Out of memory");
+        return NULL;
+    }
+    if (napi_get_value_string_utf8(env, argv[0], h->filepath, sizeof(h->filepath), NULL) != napi_ok)
+    {
+        free(h);
+        napi_throw_error(env, NULL, "Invalid filePath");
+        return NULL;
+    }
+
+    napi_create_promise(env, &h->deferred, &promise);
+    napi_create_string_utf8(env, "loadNoteIndex", NAPI_AUTO_LENGTH, &name);
+    if (napi_create_async_work(env, NULL, name, BuildNoteIndex, NoteIndexBuilt, h, &h->work) != napi_ok ||
+        napi_queue_async_work(env, h->work) != napi_ok)
+    {
+        free(h);
+        napi_throw_error(env, NULL, "Failed to start indexing");
+        return NULL;
+    }
+    return promise;
 }
 
 // —————————————————————————————————————————————————————————————————
@@ -289,6 +1332,8 @@ napi_value Init(napi_env env, napi_value exports)
     napi_value fn;
     napi_create_function(env, NULL, 0, PlayMIDI, NULL, &fn);
     napi_set_named_property(env, exports, "playMIDI", fn);
+    napi_create_function(env, NULL, 0, LoadNoteIndex, NULL, &fn);
+    napi_set_named_property(env, exports, "loadNoteIndex", fn);
     return exports;
 }
 
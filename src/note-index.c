@@ -0,0 +1,395 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>
+
+#include "note-index.h"
+#include "tempo-map.h"
+#include "midi-utils.h"
+
+#define OPEN UINT64_MAX   // end_tick of a note still waiting for its note-off
+
+// A note while pairing, before the tempo map is known
+typedef struct {
+    uint64_t start_tick;
+    uint64_t end_tick;
+    size_t next_open;     // index + 1 of the next held note on the same key
+    uint8_t key, velocity, channel;
+} TickNote;
+
+typedef struct {
+    TickNote* notes;      // in note-on order, so sorted by start
+    size_t count, capacity;
+    TempoEvent* tempo;
+    int tempo_count, tempo_capacity;
+    uint64_t last_tick;
+} TrackNotes;
+
+typedef struct {
+    const TrackData* tracks;
+    int track_count;
+    TrackNotes* out;
+    _Atomic int next_track;
+    atomic_bool failed;
+} Pairing;
+
+static bool add_tempo(TrackNotes* t, uint64_t tick, int track, uint32_t bpm) {
+    if (t->tempo_count == t->tempo_capacity) {
+        int capacity = t->tempo_capacity ? t->tempo_capacity * 2 : 16;
+        TempoEvent* grown = realloc(t->tempo, capacity * sizeof(TempoEvent));
+        if (!grown) return false;
+        t->tempo = grown;
+        t->tempo_capacity = capacity;
+    }
+    t->tempo[t->tempo_count++] = (TempoEvent){ tick, track, bpm };
+    return true;
+}
+
+// Decodes one track on a private cursor and pairs its notes. head and tail
+// hold, per channel and key, index + 1 of the oldest and newest held note;
+// they are all 0 again when this returns.
+static bool pair_track(const TrackData* track, int index, TrackNotes* out,
+                       size_t* head, size_t* tail, uint8_t** scratch, size_t* scratch_capacity) {
+    TrackData t = *track;
+    t.long_msg = *scratch;
+    t.long_msg_capacity = *scratch_capacity;
+    bool ok = true;
+
+    while (ok) {
+        update_command(&t);
+        update_message(&t);
+        uint32_t message = t.message;
+        uint8_t status = message & 0xFF;
+        if ((message & 0xFFFF) == 0x2FFF) break;   // end of track
+
+        uint8_t type = status & 0xF0;
+        uint8_t velocity = (message >> 16) & 0xFF;
+        if (type == 0x90 && velocity > 0) {
+            if (out->count == out->capacity) {
+                size_t capacity = out->capacity ? out->capacity * 2 : 1024;
+                TickNote* grown = realloc(out->notes, capacity * sizeof(TickNote));
+                if (!grown) { ok = false; break; }
+                out->notes = grown;
+                out->capacity = capacity;
+            }
+            size_t slot = (status & 0x0F) << 7 | ((message >> 8) & 0x7F);
+            out->notes[out->count] = (TickNote){
+                t.tick, OPEN, 0, (message >> 8) & 0x7F, velocity, status & 0x0F
+            };
+            out->count++;
+            if (tail[slot]) out->notes[tail[slot] - 1].next_open = out->count;
+            else head[slot] = out->count;
+            tail[slot] = out->count;
+        } else if (type == 0x80 || type == 0x90) {
+            size_t slot = (status & 0x0F) << 7 | ((message >> 8) & 0x7F);
+            if (head[slot]) {
+                TickNote* note = &out->notes[head[slot] - 1];
+                note->end_tick = t.tick;
+                head[slot] = note->next_open;
+                if (!head[slot]) tail[slot] = 0;
+            }
+        } else if (status == 0xFF && ((message >> 8) & 0xFF) == 0x51 && t.long_msg_len >= 3) {
+            ok = add_tempo(out, t.tick, index,
+                           (t.long_msg[0] << 16) | (t.long_msg[1] << 8) | t.long_msg[2]);
+        }
+        update_tick(&t);
+    }
+    out->last_tick = t.tick;
+
+    // Notes never released end with their track
+    for (size_t i = 0; i < out->count; i++) {
+        TickNote* note = &out->notes[i];
+        if (note->end_tick != OPEN) continue;
+        note->end_tick = t.tick;
+        size_t slot = (size_t)note->channel << 7 | note->key;
+        head[slot] = tail[slot] = 0;
+    }
+
+    *scratch = t.long_msg;
+    *scratch_capacity = t.long_msg_capacity;
+    return ok;
+}
+
+static void* pair_worker(void* arg) {
+    Pairing* p = arg;
+    size_t* head = calloc(2 * 16 * 128, sizeof(size_t));
+    size_t* tail = head ? head + 16 * 128 : NULL;
+    size_t scratch_capacity = 256;
+    uint8_t* scratch = malloc(scratch_capacity);
+
+    int i;
+    while (head && scratch && !atomic_load(&p->failed) &&
+           (i = atomic_fetch_add(&p->next_track, 1)) < p->track_count) {
+        if (!p->tracks[i].data) continue;
+        if (!pair_track(&p->tracks[i], i, &p->out[i], head, tail, &scratch, &scratch_capacity)) {
+            atomic_store(&p->failed, true);
+        }
+    }
+    if (!head || !scratch) atomic_store(&p->failed, true);
+
+    free(scratch);
+    free(head);
+    return NULL;
+}
+
+// Builds the latest-end augmentation of the implicit tree: node i sits at
+// level k when its k lowest bits are 1, its children are i -/+ 2^(k-1).
+// Subtrees that run past the end borrow the last value, so the tree above
+// them stays correct. Returns the height.
+static int build_tree(NoteIndex* index) {
+    size_t n = index->count;
+    int64_t* max_end = index->max_end_100ns;
+    if (n == 0) return -1;
+
+    size_t last_i = 0;
+    int64_t last = 0;
+    for (size_t i = 0; i < n; i += 2) {
+        last_i = i;
+        last = max_end[i] = index->end_100ns[i];
+    }
+    int k = 1;
+    for (; (size_t)1 << k <= n; k++) {
+        size_t x = (size_t)1 << (k - 1);
+        for (size_t i = (x << 1) - 1; i < n; i += x << 2) {
+            int64_t end = index->end_100ns[i];
+            int64_t left = max_end[i - x];
+            int64_t right = i + x < n ? max_end[i + x] : last;
+            if (left > end) end = left;
+            if (right > end) end = right;
+            max_end[i] = end;
+        }
+        // Move last_i up to its parent
+        last_i = (last_i >> k & 1) ? last_i - x : last_i + x;
+        if (last_i < n && max_end[last_i] > last) last = max_end[last_i];
+    }
+    return k - 1;
+}
+
+// Min-heap of tracks by their next unmerged note, ties in track order
+typedef struct {
+    int* tracks;
+    int count;
+    TrackNotes* notes;
+    size_t* next;
+} MergeHeap;
+
+static inline bool merge_before(const MergeHeap* h, int a, int b) {
+    uint64_t ta = h->notes[a].notes[h->next[a]].start_tick;
+    uint64_t tb = h->notes[b].notes[h->next[b]].start_tick;
+    return ta != tb ? ta < tb : a < b;
+}
+
+static void merge_sift_down(MergeHeap* h, int at) {
+    while (true) {
+        int smallest = at;
+        int left = 2 * at + 1, right = left + 1;
+        if (left < h->count && merge_before(h, h->tracks[left], h->tracks[smallest])) smallest = left;
+        if (right < h->count && merge_before(h, h->tracks[right], h->tracks[smallest])) smallest = right;
+        if (smallest == at) return;
+        int swap = h->tracks[at];
+        h->tracks[at] = h->tracks[smallest];
+        h->tracks[smallest] = swap;
+        at = smallest;
+    }
+}
+
+// Merges the per-track lists into the sorted columns, converting to song time
+static void merge_tracks(NoteIndex* index, TrackNotes* notes, int track_count,
+                         const TempoMap* tempo_map, int* heap_tracks, size_t* next) {
+    MergeHeap h = { heap_tracks, 0, notes, next };
+    for (int i = 0; i < track_count; i++) {
+        next[i] = 0;
+        if (notes[i].count) h.tracks[h.count++] = i;
+    }
+    for (int at = h.count / 2 - 1; at >= 0; at--) merge_sift_down(&h, at);
+
+    int start_cursor = 0, end_cursor = 0;
+    for (size_t out = 0; h.count > 0; out++) {
+        int track = h.tracks[0];
+        const TickNote* note = &notes[track].notes[next[track]++];
+        index->start_100ns[out] = tempo_map_time(tempo_map, note->start_tick, &start_cursor);
+        index->end_100ns[out] = tempo_map_time(tempo_map, note->end_tick, &end_cursor);
+        index->key[out] = note->key;
+        index->velocity[out] = note->velocity;
+        index->channel[out] = note->channel;
+        index->track[out] = (uint32_t)track;
+
+        if (next[track] == notes[track].count) h.tracks[0] = h.tracks[--h.count];
+        merge_sift_down(&h, 0);
+    }
+}
+
+NoteIndex* note_index_build(const TrackData* tracks, int track_count, uint16_t time_div) {
+    int64_t start_time = getTime100ns();
+    NoteIndex* index = calloc(1, sizeof(NoteIndex));
+    Pairing p = { .tracks = tracks, .track_count = track_count };
+    TempoEvent* tempo = NULL;
+    TempoMap tempo_map = { 0 };
+    int* heap_tracks = NULL;
+    size_t* next = NULL;
+    if (!index) return NULL;
+    index->max_level = -1;
+
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    index->threads = (int)(cpus < 1 ? 1 : cpus);
+    if (index->threads > track_count) index->threads = track_count > 0 ? track_count : 1;
+
+    p.out = calloc(track_count ? track_count : 1, sizeof(TrackNotes));
+    pthread_t* ids = malloc(index->threads * sizeof(pthread_t));
+    if (!p.out || !ids) {
+        free(ids);
+        goto fail;
+    }
+
+    // Pass 1, in parallel: pair each track's notes, collect tempo changes
+    int started = 0;
+    for (; started < index->threads; started++) {
+        if (pthread_create(&ids[started], NULL, pair_worker, &p) != 0) break;
+    }
+    if (started == 0) pair_worker(&p);
+    for (int t = 0; t < started; t++) pthread_join(ids[t], NULL);
+    free(ids);
+    if (atomic_load(&p.failed)) goto fail;
+
+    int tempo_total = 0;
+    uint64_t last_tick = 0;
+    for (int i = 0; i < track_count; i++) {
+        index->count += p.out[i].count;
+        tempo_total += p.out[i].tempo_count;
+        if (p.out[i].last_tick > last_tick) last_tick = p.out[i].last_tick;
+    }
+    tempo = malloc((tempo_total ? tempo_total : 1) * sizeof(TempoEvent));
+    if (!tempo) goto fail;
+    for (int i = 0, n = 0; i < track_count; i++) {
+        if (p.out[i].tempo_count) memcpy(&tempo[n], p.out[i].tempo, p.out[i].tempo_count * sizeof(TempoEvent));
+        n += p.out[i].tempo_count;
+    }
+    if (!tempo_map_build(&tempo_map, tempo, tempo_total, time_div)) goto fail;
+    int cursor = 0;
+    index->duration_100ns = tempo_map_time(&tempo_map, last_tick, &cursor);
+
+    // Pass 2: one sorted set of columns in song time, then the tree
+    size_t n = index->count ? index->count : 1;
+    index->start_100ns = malloc(n * sizeof(int64_t));
+    index->end_100ns = malloc(n * sizeof(int64_t));
+    index->max_end_100ns = malloc(n * sizeof(int64_t));
+    index->key = malloc(n);
+    index->velocity = malloc(n);
+    index->channel = malloc(n);
+    index->track = malloc(n * sizeof(uint32_t));
+    heap_tracks = malloc((track_count ? track_count : 1) * sizeof(int));
+    next = malloc((track_count ? track_count : 1) * sizeof(size_t));
+    if (!index->start_100ns || !index->end_100ns || !index->max_end_100ns || !index->key ||
+        !index->velocity || !index->channel || !index->track || !heap_tracks || !next) {
+        goto fail;
+    }
+
+    merge_tracks(index, p.out, track_count, &tempo_map, heap_tracks, next);
+    index->max_level = build_tree(index);
+    index->build_ms = (long)((getTime100ns() - start_time) / 10000);
+
+    free(heap_tracks);
+    free(next);
+    free(tempo);
+    tempo_map_free(&tempo_map);
+    for (int i = 0; i < track_count; i++) {
+        free(p.out[i].notes);
+        free(p.out[i].tempo);
+    }
+    free(p.out);
+    return index;
+
+fail:
+    fprintf(stderr, "mplayer: Not enough memory to index the notes\n");
+    free(heap_tracks);
+    free(next);
+    free(tempo);
+    tempo_map_free(&tempo_map);
+    if (p.out) {
+        for (int i = 0; i < track_count; i++) {
+            free(p.out[i].notes);
+            free(p.out[i].tempo);
+        }
+    }
+    free(p.out);
+    note_index_free(index);
+    return NULL;
+}
+
+void note_index_free(NoteIndex* index) {
+    if (!index) return;
+    free(index->start_100ns);
+    free(index->end_100ns);
+    free(index->max_end_100ns);
+    free(index->key);
+    free(index->velocity);
+    free(index->channel);
+    free(index->track);
+    free(index);
+}
+
+static inline bool add_hit(size_t** hits, size_t* capacity, size_t count, size_t position) {
+    if (count == *capacity) {
+        size_t grown_capacity = *capacity ? *capacity * 2 : 256;
+        size_t* grown = realloc(*hits, grown_capacity * sizeof(size_t));
+        if (!grown) return false;
+        *hits = grown;
+        *capacity = grown_capacity;
+    }
+    (*hits)[count] = position;
+    return true;
+}
+
+size_t note_index_query(const NoteIndex* index, int64_t from_100ns, int64_t to_100ns,
+                        size_t** hits, size_t* capacity) {
+    size_t n = index->count;
+    size_t count = 0;
+    if (index->max_level < 0 || from_100ns > to_100ns) return 0;
+
+    // In-order walk from the root. A left subtree is skipped when nothing
+    // in it lasts until from, everything right of a node starting after to
+    // is skipped; small subtrees are scanned instead of walked.
+    struct { size_t x; int k; bool left_done; } stack[64];
+    int top = 0;
+    stack[top].x = ((size_t)1 << index->max_level) - 1;
+    stack[top].k = index->max_level;
+    stack[top++].left_done = false;
+
+    while (top) {
+        size_t x = stack[--top].x;
+        int k = stack[top].k;
+        bool left_done = stack[top].left_done;
+
+        if (k <= 3) {
+            size_t first = x >> k << k;
+            size_t last = first + ((size_t)1 << (k + 1)) - 1;
+            if (last > n) last = n;
+            for (size_t i = first; i < last && index->start_100ns[i] <= to_100ns; i++) {
+                if (index->end_100ns[i] >= from_100ns && !add_hit(hits, capacity, count++, i)) {
+                    return (size_t)-1;
+                }
+            }
+        } else if (!left_done) {
+            size_t left = x - ((size_t)1 << (k - 1));   // may lie past the end
+            stack[top].x = x;
+            stack[top].k = k;
+            stack[top++].left_done = true;
+            if (left >= n || index->max_end_100ns[left] >= from_100ns) {
+                stack[top].x = left;
+                stack[top].k = k - 1;
+                stack[top++].left_done = false;
+            }
+        } else if (x < n && index->start_100ns[x] <= to_100ns) {
+            if (index->end_100ns[x] >= from_100ns && !add_hit(hits, capacity, count++, x)) {
+                return (size_t)-1;
+            }
+            stack[top].x = x + ((size_t)1 << (k - 1));
+            stack[top].k = k - 1;
+            stack[top++].left_done = false;
+        }
+    }
+    return count;
+}
@@ -0,0 +1,37 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "overload.h"
+
+void overload_init(OverloadGuard* guard, OverloadPolicy policy, int64_t threshold_100ns) {
+    memset(guard, 0, sizeof(*guard));
+    guard->policy = policy;
+    guard->threshold_100ns = threshold_100ns > 0 ? threshold_100ns : 1;
+}
+
+void overload_report(OverloadGuard* guard, int64_t now_100ns) {
+    if (guard->velocity_cut) {
+        guard->overloaded_100ns += now_100ns - guard->started_100ns;
+        guard->velocity_cut = 0;
+    }
+    if (guard->episodes == 0) return;
+    printf("mplayer: Fell behind %llu times for %.1f ms in all (at worst %.1f ms late), dropped %llu note-ons\n",
+           (unsigned long long)guard->episodes, guard->overloaded_100ns / 1e4,
+           guard->worst_100ns / 1e4, (unsigned long long)guard->dropped);
+}
+
+static const char* const policy_names[] = {
+    [OVERLOAD_OFF]  = "off",
+    [OVERLOAD_DROP] = "drop",
+    [OVERLOAD_THIN] = "thin",
+};
+
+bool overload_policy_from_name(const char* name, OverloadPolicy* policy) {
+    for (int i = 0; i < (int)(sizeof(policy_names) / sizeof(policy_names[0])); i++) {
+        if (strcmp(name, policy_names[i]) == 0) {
+            *policy = (OverloadPolicy)i;
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,129 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "playlist.h"
+#include "midi.h"
+
+static bool wait_playable(LoadedMidi* file) {
+    return file->stream &&
+        midi_stream_wait_playable(file->stream, &file->tracks, &file->time_div, &file->track_count);
+}
+
+static void* prefetch_thread_fn(void* arg) {
+    MidiPrefetch* pf = arg;
+    pf->loaded = wait_playable(&pf->file);
+    if (pf->loaded) {
+        // Decoding waits on the load where it catches up with it
+        pf->options.loading = pf->file.stream;
+        pf->file.decoded = buffered_prepare(pf->file.tracks, pf->file.track_count, pf->file.time_div,
+                                            &pf->options);
+    }
+    return NULL;
+}
+
+void prefetch_start(MidiPrefetch* pf, const char* filename, const PlaybackOptions* options) {
+    pf->file = (LoadedMidi){ .filename = filename, .stream = midi_stream_start(filename) };
+    pf->loaded = false;
+    // Only the buffered engine decodes ahead; the inline one decodes as it sends
+    pf->threaded = false;
+    if (pf->file.stream && options && options->engine == PLAYBACK_ENGINE_BUFFERED) {
+        pf->options = *options;
+        pf->threaded = pthread_create(&pf->thread, NULL, prefetch_thread_fn, pf) == 0;
+    }
+}
+
+bool prefetch_finish(MidiPrefetch* pf, LoadedMidi* out) {
+    if (pf->threaded) {
+        pthread_join(pf->thread, NULL);
+        pf->threaded = false;
+    } else {
+        pf->loaded = wait_playable(&pf->file);
+    }
+    *out = pf->file;   // ownership moves to the caller
+    pf->file.stream = NULL;
+    pf->file.decoded = NULL;
+
+    if (pf->loaded) {
+        return true;
+    }
+    midi_stream_close(out->stream);
+    out->stream = NULL;
+    return false;
+}
+
+void loaded_midi_free(LoadedMidi* loaded) {
+    // The decoder reads the tracks, and the loader may still be writing them
+    buffered_discard(loaded->decoded);
+    loaded->decoded = NULL;
+    midi_stream_close(loaded->stream);
+    loaded->stream = NULL;
+    free_tracks(loaded->tracks, loaded->track_count);
+    loaded->tracks = NULL;
+}
+
+int playlist_read(const char* path, char*** entries) {
+    FILE* file = fopen(path, "r");
+    if (!file) {
+        fprintf(stderr, "Could not open playlist: %s\n", path);
+        return -1;
+    }
+
+    // Directory prefix for relative entries
+    const char* slash = strrchr(path, '/');
+    size_t dir_len = slash ? (size_t)(slash - path + 1) : 0;
+
+    int count = 0, capacity = 16;
+    char** list = malloc(capacity * sizeof(char*));
+    char line[4096];
+    bool failed = !list;
+
+    while (!failed && fgets(line, sizeof(line), file)) {
+        char* start = line;
+        while (isspace((unsigned char)*start)) start++;
+        char* end = start + strlen(start);
+        while (end > start && isspace((unsigned char)end[-1])) end--;
+        *end = '\0';
+
+        if (*start == '\0' || *start == '#') continue;
+
+        if (count == capacity) {
+            char** grown = realloc(list, capacity * 2 * sizeof(char*));
+            if (!grown) {
+                failed = true;
+                break;
+            }
+            list = grown;
+            capacity *= 2;
+        }
+
+        size_t prefix = (*start == '/') ? 0 : dir_len;
+        char* entry = malloc(prefix + strlen(start) + 1);
+        if (!entry) {
+            failed = true;
+            break;
+        }
+        memcpy(entry, path, prefix);
+        strcpy(entry + prefix, start);
+        list[count++] = entry;
+    }
+    fclose(file);
+
+    if (failed) {
+        fprintf(stderr, "Memory allocation failed\n");
+        playlist_free(list, count);
+        return -1;
+    }
+
+    *entries = list;
+    return count;
+}
+
+void playlist_free(char** entries, int count) {
+    if (!entries) return;
+    for (int i = 0; i < count; i++) {
+        free(entries[i]);
+    }
+    free(entries);
+}
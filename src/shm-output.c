@@ -0,0 +1,31 @@
+#include <stdio.h>
+
+#include "shm-output.h"
+#include "shm-ring.h"
+#include "midi-utils.h"
+
+static ShmRing* ring = NULL;
+
+bool shm_output_initialize(const char* name) {
+    ring = shm_ring_create(name, SHM_RING_DEFAULT_CAPACITY,
+                           virtual_clock_enabled() ? SHM_RING_CLOCK_VIRTUAL : SHM_RING_CLOCK_MONOTONIC);
+    if (!ring) {
+        return false;
+    }
+    printf("mplayer: Sending to shared memory ring %s\n", name);
+    return true;
+}
+
+void shm_output_send(uint32_t message) {
+    shm_ring_push(ring, getTime100ns(), message);
+}
+
+void shm_output_shutdown(void) {
+    ShmRingStats stats;
+    shm_ring_stats(ring, &stats);
+    printf("mplayer: Shared memory ring: %llu messages, %llu wakeups, %llu dropped\n",
+           (unsigned long long)stats.events, (unsigned long long)stats.wakeups,
+           (unsigned long long)stats.dropped);
+    shm_ring_destroy(ring);
+    ring = NULL;
+}
@@ -0,0 +1,293 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "shm-ring.h"
+
+#define SHM_RING_MAGIC        "MPRING01"
+#define MIN_CAPACITY          1024u
+#define MAX_CAPACITY          (1u << 26)
+#define PRODUCER_WAIT_100NS   10000000LL   // 1 s for a stuck consumer
+
+// The shared segment. head and tail count events and never wrap; each is
+// written by one side only and sits on its own cache line. The two futex
+// words are set by the side going to sleep and cleared by the side waking
+// it, which only looks at them after publishing its own index.
+typedef struct {
+    char magic[8];            // written last, once the ring is set up
+    uint32_t capacity;
+    uint32_t clock;           // ShmRingClock
+    uint8_t pad0[48];
+
+    _Atomic uint64_t head;               // producer
+    _Atomic uint32_t producer_waiting;   // futex: producer sleeps on a full ring
+    _Atomic uint32_t closed;
+    uint8_t pad1[48];
+
+    _Atomic uint64_t tail;               // consumer
+    _Atomic uint32_t consumer_waiting;   // futex: consumer sleeps on an empty ring
+    _Atomic int32_t consumer_pid;        // 0 when nobody is attached
+    uint8_t pad2[48];
+
+    ShmRingEvent events[];
+} ShmRingShared;
+
+struct ShmRing {
+    ShmRingShared* shared;
+    size_t map_size;
+    uint32_t mask;
+    uint64_t position;     // our own index: head for the producer, tail for the consumer
+    uint64_t other;        // last seen index of the other side
+    bool stalled;          // producer: the consumer stopped moving, drop until it does
+    uint64_t stalled_at;
+    ShmRingStats stats;
+    char name[256];
+};
+
+static int64_t now_100ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 10000000 + ts.tv_nsec / 100;
+}
+
+// Not FUTEX_PRIVATE_FLAG: the words are shared between processes
+static void futex_wait(_Atomic uint32_t* word, uint32_t value, int64_t timeout_100ns) {
+    struct timespec ts;
+    if (timeout_100ns >= 0) {
+        ts.tv_sec = timeout_100ns / 10000000;
+        ts.tv_nsec = (timeout_100ns % 10000000) * 100;
+    }
+    syscall(SYS_futex, word, FUTEX_WAIT, value, timeout_100ns >= 0 ? &ts : NULL, NULL, 0);
+}
+
+static void futex_wake(_Atomic uint32_t* word) {
+    syscall(SYS_futex, word, FUTEX_WAKE, 1, NULL, NULL, 0);
+}
+
+// After our index store (both seq_cst): either the sleeper sees the new
+// index before it sleeps, or we see its flag here
+static void wake_if_waiting(_Atomic uint32_t* word, ShmRingStats* stats) {
+    if (atomic_load(word) && atomic_exchange(word, 0)) {
+        futex_wake(word);
+        stats->wakeups++;
+    }
+}
+
+static bool set_name(ShmRing* ring, const char* name) {
+    int written = snprintf(ring->name, sizeof(ring->name), "%s%s", name[0] == '/' ? "" : "/", name);
+    return written > 1 && written < (int)sizeof(ring->name) && !strchr(ring->name + 1, '/');
+}
+
+static size_t map_size_for(uint32_t capacity) {
+    return sizeof(ShmRingShared) + (size_t)capacity * sizeof(ShmRingEvent);
+}
+
+static bool consumer_alive(const ShmRingShared* shared) {
+    pid_t pid = atomic_load(&shared->consumer_pid);
+    return pid != 0 && (kill(pid, 0) == 0 || errno == EPERM);
+}
+
+// ——— Producer ———
+ShmRing* shm_ring_create(const char* name, uint32_t capacity, ShmRingClock clock) {
+    ShmRing* ring = calloc(1, sizeof(ShmRing));
+    if (!ring) return NULL;
+    if (!set_name(ring, name)) {
+        fprintf(stderr, "Invalid shared memory name: %s\n", name);
+        free(ring);
+        return NULL;
+    }
+
+    uint32_t rounded = MIN_CAPACITY;
+    while (rounded < capacity && rounded < MAX_CAPACITY) rounded <<= 1;
+    ring->map_size = map_size_for(rounded);
+    ring->mask = rounded - 1;
+
+    // A consumer still attached to an old segment keeps its mapping and
+    // sees it closed; the new one gets the name
+    shm_unlink(ring->name);
+    int fd = shm_open(ring->name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0 || ftruncate(fd, ring->map_size) != 0) {
+        fprintf(stderr, "Failed to create shared memory %s: %s\n", ring->name, strerror(errno));
+        if (fd >= 0) {
+            close(fd);
+            shm_unlink(ring->name);
+        }
+        free(ring);
+        return NULL;
+    }
+    ring->shared = mmap(NULL, ring->map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0);
+    close(fd);
+    if (ring->shared == MAP_FAILED) {
+        fprintf(stderr, "Failed to map shared memory %s: %s\n", ring->name, strerror(errno));
+        shm_unlink(ring->name);
+        free(ring);
+        return NULL;
+    }
+
+    ring->shared->capacity = rounded;
+    ring->shared->clock = clock;
+    atomic_thread_fence(memory_order_release);
+    memcpy(ring->shared->magic, SHM_RING_MAGIC, sizeof(ring->shared->magic));
+    return ring;
+}
+
+// Slow path of shm_ring_push: the ring is full as of ring->other
+static bool wait_for_space(ShmRing* ring) {
+    ShmRingShared* shared = ring->shared;
+    if (ring->stalled) {
+        if (ring->other == ring->stalled_at) return false;
+        ring->stalled = false;
+    }
+
+    int64_t deadline = now_100ns() + PRODUCER_WAIT_100NS;
+    while (ring->position - ring->other > ring->mask) {
+        int64_t remaining = deadline - now_100ns();
+        if (!consumer_alive(shared) || remaining <= 0) {
+            ring->stalled = true;
+            ring->stalled_at = ring->other;
+            return false;
+        }
+        atomic_store(&shared->producer_waiting, 1);
+        ring->other = atomic_load(&shared->tail);
+        if (ring->position - ring->other > ring->mask) {
+            futex_wait(&shared->producer_waiting, 1, remaining);
+            ring->other = atomic_load(&shared->tail);
+        }
+        atomic_store(&shared->producer_waiting, 0);
+    }
+    return true;
+}
+
+bool shm_ring_push(ShmRing* ring, int64_t time_100ns, uint32_t message) {
+    ShmRingShared* shared = ring->shared;
+    uint64_t head = ring->position;
+    if (head - ring->other > ring->mask) {
+        ring->other = atomic_load_explicit(&shared->tail, memory_order_acquire);
+        if (head - ring->other > ring->mask && !wait_for_space(ring)) {
+            ring->stats.dropped++;
+            return false;
+        }
+    }
+
+    ShmRingEvent* event = &shared->events[head & ring->mask];
+    event->time_100ns = time_100ns;
+    event->message = message;
+    event->reserved = 0;
+    ring->position = head + 1;
+    atomic_store(&shared->head, head + 1);
+    wake_if_waiting(&shared->consumer_waiting, &ring->stats);
+    ring->stats.events++;
+    return true;
+}
+
+void shm_ring_destroy(ShmRing* ring) {
+    if (!ring) return;
+    atomic_store(&ring->shared->closed, 1);
+    wake_if_waiting(&ring->shared->consumer_waiting, &ring->stats);
+    munmap(ring->shared, ring->map_size);
+    shm_unlink(ring->name);
+    free(ring);
+}
+
+// ——— Consumer ———
+ShmRing* shm_ring_attach(const char* name) {
+    ShmRing* ring = calloc(1, sizeof(ShmRing));
+    if (!ring) return NULL;
+    if (!set_name(ring, name)) {
+        free(ring);
+        return NULL;
+    }
+
+    int fd = shm_open(ring->name, O_RDWR, 0);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(ShmRingShared)) {
+        if (fd >= 0) close(fd);
+        free(ring);
+        return NULL;
+    }
+    ring->map_size = st.st_size;
+    ring->shared = mmap(NULL, ring->map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0);
+    close(fd);
+    if (ring->shared == MAP_FAILED) {
+        free(ring);
+        return NULL;
+    }
+
+    ShmRingShared* shared = ring->shared;
+    bool ready = memcmp(shared->magic, SHM_RING_MAGIC, sizeof(shared->magic)) == 0;
+    atomic_thread_fence(memory_order_acquire);
+    int32_t previous = atomic_load(&shared->consumer_pid);
+    if (!ready || map_size_for(shared->capacity) > ring->map_size ||
+        (previous != 0 && consumer_alive(shared)) ||
+        !atomic_compare_exchange_strong(&shared->consumer_pid, &previous, (int32_t)getpid())) {
+        munmap(ring->shared, ring->map_size);
+        free(ring);
+        return NULL;
+    }
+
+    ring->mask = shared->capacity - 1;
+    ring->position = atomic_load(&shared->tail);
+    ring->other = ring->position;
+    return ring;
+}
+
+ShmRingClock shm_ring_clock(const ShmRing* ring) {
+    return (ShmRingClock)ring->shared->clock;
+}
+
+size_t shm_ring_peek(ShmRing* ring, const ShmRingEvent** events) {
+    if (ring->other == ring->position) {
+        ring->other = atomic_load_explicit(&ring->shared->head, memory_order_acquire);
+    }
+    uint64_t ready = ring->other - ring->position;
+    size_t start = ring->position & ring->mask;
+    size_t to_end = (size_t)ring->mask + 1 - start;
+    *events = &ring->shared->events[start];
+    return ready < to_end ? ready : to_end;
+}
+
+void shm_ring_release(ShmRing* ring, size_t count) {
+    ring->position += count;
+    ring->stats.events += count;
+    atomic_store(&ring->shared->tail, ring->position);
+    wake_if_waiting(&ring->shared->producer_waiting, &ring->stats);
+}
+
+bool shm_ring_wait(ShmRing* ring, int64_t timeout_100ns) {
+    ShmRingShared* shared = ring->shared;
+    if (ring->other != ring->position) return true;
+
+    atomic_store(&shared->consumer_waiting, 1);
+    ring->other = atomic_load(&shared->head);
+    if (ring->other == ring->position && !atomic_load(&shared->closed)) {
+        futex_wait(&shared->consumer_waiting, 1, timeout_100ns);
+    }
+    atomic_store(&shared->consumer_waiting, 0);
+
+    // closed is set after the last push, so read it first
+    bool closed = atomic_load(&shared->closed);
+    ring->other = atomic_load_explicit(&shared->head, memory_order_acquire);
+    return ring->other != ring->position || !closed;
+}
+
+void shm_ring_detach(ShmRing* ring) {
+    if (!ring) return;
+    atomic_store(&ring->shared->consumer_pid, 0);
+    wake_if_waiting(&ring->shared->producer_waiting, &ring->stats);
+    munmap(ring->shared, ring->map_size);
+    free(ring);
+}
+
+void shm_ring_stats(const ShmRing* ring, ShmRingStats* stats) {
+    *stats = ring->stats;
+}
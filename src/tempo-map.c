@@ -0,0 +1,66 @@
+#include <stdlib.h>
+
+#include "tempo-map.h"
+
+static double tempo_multiplier(uint32_t bpm, uint16_t time_div) {
+    double multiplier = (double)((uint64_t)bpm * 10) / (double)time_div;
+    return multiplier < 1.0 ? 1.0 : multiplier;
+}
+
+static int compare_tempo_events(const void* a, const void* b) {
+    const TempoEvent* x = (const TempoEvent*)a;
+    const TempoEvent* y = (const TempoEvent*)b;
+    if (x->tick != y->tick) return x->tick < y->tick ? -1 : 1;
+    return x->track - y->track;
+}
+
+bool tempo_map_build(TempoMap* map, TempoEvent* events, int event_count, uint16_t time_div) {
+    map->points = malloc((event_count + 1) * sizeof(TempoPoint));
+    map->count = 0;
+    if (!map->points) return false;
+
+    qsort(events, event_count, sizeof(TempoEvent), compare_tempo_events);
+
+    // Default tempo: 120 BPM
+    map->points[0] = (TempoPoint){ 0, 0, (double)(500000 * 10) / (double)time_div };
+    map->count = 1;
+
+    for (int i = 0; i < event_count; i++) {
+        TempoPoint* last = &map->points[map->count - 1];
+        double multiplier = tempo_multiplier(events[i].bpm, time_div);
+
+        if (events[i].tick == last->tick) {
+            // Later tracks win on the same tick
+            last->multiplier = multiplier;
+        } else {
+            int64_t time = last->time_100ns + (int64_t)((events[i].tick - last->tick) * last->multiplier);
+            map->points[map->count++] = (TempoPoint){ events[i].tick, time, multiplier };
+        }
+    }
+    return true;
+}
+
+void tempo_map_free(TempoMap* map) {
+    free(map->points);
+    map->points = NULL;
+    map->count = 0;
+}
+
+int64_t tempo_map_time(const TempoMap* map, uint64_t tick, int* cursor) {
+    int i = *cursor;
+    if (i >= map->count || map->points[i].tick > tick) {
+        // Went backwards: binary search for the last point at or before tick
+        int lo = 0, hi = map->count - 1;
+        while (lo < hi) {
+            int mid = (lo + hi + 1) / 2;
+            if (map->points[mid].tick <= tick) lo = mid;
+            else hi = mid - 1;
+        }
+        i = lo;
+    }
+    while (i + 1 < map->count && map->points[i + 1].tick <= tick) i++;
+    *cursor = i;
+
+    const TempoPoint* p = &map->points[i];
+    return p->time_100ns + (int64_t)((tick - p->tick) * p->multiplier);
+}
@@ -0,0 +1,204 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sched.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "thread-placement.h"
+
+static cpu_set_t role_cpus[THREAD_ROLE_COUNT];
+static bool role_pinned[THREAD_ROLE_COUNT];
+static RealtimePolicy realtime_policy = REALTIME_OFF;
+static int realtime_priority = 80;
+
+// Where the process ran before anything was placed. Threads inherit CPUs
+// and scheduling class from whoever creates them, so roles without CPUs of
+// their own are put back here instead of staying where their creator was.
+static cpu_set_t default_cpus;
+static bool configured = false;
+
+static void configure(void) {
+    if (!configured && sched_getaffinity(0, sizeof(default_cpus), &default_cpus) == 0) {
+        configured = true;
+    }
+}
+
+static atomic_bool reported[THREAD_ROLE_COUNT];
+static atomic_bool warned_realtime = false;
+
+static const char* const role_names[THREAD_ROLE_COUNT] = {
+    [THREAD_ROLE_PLAYBACK] = "playback",
+    [THREAD_ROLE_PARSER]   = "parser",
+    [THREAD_ROLE_LOGGER]   = "logger",
+};
+
+const char* thread_role_name(ThreadRole role) {
+    return role_names[role];
+}
+
+static bool parse_cpu_list(const char* list, cpu_set_t* cpus) {
+    CPU_ZERO(cpus);
+    const char* p = list;
+    while (*p && *p != '\n') {
+        char* end;
+        long first = strtol(p, &end, 10);
+        if (end == p || first < 0) return false;
+        long last = first;
+        if (*end == '-') {
+            p = end + 1;
+            last = strtol(p, &end, 10);
+            if (end == p || last < first) return false;
+        }
+        if (last >= CPU_SETSIZE) return false;
+        for (long cpu = first; cpu <= last; cpu++) CPU_SET(cpu, cpus);
+
+        if (*end == ',') end++;
+        else if (*end != '\0' && *end != '\n') return false;
+        p = end;
+    }
+    return true;
+}
+
+bool thread_placement_pin(ThreadRole role, const char* list) {
+    cpu_set_t cpus;
+    configure();
+    if (!configured || !parse_cpu_list(list, &cpus)) return false;
+
+    // Only CPUs this process may use count, a cpuset may hide some
+    CPU_AND(&cpus, &cpus, &default_cpus);
+    if (CPU_COUNT(&cpus) == 0) return false;
+    role_cpus[role] = cpus;
+    role_pinned[role] = true;
+    return true;
+}
+
+void thread_placement_realtime(RealtimePolicy policy, int priority) {
+    configure();
+    realtime_policy = policy;
+    realtime_priority = priority < 2 ? 2 : (priority > 99 ? 99 : priority);
+}
+
+static int first_cpu(const cpu_set_t* cpus) {
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (CPU_ISSET(cpu, cpus)) return cpu;
+    }
+    return -1;
+}
+
+static int cpu_numa_node(int cpu) {
+    char path[64];
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d", cpu);
+    DIR* dir = opendir(path);
+    if (!dir) return -1;
+
+    int node = -1;
+    struct dirent* entry;
+    while ((entry = readdir(dir))) {
+        if (strncmp(entry->d_name, "node", 4) == 0 && entry->d_name[4] >= '0' && entry->d_name[4] <= '9') {
+            node = atoi(entry->d_name + 4);
+            break;
+        }
+    }
+    closedir(dir);
+    return node;
+}
+
+int thread_role_numa_node(ThreadRole role) {
+    return role_pinned[role] ? cpu_numa_node(first_cpu(&role_cpus[role])) : -1;
+}
+
+// Formats cpus as a list like "0-3,6"
+static void format_cpu_list(const cpu_set_t* cpus, char* out, size_t size) {
+    size_t len = 0;
+    out[0] = '\0';
+    for (int cpu = 0; cpu < CPU_SETSIZE && len < size; cpu++) {
+        if (!CPU_ISSET(cpu, cpus)) continue;
+        int last = cpu;
+        while (last + 1 < CPU_SETSIZE && CPU_ISSET(last + 1, cpus)) last++;
+        len += last > cpu
+             ? snprintf(out + len, size - len, "%s%d-%d", len ? "," : "", cpu, last)
+             : snprintf(out + len, size - len, "%s%d", len ? "," : "", cpu);
+        cpu = last;
+    }
+}
+
+// CPUs kept away from the scheduler with isolcpus=, they only run what is
+// pinned to them
+static bool cpus_isolated(const cpu_set_t* cpus) {
+    char line[256] = "";
+    cpu_set_t isolated;
+    FILE* file = fopen("/sys/devices/system/cpu/isolated", "r");
+    if (!file) return false;
+    bool ok = fgets(line, sizeof(line), file) && parse_cpu_list(line, &isolated);
+    fclose(file);
+    if (!ok || CPU_COUNT(&isolated) == 0) return false;
+
+    cpu_set_t both;
+    CPU_AND(&both, cpus, &isolated);
+    return CPU_EQUAL(&both, cpus);
+}
+
+static void report_placement(ThreadRole role) {
+    cpu_set_t cpus;
+    char list[256];
+    int policy;
+    struct sched_param param;
+
+    if (pthread_getaffinity_np(pthread_self(), sizeof(cpus), &cpus) != 0 ||
+        pthread_getschedparam(pthread_self(), &policy, &param) != 0) {
+        return;
+    }
+    format_cpu_list(&cpus, list, sizeof(list));
+    int node = role_pinned[role] ? cpu_numa_node(first_cpu(&cpus)) : -1;
+
+    char node_text[32] = "";
+    if (node >= 0) snprintf(node_text, sizeof(node_text), ", NUMA node %d", node);
+
+    printf("mplayer: %s thread on CPU %s%s%s, %s",
+           role_names[role], list, node_text,
+           role_pinned[role] && cpus_isolated(&cpus) ? " (isolated)" : "",
+           policy == SCHED_FIFO ? "SCHED_FIFO" : policy == SCHED_RR ? "SCHED_RR" : "normal priority");
+    if (policy == SCHED_FIFO || policy == SCHED_RR) printf(" %d", param.sched_priority);
+    printf("\n");
+}
+
+void place_current_thread(ThreadRole role) {
+    if (!configured) return;
+
+    const cpu_set_t* cpus = role_pinned[role] ? &role_cpus[role] : &default_cpus;
+    int err = pthread_setaffinity_np(pthread_self(), sizeof(*cpus), cpus);
+    if (err != 0) {
+        fprintf(stderr, "mplayer: Could not pin the %s thread: %s\n", role_names[role], strerror(err));
+    }
+
+    if (realtime_policy != REALTIME_OFF) {
+        struct sched_param param = { .sched_priority = 0 };
+        int policy = SCHED_OTHER;
+        if (role != THREAD_ROLE_LOGGER) {
+            policy = realtime_policy == REALTIME_FIFO ? SCHED_FIFO : SCHED_RR;
+            param.sched_priority = role == THREAD_ROLE_PLAYBACK ? realtime_priority : realtime_priority - 1;
+        }
+        err = pthread_setschedparam(pthread_self(), policy, &param);
+        if (err != 0 && !atomic_exchange(&warned_realtime, true)) {
+            fprintf(stderr, "mplayer: No realtime scheduling (%s), staying at normal priority; "
+                            "it needs CAP_SYS_NICE or an rtprio limit\n", strerror(err));
+        }
+    }
+
+    if (!atomic_exchange(&reported[role], true)) {
+        report_placement(role);
+    }
+}
+
+void release_current_thread(void) {
+    if (!configured) return;
+    pthread_setaffinity_np(pthread_self(), sizeof(default_cpus), &default_cpus);
+    if (realtime_policy != REALTIME_OFF) {
+        struct sched_param param = { .sched_priority = 0 };
+        pthread_setschedparam(pthread_self(), SCHED_OTHER, &param);
+    }
+}
@@ -0,0 +1,111 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "trace.h"
+
+bool trace_writer_open(TraceWriter* w, const char* path) {
+    w->file = fopen(path, "wb");
+    w->last_time = 0;
+    w->count = 0;
+    if (!w->file) {
+        perror("mplayer: trace");
+        return false;
+    }
+    setvbuf(w->file, NULL, _IOFBF, 1 << 20);
+    fwrite(TRACE_MAGIC, 1, TRACE_MAGIC_LEN, w->file);
+    return true;
+}
+
+void trace_writer_add(TraceWriter* w, int64_t time_100ns, uint32_t message) {
+    uint64_t delta = time_100ns > w->last_time ? (uint64_t)(time_100ns - w->last_time) : 0;
+    w->last_time += (int64_t)delta;
+
+    uint8_t record[13];
+    size_t len = 0;
+    do {
+        uint8_t byte = delta & 0x7F;
+        delta >>= 7;
+        record[len++] = delta ? byte | 0x80 : byte;
+    } while (delta);
+    record[len++] = message & 0xFF;
+    record[len++] = (message >> 8) & 0xFF;
+    record[len++] = (message >> 16) & 0xFF;
+
+    fwrite(record, 1, len, w->file);
+    w->count++;
+}
+
+bool trace_writer_close(TraceWriter* w) {
+    if (!w->file) return false;
+    bool ok = !ferror(w->file);
+    ok = fclose(w->file) == 0 && ok;
+    w->file = NULL;
+    return ok;
+}
+
+TraceEvent* trace_read(const char* path, size_t* count) {
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        perror(path);
+        return NULL;
+    }
+
+    char magic[TRACE_MAGIC_LEN];
+    if (fread(magic, 1, TRACE_MAGIC_LEN, file) != TRACE_MAGIC_LEN ||
+        memcmp(magic, TRACE_MAGIC, TRACE_MAGIC_LEN) != 0) {
+        fprintf(stderr, "%s: not a trace file\n", path);
+        fclose(file);
+        return NULL;
+    }
+
+    size_t capacity = 4096;
+    size_t n = 0;
+    TraceEvent* events = malloc(capacity * sizeof(TraceEvent));
+    int64_t time = 0;
+
+    while (events) {
+        uint64_t delta = 0;
+        int shift = 0;
+        int c;
+        do {
+            c = fgetc(file);
+            if (c == EOF) break;
+            delta |= (uint64_t)(c & 0x7F) << shift;
+            shift += 7;
+        } while ((c & 0x80) && shift < 64);
+
+        if (c == EOF) {
+            if (shift != 0) goto TRUNCATED;
+            break;
+        }
+
+        uint8_t bytes[3];
+        if (fread(bytes, 1, 3, file) != 3) goto TRUNCATED;
+
+        if (n == capacity) {
+            capacity *= 2;
+            TraceEvent* grown = realloc(events, capacity * sizeof(TraceEvent));
+            if (!grown) {
+                free(events);
+                events = NULL;
+                break;
+            }
+            events = grown;
+        }
+        time += (int64_t)delta;
+        events[n].time_100ns = time;
+        events[n].message = bytes[0] | (bytes[1] << 8) | (bytes[2] << 16);
+        n++;
+    }
+
+    if (!events) fprintf(stderr, "%s: out of memory\n", path);
+    fclose(file);
+    *count = n;
+    return events;
+
+TRUNCATED:
+    fprintf(stderr, "%s: truncated after %zu events\n", path, n);
+    fclose(file);
+    free(events);
+    return NULL;
+}
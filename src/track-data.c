@@ -16,21 +16,97 @@ void init_track_data(TrackData* track) {
     track->data_capacity = 0;
 }
 
-void free_track_data(TrackData* track) {
-    if (track->data) free(track->data);
-    if (track->long_msg) free(track->long_msg);
-    track->data = NULL;
-    track->long_msg = NULL;
+// Checked twin of decode_variable_length; returns false when it overruns
+static bool scan_variable_length(const uint8_t* data, size_t length, size_t* offset, uint32_t* value) {
+    uint32_t result = 0;
+    int i = 0;
+    uint8_t byte;
+    do {
+        if (*offset >= length) return false;
+        byte = data[(*offset)++];
+        result = (result << 7) | (byte & 0x7F);
+    } while ((byte & 0x80) && ++i < 4);
+    *value = result;
+    return true;
 }
 
+// Follows exactly the decoding rules of update_tick/update_command/update_message.
+// The scan state only moves past complete events.
+bool track_scan(TrackScan* scan, const uint8_t* data, size_t available) {
+    size_t offset = scan->offset;
+    uint8_t status = scan->status;
+    uint32_t delta, value;
+
+    while (true) {
+        size_t event_start = offset;
+        if (!scan_variable_length(data, available, &offset, &delta)) break;
+        if (offset >= available) break;
+        uint8_t event_status = data[offset] >= 0x80 ? data[offset++] : status;
+
+        size_t needed;
+        if (event_status < 0xC0 || (event_status >= 0xE0 && event_status < 0xF0)) {
+            needed = 2;
+        } else if (event_status < 0xE0) {
+            needed = 1;
+        } else if (event_status == 0xFF || event_status == 0xF0 || event_status == 0xF7) {
+            uint8_t meta_type = 0;
+            if (event_status == 0xFF) {
+                if (offset >= available) break;
+                meta_type = data[offset++];
+            }
+            if (!scan_variable_length(data, available, &offset, &value)) break;
+            if (event_status == 0xFF && meta_type == 0x2F) {
+                scan->offset = event_start;
+                scan->status = status;
+                scan->ended = true;
+                return true;
+            }
+            needed = value;
+        } else {
+            needed = 0;
+        }
+
+        if (needed > available - offset) {
+            offset = event_start;
+            break;
+        }
+        offset += needed;
+        status = event_status;
+        scan->tick += delta;
+        if (status >= 0xF0 && needed > scan->longest) scan->longest = needed;
+        scan->offset = offset;
+    }
+
+    scan->status = status;
+    return false;
+}
+
+void track_seal(TrackData* track, uint8_t* data, const TrackScan* scan) {
+    static const uint8_t end_of_track[TRACK_PADDING] = { 0x00, 0xFF, 0x2F, 0x00 };
+    track->length = scan->offset;
+    memcpy(&data[scan->offset], end_of_track, TRACK_PADDING);
+}
+
+bool seal_track_data(TrackData* track, size_t* longest) {
+    TrackScan scan = { 0 };
+    bool complete = track_scan(&scan, track->data, track->length);
+    // Cut before the first incomplete event (or the end-of-track) and seal
+    track_seal(track, track->data, &scan);
+    *longest = scan.longest;
+    return complete;
+}
+
+// Quantities are at most 4 bytes long
 int decode_variable_length(TrackData* track) {
+    const uint8_t* p = &track->data[track->offset];
     int result = 0;
+    int i = 0;
     uint8_t byte;
-    if (track->offset >= track->length) return 0; // Avoid out-of-bounds
     do {
-        byte = track->data[track->offset++];
+        byte = p[i++];
         result = (result << 7) | (byte & 0x7F);
-    } while ((byte & 0x80) && track->offset < track->length); // Prevent overflow
+    } while ((byte & 0x80) && i < 4);
+    track->offset += i;
     return result;
 }
 
@@ -39,8 +115,6 @@ void update_tick(TrackData* track) {
 }
 
 void update_command(TrackData* track) {
-    if (track->length == 0 || track->data == NULL)
-        return;
     const uint8_t temp = track->data[track->offset];
     if (temp >= 0x80) {
         track->offset++;
@@ -49,8 +123,6 @@ void update_command(TrackData* track) {
 }
 
 void update_message(TrackData* track) {
-    if (track->length == 0 || track->data == NULL) return;
-
     const uint8_t msg_type = track->message & 0xFF;
 
     if (msg_type < 0xC0) {
@@ -62,12 +134,17 @@ void update_message(TrackData* track) {
     } else if (msg_type < 0xF0) {
         track->temp = track->data[track->offset] << 8 | track->data[track->offset + 1] << 16;
         track->offset += 2;
-    } else if (msg_type == 0xFF || msg_type == 0xF0) {
-        track->temp = (msg_type == 0xFF) ? track->data[track->offset] << 8 : 0;
-        track->offset += 1;
+    } else if (msg_type == 0xFF || msg_type == 0xF0 || msg_type == 0xF7) {
+        if (msg_type == 0xFF) {
+            track->temp = track->data[track->offset] << 8;
+            track->offset += 1;
+        } else {
+            track->temp = 0;
+        }
         track->long_msg_len = decode_variable_length(track);
 
-        // Ensure we have enough capacity
+        // Loaded tracks are sized for their longest message and never grow;
+        // this is for decoders with their own scratch buffer
         if (track->long_msg_capacity < track->long_msg_len) {
             uint8_t* new_buf = realloc(track->long_msg, track->long_msg_len);
             if (new_buf == NULL) {
@@ -80,20 +157,22 @@ void update_message(TrackData* track) {
 
         memcpy(track->long_msg, &track->data[track->offset], track->long_msg_len);
         track->offset += track->long_msg_len;
+    } else {
+        // Other system messages carry no data in a file
+        track->temp = 0;
     }
 
-    track->message |= track->temp;
+    // Keep only the status byte, so running status does not mix in old data
+    track->message = (track->message & 0xFF) | track->temp;
 }
 
 void process_meta_event(TrackData* track, double* multiplier, uint64_t* bpm, uint16_t time_div) {
     const uint8_t meta_type = (track->message >> 8) & 0xFF;
-    if (meta_type == 0x51) { // Tempo change
+    if (meta_type == 0x51 && track->long_msg_len >= 3) { // Tempo change
         *bpm = (track->long_msg[0] << 16) | (track->long_msg[1] << 8) | track->long_msg[2];
-        *multiplier = (double)(*bpm * 10) / (double)time_div;
-        *multiplier = (*multiplier < 1.0) ? 1.0 : *multiplier; // Ensure minimum multiplier of 1
+        *multiplier = tempo_multiplier(*bpm, time_div);
     }
-    else if (meta_type == 0x2F) { // End of track
-        free(track->data);
+    else if (meta_type == 0x2F) { // End of track, the arena still owns data
         track->data = NULL;
         track->length = 0;
     }
@@ -0,0 +1,32 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "track-schedule.h"
+
+bool track_schedule_init(TrackSchedule* schedule, const TrackData* tracks, int track_count) {
+    size_t slots = track_count > 0 ? (size_t)track_count : 1;
+    schedule->count = 0;
+    // One block: the ticks, then the indices
+    schedule->ticks = malloc(slots * (sizeof(uint64_t) + sizeof(int)));
+    if (!schedule->ticks) {
+        fprintf(stderr, "mplayer: Not enough memory to schedule %d tracks\n", track_count);
+        schedule->tracks = NULL;
+        return false;
+    }
+    schedule->tracks = (int*)(schedule->ticks + slots);
+
+    for (int i = 0; i < track_count; i++) {
+        if (tracks[i].data == NULL) continue;
+        schedule->ticks[schedule->count] = tracks[i].tick;
+        schedule->tracks[schedule->count] = i;
+        schedule->count++;
+    }
+    return true;
+}
+
+void track_schedule_free(TrackSchedule* schedule) {
+    free(schedule->ticks);
+    schedule->ticks = NULL;
+    schedule->tracks = NULL;
+    schedule->count = 0;
+}
@@ -0,0 +1,185 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "transform.h"
+
+#define DROP 0x80
+
+void transform_spec_init(TransformSpec* spec) {
+    memset(spec, 0, sizeof(*spec));
+    for (int channel = 0; channel < 16; channel++) spec->channel_map[channel] = (int8_t)channel;
+    spec->velocity_gamma = 1.0;
+    spec->velocity_scale = 1.0;
+}
+
+bool transform_spec_is_identity(const TransformSpec* spec) {
+    for (int channel = 0; channel < 16; channel++) {
+        if (spec->channel_map[channel] != channel || spec->transpose[channel] != 0) return false;
+    }
+    return spec->velocity_gamma == 1.0 && spec->velocity_scale == 1.0 && spec->muted_track_ranges == 0;
+}
+
+// Reads one number of a list, "first" or "first-last", and the separator after it
+static bool parse_range(const char** p, long min, long max, long* first, long* last) {
+    char* end;
+    *first = strtol(*p, &end, 10);
+    if (end == *p || *first < min || *first > max) return false;
+    *last = *first;
+    if (*end == '-') {
+        const char* start = end + 1;
+        *last = strtol(start, &end, 10);
+        if (end == start || *last < *first || *last > max) return false;
+    }
+    if (*end == ',') end++;
+    else if (*end != '\0') return false;
+    *p = end;
+    return true;
+}
+
+// "1-4,9" as a bit per channel, 1-16 in the string
+static bool parse_channels(const char* list, uint16_t* channels) {
+    *channels = 0;
+    if (!*list) return false;
+    while (*list) {
+        long first, last;
+        if (!parse_range(&list, 1, 16, &first, &last)) return false;
+        for (long channel = first; channel <= last; channel++) *channels |= 1u << (channel - 1);
+    }
+    return true;
+}
+
+bool transform_parse_remap(TransformSpec* spec, const char* value) {
+    while (*value) {
+        char* end;
+        long from = strtol(value, &end, 10);
+        if (end == value || *end != ':' || from < 1 || from > 16) return false;
+        const char* to_start = end + 1;
+        long to = strtol(to_start, &end, 10);
+        if (end == to_start || to < 1 || to > 16) return false;
+        if (*end == ',') end++;
+        else if (*end != '\0') return false;
+        spec->channel_map[from - 1] = (int8_t)(to - 1);
+        value = end;
+    }
+    return true;
+}
+
+bool transform_parse_transpose(TransformSpec* spec, const char* value) {
+    char* end;
+    long semitones = strtol(value, &end, 10);
+    if (end == value || semitones < -127 || semitones > 127) return false;
+
+    // Channel 10 is drums, where a key is an instrument and not a pitch
+    uint16_t channels = 0xFFFF & ~(1u << 9);
+    if (*end == ':') {
+        if (!parse_channels(end + 1, &channels)) return false;
+    } else if (*end != '\0') {
+        return false;
+    }
+    for (int channel = 0; channel < 16; channel++) {
+        if (channels & (1u << channel)) spec->transpose[channel] = (int8_t)semitones;
+    }
+    return true;
+}
+
+bool transform_parse_mute_channels(TransformSpec* spec, const char* value) {
+    uint16_t channels;
+    if (!parse_channels(value, &channels)) return false;
+    for (int channel = 0; channel < 16; channel++) {
+        if (channels & (1u << channel)) spec->channel_map[channel] = -1;
+    }
+    return true;
+}
+
+bool transform_parse_mute_tracks(TransformSpec* spec, const char* value) {
+    if (!*value) return false;
+    while (*value) {
+        long first, last;
+        if (spec->muted_track_ranges == TRANSFORM_MAX_TRACK_RANGES ||
+            !parse_range(&value, 0, 65535, &first, &last)) {
+            return false;
+        }
+        spec->muted_tracks[spec->muted_track_ranges].first = (int)first;
+        spec->muted_tracks[spec->muted_track_ranges].last = (int)last;
+        spec->muted_track_ranges++;
+    }
+    return true;
+}
+
+bool transform_parse_velocity_curve(TransformSpec* spec, const char* value) {
+    char* end;
+    double gamma = strtod(value, &end);
+    double scale = 1.0;
+    if (end == value || !(gamma >= 0.1 && gamma <= 10.0)) return false;
+    if (*end == ':') {
+        const char* start = end + 1;
+        scale = strtod(start, &end);
+        if (end == start || !(scale > 0.0 && scale <= 10.0)) return false;
+    }
+    if (*end != '\0') return false;
+    spec->velocity_gamma = gamma;
+    spec->velocity_scale = scale;
+    return true;
+}
+
+Transform* transform_compile(const TransformSpec* spec, int min_velocity, int track_count) {
+    if (!spec || transform_spec_is_identity(spec)) return NULL;
+
+    Transform* t = malloc(sizeof(Transform) + (size_t)track_count);
+    if (!t) {
+        fprintf(stderr, "mplayer: Not enough memory for the event transforms, playing unchanged\n");
+        return NULL;
+    }
+    t->track_count = track_count;
+    memset(t->track_mask, 0xFF, (size_t)track_count);
+    for (int r = 0; r < spec->muted_track_ranges; r++) {
+        int last = spec->muted_tracks[r].last < track_count ? spec->muted_tracks[r].last : track_count - 1;
+        for (int track = spec->muted_tracks[r].first; track <= last; track++) {
+            t->track_mask[track] = 0;
+        }
+    }
+
+    for (int value = 0; value < 128; value++) {
+        t->data1[0][value] = (uint8_t)value;
+        t->data2[0][value] = (uint8_t)value;
+    }
+    for (int channel = 0; channel < 16; channel++) {
+        for (int key = 0; key < 128; key++) {
+            int moved = key + spec->transpose[channel];
+            t->data1[1 + channel][key] = moved >= 0 && moved <= 127 ? (uint8_t)moved : DROP;
+        }
+    }
+    for (int velocity = 0; velocity < 128; velocity++) {
+        if (velocity <= min_velocity) {
+            t->data2[1][velocity] = DROP;
+        } else if (velocity == 0) {
+            t->data2[1][velocity] = 0;   // a note-off stays one
+        } else {
+            double curved = 127.0 * pow(velocity / 127.0, spec->velocity_gamma) * spec->velocity_scale;
+            long rounded = lround(curved);
+            t->data2[1][velocity] = (uint8_t)(rounded < 1 ? 1 : (rounded > 127 ? 127 : rounded));
+        }
+    }
+
+    for (int status = 0; status < 256; status++) {
+        int kind = status & 0xF0;
+        int channel = status & 0x0F;
+        t->status[status] = (uint8_t)status;
+        t->data1_row[status] = 0;
+        t->data2_row[status] = 0;
+        if (status < 0x80 || status >= 0xF0) continue;
+
+        int target = spec->channel_map[channel];
+        t->status[status] = target < 0 ? 0 : (uint8_t)(kind | target);
+        // Keys are transposed for the channel they come from
+        if (kind == 0x80 || kind == 0x90 || kind == 0xA0) t->data1_row[status] = (uint8_t)(1 + channel);
+        if (kind == 0x90) t->data2_row[status] = 1;
+    }
+    return t;
+}
+
+void transform_free(Transform* transform) {
+    free(transform);
+}
@@ -0,0 +1,64 @@
+#!/bin/sh
+# Plays every test/golden/*.mid headless on each engine, captures what is
+# sent and diffs it against the golden <name>.trace next to it. The virtual
+# clock makes the traces reproducible, so times have to match exactly.
+#
+#   test/golden/check.sh [<midi_player> [<trace_compare>]]
+#   test/golden/check.sh --update [<midi_player>]   rewrites the golden traces
+#
+# Exits with 0 when everything matches, 1 on a mismatch and 2 on errors.
+
+dir=$(cd "$(dirname "$0")" && pwd)
+bin=$(cd "$dir/../.." && pwd)/build/linux/x86_64/release
+
+update=0
+if [ "$1" = "--update" ]; then
+    update=1
+    shift
+fi
+player=${1:-$bin/midi_player}
+compare=${2:-$bin/trace_compare}
+
+tools="$player"
+[ "$update" = 0 ] && tools="$tools $compare"
+for tool in $tools; do
+    if [ ! -x "$tool" ]; then
+        echo "check.sh: $tool not found, build it with xmake first" >&2
+        exit 2
+    fi
+done
+
+out=$(mktemp -d) || exit 2
+trap 'rm -rf "$out"' EXIT
+
+status=0
+for midi in "$dir"/*.mid; do
+    name=$(basename "$midi" .mid)
+    golden=$dir/$name.trace
+
+    if [ "$update" = 1 ]; then
+        "$player" --headless -q --capture="$golden" "$midi" > /dev/null 2>&1 || {
+            echo "FAIL $name: midi_player exited with $?"
+            status=2
+        }
+        continue
+    fi
+
+    for engine in "inline" "buffered" "buffered --parsers=2"; do
+        label="$name ($engine)"
+        trace=$out/$name.trace
+        # $engine is split on purpose, for the extra option
+        if ! "$player" --headless -q --engine=$engine --capture="$trace" "$midi" > "$out/log" 2>&1; then
+            echo "FAIL $label: midi_player exited with an error"
+            cat "$out/log"
+            status=2
+        elif "$compare" "$golden" "$trace" > "$out/log" 2>&1; then
+            echo "ok   $label"
+        else
+            echo "FAIL $label"
+            cat "$out/log"
+            [ "$status" = 0 ] && status=1
+        fi
+    done
+done
+exit $status
@@ -0,0 +1,32 @@
+import { configDotenv } from "dotenv";
+configDotenv();
+
+import { Client } from "mpp-client-net";
+
+const client = new Client("wss://mppclone.com", process.env.MPPNET_TOKEN);
+client.start();
+client.setChannel('✧𝓓𝓔𝓥 𝓡𝓸𝓸𝓶✧');
+
+import { createRequire } from "module";
+const require = createRequire(import.meta.url);
+const midiPlayer = require("../../build/linux/x86_64/release/midi_player.node");
+
+const file = '/run/media/ar06/74EAEFC8EAEF8528/Midis/(ATLAS) midis2/[Tikronix] Kirby Super Star - Gourmet Race 140k.mid';
+const minimumVelocity = 1; // Minimum velocity (0-127)
+
+let MIDI_TRANSPOSE = -12;
+
+// Packets are built natively, JS only wraps and sends them
+const player = midiPlayer.playMIDI(file, notes => {
+    if (!client.isConnected()) return;
+    client.ws.send(`[{"m":"custom","data":{"n":"${notes}"},"target":{"mode":"subscribed"}}]`);
+}, {
+    minVelocity: minimumVelocity,
+    output: "mpp",
+    noteOffset: -9 + MIDI_TRANSPOSE,
+    flushIntervalMs: 200,
+    maxNotes: 65000,
+    timeOffsetMs: 5000,
+});
+
+player.then(stats => console.log("Finished:", stats));
@@ -0,0 +1,43 @@
+// Plays a file through the native MPP encoder into a local WebSocket
+// server and checks that every note arrives.
+//   node standin.js <file.mid> [speed]
+import { WebSocketServer, WebSocket } from "ws";
+import NoteHandler from "./NoteHandler.js";
+
+import { createRequire } from "module";
+const require = createRequire(import.meta.url);
+const midiPlayer = require("../../build/linux/x86_64/release/midi_player.node");
+
+const file = process.argv[2];
+const speed = Number(process.argv[3] ?? 1);
+
+const noteHandler = new NoteHandler();
+let packets = 0;
+let received = 0;
+let pressed = 0;
+
+const server = new WebSocketServer({ port: 0 });
+server.on("connection", socket => {
+    socket.on("message", raw => {
+        const [msg] = JSON.parse(raw.toString());
+        const { notes } = noteHandler.parseBinaryNotes(msg.data.n);
+        packets++;
+        received += notes.length;
+        pressed += notes.filter(note => note.velocity > 0).length;
+    });
+});
+
+const ws = new WebSocket(`ws://127.0.0.1:${server.address().port}`);
+ws.on("open", async () => {
+    const stats = await midiPlayer.playMIDI(file, notes => {
+        ws.send(`[{"m":"custom","data":{"n":"${notes}"},"target":{"mode":"subscribed"}}]`);
+    }, { output: "mpp", speed });
+
+    // Let the last packets land before comparing
+    setTimeout(() => {
+        console.log(`packets=${packets} notes=${received} pressed=${pressed} player=${stats.notes}`);
+        ws.close();
+        server.close();
+        process.exitCode = pressed === stats.notes ? 0 : 1;
+    }, 500);
+});
@@ -0,0 +1,14 @@
+const midiPlayer = require("../build/linux/x86_64/release/midi_player.node");
+
+// What a piano roll asks every frame: the notes visible in a 2 second window
+midiPlayer.loadNoteIndex(process.argv[2]).then(index => {
+  console.log(`${index.count} notes, ${(index.durationMs / 1000).toFixed(1)} s, indexed in ${index.buildMs} ms`);
+
+  const started = Date.now();
+  const timer = setInterval(() => {
+    const now = Date.now() - started;
+    const notes = index.query(now, now + 2000);  // { start, end, key, velocity, channel, track }
+    console.log(`${now} ms: ${notes.start.length} notes on screen`);
+    if (now > index.durationMs) clearInterval(timer);
+  }, 1000 / 60);
+});
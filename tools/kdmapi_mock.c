@@ -0,0 +1,194 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <time.h>
+
+// Stand-in KDMAPI library for headless tests and benchmarks:
+//   midi_player --headless --kdmapi=./libkdmapi_mock.so song.mid
+// It counts every call per entrypoint, checksums the short messages in
+// order (so two runs or two entrypoints can be compared) and reports, per
+// send entrypoint, the time from its first to its last call divided by the
+// calls: the full cost of one event as the player sees it.
+//
+// KDMAPI_MOCK_COST_NS=<ns>  spins that long in every send, like a synth would
+// KDMAPI_MOCK_REPORT=<file> appends the report there instead of stderr
+// KDMAPI_MOCK_LONG_ERROR=<n> fails every SendDirectLongData with that code
+//
+// Built with -DKDMAPI_MOCK_LEGACY (the kdmapi_mock_legacy target) it only
+// exports the three entrypoints of old KDMAPI versions, to test the
+// player's fallbacks.
+
+enum { SHORT_BUFFERED, SHORT_NO_BUFFER, LONG_DATA, ENTRY_COUNT };
+
+static const char* const entry_names[ENTRY_COUNT] = {
+    "SendDirectData", "SendDirectDataNoBuf", "SendDirectLongData"
+};
+
+typedef struct {
+    _Atomic uint64_t calls;
+    _Atomic uint64_t bytes;
+    _Atomic int64_t first_ns;
+    _Atomic int64_t last_ns;
+} EntryStats;
+
+static EntryStats entries[ENTRY_COUNT];
+static _Atomic uint64_t checksum = 14695981039346656037ULL;   // FNV-1a offset basis
+static _Atomic int initialized = 0;
+static _Atomic int terminated = 0;
+static _Atomic int resets = 0;
+static int64_t cost_ns = -1;   // -1 until the environment was read
+static uint32_t long_error = 0;
+static bool reported = false;
+
+static int64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void count(int entry, uint64_t bytes) {
+    EntryStats* e = &entries[entry];
+    int64_t now = now_ns();
+    if (atomic_fetch_add_explicit(&e->calls, 1, memory_order_relaxed) == 0) {
+        atomic_store_explicit(&e->first_ns, now, memory_order_relaxed);
+    }
+    atomic_store_explicit(&e->last_ns, now, memory_order_relaxed);
+    atomic_fetch_add_explicit(&e->bytes, bytes, memory_order_relaxed);
+
+    if (cost_ns > 0) {
+        while (now_ns() - now < cost_ns) {}
+    }
+}
+
+static void short_message(int entry, uint32_t message) {
+    count(entry, 3);
+    // Order matters, so this is only exact for one sending thread
+    uint64_t hash = atomic_load_explicit(&checksum, memory_order_relaxed);
+    hash = (hash ^ (message & 0xFFFFFF)) * 1099511628211ULL;
+    atomic_store_explicit(&checksum, hash, memory_order_relaxed);
+}
+
+static void report(void) {
+    if (reported) return;
+    reported = true;
+
+    const char* path = getenv("KDMAPI_MOCK_REPORT");
+    FILE* out = path ? fopen(path, "a") : NULL;
+    if (!out) out = stderr;
+
+    fprintf(out, "kdmapi-mock: stream initialized %dx, terminated %dx, reset %dx%s\n",
+            atomic_load(&initialized), atomic_load(&terminated), atomic_load(&resets),
+            atomic_load(&terminated) ? "" : " (never terminated)");
+    for (int i = 0; i < ENTRY_COUNT; i++) {
+        EntryStats* e = &entries[i];
+        uint64_t calls = atomic_load(&e->calls);
+        if (calls == 0) {
+            fprintf(out, "kdmapi-mock: %-20s 0 calls\n", entry_names[i]);
+            continue;
+        }
+        double span_ms = (atomic_load(&e->last_ns) - atomic_load(&e->first_ns)) / 1e6;
+        fprintf(out, "kdmapi-mock: %-20s %llu calls, %llu bytes, %.3f ms span, %.1f ns/call\n",
+                entry_names[i], (unsigned long long)calls, (unsigned long long)atomic_load(&e->bytes),
+                span_ms, calls > 1 ? span_ms * 1e6 / (calls - 1) : 0.0);
+    }
+    fprintf(out, "kdmapi-mock: short message checksum %016llx\n",
+            (unsigned long long)atomic_load(&checksum));
+    if (out != stderr) fclose(out);
+}
+
+__attribute__((destructor)) static void unloaded(void) {
+    report();
+}
+
+bool IsKDMAPIAvailable(void) {
+    return true;
+}
+
+bool InitializeKDMAPIStream(void) {
+    const char* cost = getenv("KDMAPI_MOCK_COST_NS");
+    cost_ns = cost ? atoll(cost) : 0;
+    const char* error = getenv("KDMAPI_MOCK_LONG_ERROR");
+    long_error = error ? (uint32_t)atol(error) : 0;
+    atomic_fetch_add(&initialized, 1);
+    return true;
+}
+
+void SendDirectData(uint32_t message) {
+    short_message(SHORT_BUFFERED, message);
+}
+
+#ifndef KDMAPI_MOCK_LEGACY
+
+bool TerminateKDMAPIStream(void) {
+    atomic_fetch_add(&terminated, 1);
+    report();
+    return true;
+}
+
+void ResetKDMAPIStream(void) {
+    atomic_fetch_add(&resets, 1);
+}
+
+bool ReturnKDMAPIVer(uint32_t* major, uint32_t* minor, uint32_t* build, uint32_t* revision) {
+    *major = 4;
+    *minor = 0;
+    *build = 0;
+    *revision = 0;
+    return true;
+}
+
+void SendDirectDataNoBuf(uint32_t message) {
+    short_message(SHORT_NO_BUFFER, message);
+}
+
+// Same layout as the MIDIHDR the player passes
+typedef struct MockMidiHdr {
+    char* lpData;
+    uint32_t dwBufferLength;
+    uint32_t dwBytesRecorded;
+    uintptr_t dwUser;
+    uint32_t dwFlags;
+    struct MockMidiHdr* lpNext;
+    uintptr_t reserved;
+    uint32_t dwOffset;
+    uintptr_t dwReserved[8];
+} MockMidiHdr;
+
+#define MHDR_PREPARED 0x00000002
+#define MMSYSERR_INVALPARAM 11
+#define MIDIERR_UNPREPARED 64
+
+uint32_t PrepareLongData(MockMidiHdr* header, uint32_t header_size) {
+    if (!header || header_size < sizeof(MockMidiHdr) || !header->lpData) {
+        return MMSYSERR_INVALPARAM;
+    }
+    header->dwFlags |= MHDR_PREPARED;
+    return 0;
+}
+
+uint32_t UnprepareLongData(MockMidiHdr* header, uint32_t header_size) {
+    if (!header || header_size < sizeof(MockMidiHdr)) {
+        return MMSYSERR_INVALPARAM;
+    }
+    header->dwFlags &= ~MHDR_PREPARED;
+    return 0;
+}
+
+uint32_t SendDirectLongData(MockMidiHdr* header, uint32_t header_size) {
+    if (!header || header_size < sizeof(MockMidiHdr) || !header->lpData ||
+        (uint8_t)header->lpData[0] != 0xF0) {
+        return MMSYSERR_INVALPARAM;
+    }
+    if (!(header->dwFlags & MHDR_PREPARED)) {
+        return MIDIERR_UNPREPARED;
+    }
+    if (long_error) {
+        return long_error;
+    }
+    count(LONG_DATA, header->dwBufferLength);
+    return 0;
+}
+
+#endif
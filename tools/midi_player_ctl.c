@@ -0,0 +1,61 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+// Minimal client for the midi_player daemon: sends one command and prints
+// the reply. Exits with 0 when the daemon answered "ok".
+int main(int argc, char* argv[]) {
+    if (argc < 3) {
+        fprintf(stderr, "Usage: %s <socket> <command> [args...]\n\n", argv[0]);
+        fprintf(stderr, "Commands: load <path>, play [path], seek <seconds>, pause, resume,\n"
+                        "          speed <x>, stop, status, shutdown\n");
+        return 2;
+    }
+
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    if (strlen(argv[1]) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Socket path too long: %s\n", argv[1]);
+        return 2;
+    }
+    strcpy(addr.sun_path, argv[1]);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        perror("midi_player_ctl: connect");
+        return 1;
+    }
+
+    char command[4096];
+    size_t len = 0;
+    for (int i = 2; i < argc; i++) {
+        int n = snprintf(command + len, sizeof(command) - len, "%s%s",
+                         argv[i], i + 1 < argc ? " " : "\n");
+        if (n < 0 || (size_t)n >= sizeof(command) - len) {
+            fprintf(stderr, "midi_player_ctl: command too long\n");
+            close(fd);
+            return 2;
+        }
+        len += n;
+    }
+
+    if (write(fd, command, len) != (ssize_t)len) {
+        perror("midi_player_ctl: write");
+        close(fd);
+        return 1;
+    }
+
+    FILE* stream = fdopen(fd, "r");
+    char reply[4096];
+    if (!stream || !fgets(reply, sizeof(reply), stream)) {
+        fprintf(stderr, "midi_player_ctl: no reply\n");
+        if (stream) fclose(stream); else close(fd);
+        return 1;
+    }
+    fclose(stream);
+
+    fputs(reply, stdout);
+    return strncmp(reply, "ok", 2) == 0 ? 0 : 1;
+}
@@ -0,0 +1,96 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "shm-ring.h"
+#include "trace.h"
+
+// Reference consumer for midi_player --shm=<name>: waits for the ring to
+// appear, drains it in place and prints the event rate and how late the
+// events arrive once a second. With --trace=<file> it also records what it
+// received, for trace_compare against a --capture of the same run.
+// Exits when the player closes the ring.
+
+static int64_t now_100ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 10000000 + ts.tv_nsec / 100;
+}
+
+int main(int argc, char* argv[]) {
+    const char* name = NULL;
+    const char* trace_path = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--trace=", 8) == 0) {
+            trace_path = argv[i] + 8;
+        } else if (!name && argv[i][0] != '-') {
+            name = argv[i];
+        } else {
+            name = NULL;
+            break;
+        }
+    }
+    if (!name) {
+        fprintf(stderr, "Usage: %s [--trace=<file>] <name>\n", argv[0]);
+        return 2;
+    }
+
+    ShmRing* ring;
+    while (!(ring = shm_ring_attach(name))) {
+        usleep(10000);
+    }
+    bool real_time = shm_ring_clock(ring) == SHM_RING_CLOCK_MONOTONIC;
+
+    TraceWriter trace;
+    if (trace_path && !trace_writer_open(&trace, trace_path)) {
+        shm_ring_detach(ring);
+        return 2;
+    }
+
+    uint64_t total = 0, note_ons = 0, interval_events = 0;
+    int64_t lag_sum = 0, lag_max = 0;
+    int64_t interval_start = now_100ns();
+    while (shm_ring_wait(ring, 1000000)) {
+        const ShmRingEvent* events;
+        size_t count;
+        while ((count = shm_ring_peek(ring, &events)) > 0) {
+            int64_t now = now_100ns();
+            for (size_t i = 0; i < count; i++) {
+                uint32_t message = events[i].message;
+                if ((message & 0xF0) == 0x90 && (message >> 16 & 0x7F)) note_ons++;
+                if (real_time) {
+                    int64_t lag = now - events[i].time_100ns;
+                    lag_sum += lag;
+                    if (lag > lag_max) lag_max = lag;
+                }
+                if (trace_path) trace_writer_add(&trace, events[i].time_100ns, message);
+            }
+            interval_events += count;
+            shm_ring_release(ring, count);
+        }
+
+        int64_t now = now_100ns();
+        if (now - interval_start >= 10000000) {
+            printf("shm_ring_stat: Events/sec: %llu", (unsigned long long)interval_events);
+            if (real_time && interval_events) {
+                printf(" | lag avg %.1f us, max %.1f us",
+                       lag_sum / 10.0 / interval_events, lag_max / 10.0);
+            }
+            printf("\n");
+            total += interval_events;
+            interval_events = 0;
+            lag_sum = lag_max = 0;
+            interval_start = now;
+        }
+    }
+    total += interval_events;
+
+    ShmRingStats stats;
+    shm_ring_stats(ring, &stats);
+    printf("shm_ring_stat: %llu events, %llu note-ons, %llu wakeups sent to the player\n",
+           (unsigned long long)total, (unsigned long long)note_ons, (unsigned long long)stats.wakeups);
+    shm_ring_detach(ring);
+    return trace_path && !trace_writer_close(&trace) ? 1 : 0;
+}
@@ -0,0 +1,127 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "trace.h"
+
+// Diffs a capture trace (midi_player --capture) against a golden one. The
+// message sequences must match exactly; times are compared relative to
+// each trace's first event, either exactly or within --tolerance=<ms>.
+// Exits with 0 on a match, 1 on a difference and 2 on errors.
+
+static int compare_abs(const void* a, const void* b) {
+    int64_t x = *(const int64_t*)a;
+    int64_t y = *(const int64_t*)b;
+    return (x > y) - (x < y);
+}
+
+static double ms(int64_t time_100ns) {
+    return time_100ns / 10000.0;
+}
+
+int main(int argc, char* argv[]) {
+    double tolerance_ms = 0.0;
+    const char* paths[2];
+    int path_count = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--tolerance=", 12) == 0) {
+            tolerance_ms = atof(argv[i] + 12);
+        } else if (path_count < 2 && argv[i][0] != '-') {
+            paths[path_count++] = argv[i];
+        } else {
+            path_count = -1;
+            break;
+        }
+    }
+    if (path_count != 2 || tolerance_ms < 0) {
+        fprintf(stderr, "Usage: %s [--tolerance=<ms>] <golden.trace> <candidate.trace>\n", argv[0]);
+        return 2;
+    }
+
+    size_t golden_count, candidate_count;
+    TraceEvent* golden = trace_read(paths[0], &golden_count);
+    TraceEvent* candidate = golden ? trace_read(paths[1], &candidate_count) : NULL;
+    if (!golden || !candidate) {
+        free(golden);
+        return 2;
+    }
+
+    int64_t golden_base = golden_count ? golden[0].time_100ns : 0;
+    int64_t candidate_base = candidate_count ? candidate[0].time_100ns : 0;
+
+    printf("golden:    %zu messages, %.3f s\n", golden_count,
+           golden_count ? ms(golden[golden_count - 1].time_100ns - golden_base) / 1000.0 : 0.0);
+    printf("candidate: %zu messages, %.3f s\n", candidate_count,
+           candidate_count ? ms(candidate[candidate_count - 1].time_100ns - candidate_base) / 1000.0 : 0.0);
+
+    // Messages: the common prefix up to the first difference
+    size_t common = golden_count < candidate_count ? golden_count : candidate_count;
+    size_t aligned = 0;
+    while (aligned < common && golden[aligned].message == candidate[aligned].message) {
+        aligned++;
+    }
+    bool messages_match = aligned == golden_count && aligned == candidate_count;
+    if (messages_match) {
+        printf("messages:  identical\n");
+    } else if (aligned < common) {
+        printf("messages:  first difference at #%zu (%.3f ms): golden %06x, candidate %06x\n",
+               aligned, ms(golden[aligned].time_100ns - golden_base),
+               golden[aligned].message, candidate[aligned].message);
+    } else {
+        printf("messages:  candidate %s after %zu messages\n",
+               candidate_count < golden_count ? "ends early" : "has extra messages", aligned);
+    }
+
+    // Timing over the aligned messages
+    int64_t tolerance = (int64_t)(tolerance_ms * 10000.0);
+    size_t outside = 0;
+    bool timing_exact = true;
+    if (aligned > 0) {
+        int64_t* drift = malloc(aligned * sizeof(int64_t));
+        if (!drift) {
+            fprintf(stderr, "Out of memory\n");
+            free(golden);
+            free(candidate);
+            return 2;
+        }
+
+        double sum = 0, sum_sq = 0;
+        int64_t worst = 0;
+        size_t worst_at = 0;
+        for (size_t i = 0; i < aligned; i++) {
+            int64_t d = (candidate[i].time_100ns - candidate_base) - (golden[i].time_100ns - golden_base);
+            sum += d;
+            sum_sq += (double)d * d;
+            if (llabs(d) > llabs(worst)) {
+                worst = d;
+                worst_at = i;
+            }
+            if (d != 0) timing_exact = false;
+            if (llabs(d) > tolerance) outside++;
+            drift[i] = llabs(d);
+        }
+        qsort(drift, aligned, sizeof(int64_t), compare_abs);
+
+        double mean = sum / aligned;
+        double stddev = sqrt(fmax(0.0, sum_sq / aligned - mean * mean));
+        printf("timing:    %s\n", timing_exact ? "identical" : "drift (candidate - golden)");
+        if (!timing_exact) {
+            printf("  mean     %+.3f ms\n", ms((int64_t)mean));
+            printf("  stddev   %.3f ms\n", ms((int64_t)stddev));
+            printf("  |p50|    %.3f ms\n", ms(drift[aligned / 2]));
+            printf("  |p99|    %.3f ms\n", ms(drift[(size_t)(aligned * 0.99)]));
+            printf("  max      %+.3f ms at #%zu\n", ms(worst), worst_at);
+            printf("  outside  %zu of %zu beyond %.3f ms\n", outside, aligned, tolerance_ms);
+        }
+        free(drift);
+    }
+
+    bool ok = messages_match && outside == 0;
+    printf("result:    %s\n", ok ? (timing_exact ? "exact match" : "match within tolerance") : "MISMATCH");
+
+    free(golden);
+    free(candidate);
+    return ok ? 0 : 1;
+}
@@ -14,7 +14,7 @@ target("midi_player")
     set_kind("binary")
     add_files("src/*.c")
     add_includedirs("include")
-    add_links("asound")
+    add_links("asound", "m", "z", "lzma", "zstd", "rt")
     -- Exclude NAPI binding from binary
     remove_files("src/napi_binding.c")
 
@@ -27,6 +27,44 @@ target("midi_player")
         end
     end)
 
+-- Client for the daemon mode (midi_player --daemon=<socket>)
+target("midi_player_ctl")
+    set_kind("binary")
+    add_files("tools/midi_player_ctl.c")
+
+-- Diffs capture traces (midi_player --capture=<file>)
+target("trace_compare")
+    set_kind("binary")
+    add_files("tools/trace_compare.c", "src/trace.c")
+    add_includedirs("include")
+    add_links("m")
+
+-- Consumer side of midi_player --shm=<name>, for a synthesizer process to link
+target("shm_ring")
+    set_kind("static")
+    add_files("src/shm-ring.c")
+    add_includedirs("include", {public = true})
+    add_syslinks("rt", {public = true})
+
+-- Reference consumer: drains a --shm ring and reports rate and lag
+target("shm_ring_stat")
+    set_kind("binary")
+    add_files("tools/shm_ring_stat.c", "src/trace.c")
+    add_deps("shm_ring")
+
+-- Stand-in KDMAPI library for headless tests (midi_player --kdmapi=<lib>)
+target("kdmapi_mock")
+    set_kind("shared")
+    set_filename("libkdmapi_mock.so")
+    add_files("tools/kdmapi_mock.c")
+
+-- The same with only the entrypoints of old KDMAPI versions, for the fallbacks
+target("kdmapi_mock_legacy")
+    set_kind("shared")
+    set_filename("libkdmapi_mock_legacy.so")
+    add_files("tools/kdmapi_mock.c")
+    add_defines("KDMAPI_MOCK_LEGACY")
+
 -- Node.js N-API target
 target("midi_player_napi")
     set_kind("shared")
@@ -34,7 +72,7 @@ target("midi_player_napi")
     add_files("src/*.c")
     remove_files("src/main.c")  -- Remove the main.c file from this target
     add_includedirs("include")
-    add_links("asound")
+    add_links("asound", "m", "z", "lzma", "zstd", "rt")
     
     -- Add Node.js include paths for different platforms
     if is_plat("linux") then